@@ -1,6 +1,16 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <unordered_set>
 #include <benchmark/benchmark.h>
+#include "ecs/ArchetypeEntityManager.h"
 #include "ecs/Component.h"
 #include "ecs/EntityManager.h"
+#include "ecs/RollbackBuffer.h"
+#include "ecs/SnapshotWriter.h"
 
 using namespace ecs;
 
@@ -36,29 +46,64 @@ struct Mass : public Component<Mass>
     float value;
 };
 
+template<>
+struct ecs::ComponentTraits<Position> : ecs::DefaultComponentTraits
+{
+    using Fields = ecs::Fields<&Position::x, &Position::y>;
+};
+
+template<>
+struct ecs::ComponentTraits<Velocity> : ecs::DefaultComponentTraits
+{
+    using Fields = ecs::Fields<&Velocity::x, &Velocity::y>;
+};
+
+template<bool Paged>
+struct Particle : public Component<Particle<Paged>>
+{
+    std::array<float, 16> data = {};
+};
+
+template<>
+struct ecs::ComponentTraits<Particle<true>> : ecs::DefaultComponentTraits
+{
+    static constexpr auto PagedStorage = true;
+};
+
+struct Temperature : public Component<Temperature>
+{
+    float value = 0.0f;
+};
+
+template<>
+struct ecs::ComponentTraits<Temperature> : ecs::DefaultComponentTraits
+{
+    static constexpr auto TrackChanges = true;
+};
+
 template<typename ...Components, size_t ...Is>
 void extractComponents(const std::tuple<Components&...>& components, std::index_sequence<Is...>)
 {
     benchmark::DoNotOptimize((std::get<Is>(components), ...));
 }
 
-template<typename ...Components>
+template<typename Manager, typename ...Components>
 class DummySystem
 {
 public:
-    DummySystem(EntityManager& entityManager) : mEntityManager(entityManager)
+    DummySystem(Manager& entityManager) : mEntityManager(entityManager)
     {
 
     }
 
     void update()
     {
-        for (auto [entity, components] : mEntityManager.getEntitySet<Components...>())
+        for (auto [entity, components] : mEntityManager.template getEntitySet<Components...>())
             extractComponents(components, std::index_sequence_for<Components...>{});
     }
 
 private:
-    EntityManager& mEntityManager;
+    Manager& mEntityManager;
 };
 
 constexpr auto MinNbEntities = 100000;
@@ -79,12 +124,12 @@ void createEntities(benchmark::State& state)
             else
             {
                 auto entity = manager.createEntity();
-                (manager.addComponent<Components>(entity), ...);
+                (manager.template addComponent<Components>(entity), ...);
             }
         }
     }
-    auto nbItems = static_cast<int>(state.iterations()) * state.range();
-    state.SetItemsProcessed(static_cast<std::size_t>(nbItems));
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
     state.SetComplexityN(state.range());
 }
 BENCHMARK_TEMPLATE(createEntities, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
@@ -93,27 +138,675 @@ BENCHMARK_TEMPLATE(createEntities, false, Position)->RangeMultiplier(10)->Range(
 BENCHMARK_TEMPLATE(createEntities, false, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
 BENCHMARK_TEMPLATE(createEntities, false, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
 
-template<bool Reserve, typename ...Components>
+template<typename ...Components>
+void createEntitiesInBulk(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        auto manager = EntityManager();
+        benchmark::DoNotOptimize(manager.createEntities<Components...>(static_cast<std::size_t>(state.range())));
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(createEntitiesInBulk, Position)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(createEntitiesInBulk, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(createEntitiesInBulk, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+template<typename ...Components>
+void removeEntitiesInBulk(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto manager = EntityManager();
+        auto entities = manager.createEntities<Components...>(static_cast<std::size_t>(state.range()));
+        state.ResumeTiming();
+        manager.removeEntities(entities);
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(removeEntitiesInBulk, Position)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(removeEntitiesInBulk, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(removeEntitiesInBulk, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+template<bool Batched>
+void createEntitiesWithListeners(benchmark::State& state)
+{
+    constexpr auto NbListeners = 4;
+    for (auto _ : state)
+    {
+        auto manager = EntityManager();
+        auto& entitySet = manager.getEntitySet<Position, Velocity>();
+        auto sum = std::underlying_type_t<Entity>(0);
+        for (auto i = 0; i < NbListeners; ++i)
+        {
+            if constexpr (Batched)
+            {
+                entitySet.addEntitiesAddedListener([&sum](Span<const Entity> entities)
+                {
+                    for (auto entity : entities)
+                        sum += static_cast<std::underlying_type_t<Entity>>(entity);
+                });
+            }
+            else
+            {
+                entitySet.addEntityAddedListener([&sum](Entity entity)
+                {
+                    sum += static_cast<std::underlying_type_t<Entity>>(entity);
+                });
+            }
+        }
+        benchmark::DoNotOptimize(manager.createEntities<Position, Velocity>(static_cast<std::size_t>(state.range())));
+        manager.notifyListeners();
+        benchmark::DoNotOptimize(sum);
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(createEntitiesWithListeners, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(createEntitiesWithListeners, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+template<bool Arena>
+void createAndDestroyWorld(benchmark::State& state)
+{
+    auto buffer = std::vector<std::byte>(std::size_t(64) << 20);
+    for (auto _ : state)
+    {
+        auto resource = std::pmr::monotonic_buffer_resource(buffer.data(), buffer.size());
+        auto manager = Arena ? EntityManager(&resource) : EntityManager();
+        benchmark::DoNotOptimize(manager.createEntities<Position, Velocity>(static_cast<std::size_t>(state.range())));
+        for (auto i = 0; i < state.range(); i += 2)
+            manager.addComponent<Mass>(static_cast<Entity>(i));
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(createAndDestroyWorld, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(createAndDestroyWorld, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+// Measure the latency of each insertion, the worst ones happen when the storage grows
+template<bool Paged>
+void addComponentLatency(benchmark::State& state)
+{
+    auto nbEntities = static_cast<std::size_t>(state.range());
+    auto latencies = std::vector<std::chrono::steady_clock::duration>(nbEntities);
+    auto maxLatency = std::chrono::steady_clock::duration::zero();
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto manager = EntityManager();
+        auto entities = manager.createEntities<>(nbEntities);
+        state.ResumeTiming();
+        for (auto i = std::size_t(0); i < nbEntities; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            manager.addComponent<Particle<Paged>>(entities[i]);
+            latencies[i] = std::chrono::steady_clock::now() - start;
+        }
+        maxLatency = std::max(maxLatency, *std::max_element(std::begin(latencies), std::end(latencies)));
+    }
+    std::sort(std::begin(latencies), std::end(latencies));
+    state.counters["p99.9_ns"] = static_cast<double>(std::chrono::nanoseconds(latencies[latencies.size() * 999 / 1000]).count());
+    state.counters["max_ns"] = static_cast<double>(std::chrono::nanoseconds(maxLatency).count());
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+}
+BENCHMARK_TEMPLATE(addComponentLatency, false)->RangeMultiplier(10)->Range(MaxNbEntities, 10 * MaxNbEntities);
+BENCHMARK_TEMPLATE(addComponentLatency, true)->RangeMultiplier(10)->Range(MaxNbEntities, 10 * MaxNbEntities);
+
+template<typename Manager, bool Reserve, typename ...Components>
 void iterateEntities(benchmark::State& state)
 {
-    auto manager = EntityManager();
-    auto system = DummySystem<Components...>(manager);
+    auto manager = Manager();
+    auto system = DummySystem<Manager, Components...>(manager);
     if constexpr (Reserve)
         manager.reserve(static_cast<std::size_t>(state.range()));
     for (auto i = 0; i < state.range(); ++i)
     {
         auto entity = manager.createEntity();
-        (manager.addComponent<Components>(entity), ...);
+        (manager.template addComponent<Components>(entity), ...);
     }
     for (auto _ : state)
         system.update();
-    auto nbItems = static_cast<int>(state.iterations()) * state.range();
-    state.SetItemsProcessed(static_cast<std::size_t>(nbItems));
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(iterateEntities, EntityManager, false, Position)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(iterateEntities, EntityManager, false, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(iterateEntities, EntityManager, false, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(iterateEntities, ArchetypeEntityManager, false, Position)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(iterateEntities, ArchetypeEntityManager, false, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(iterateEntities, ArchetypeEntityManager, false, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+// Half of the entities have a mass and one fourth are excluded because they have a velocity
+template<bool Filtered>
+void iterateWithFilters(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto entities = manager.createEntities<Position>(static_cast<std::size_t>(state.range()));
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        if (i % 2 == 0)
+            manager.addComponent<Mass>(entities[i]);
+        if (i % 4 == 1)
+            manager.addComponent<Velocity>(entities[i]);
+    }
+    for (auto _ : state)
+    {
+        auto sum = 0.0f;
+        if constexpr (Filtered)
+        {
+            manager.getEntitySet<With<Position>, Without<Velocity>, Optional<Mass>>().forEach(
+                [&sum]([[maybe_unused]] Entity entity, const Position& position, const Mass* mass)
+            {
+                sum += position.x + (mass != nullptr ? mass->value : 0.0f);
+            });
+        }
+        else
+        {
+            std::as_const(manager.getEntitySet<Position>()).forEach([&manager, &sum](Entity entity, const Position& position)
+            {
+                if (manager.hasComponent<Velocity>(entity))
+                    return;
+                sum += position.x + (manager.hasComponent<Mass>(entity) ? std::as_const(manager).getComponent<Mass>(entity).value : 0.0f);
+            });
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(iterateWithFilters, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(iterateWithFilters, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+enum class UpdateMode
+{
+    Iterator,
+    ForEach,
+    Chunks,
+    Scalars
+};
+
+template<UpdateMode Mode, bool Owning>
+void updatePositions(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto& entitySet = Owning ? manager.getOwningEntitySet<Position, Velocity>() : manager.getEntitySet<Position, Velocity>();
+    manager.createEntities<Position, Velocity>(static_cast<std::size_t>(state.range()));
+    constexpr auto dt = 0.016f;
+    for (auto _ : state)
+    {
+        if constexpr (Mode == UpdateMode::Iterator)
+        {
+            for (auto [entity, components] : entitySet)
+            {
+                auto& [position, velocity] = components;
+                position.x += velocity.x * dt;
+                position.y += velocity.y * dt;
+            }
+        }
+        else if constexpr (Mode == UpdateMode::ForEach)
+        {
+            entitySet.forEach([]([[maybe_unused]] Entity entity, Position& position, const Velocity& velocity)
+            {
+                position.x += velocity.x * dt;
+                position.y += velocity.y * dt;
+            });
+        }
+        else if constexpr (Mode == UpdateMode::Chunks)
+        {
+            entitySet.forEachChunk([]([[maybe_unused]] Span<const Entity> entities, Span<Position> positions, Span<Velocity> velocities)
+            {
+                for (auto i = std::size_t(0); i < positions.size(); ++i)
+                {
+                    positions[i].x += velocities[i].x * dt;
+                    positions[i].y += velocities[i].y * dt;
+                }
+            });
+        }
+        else
+        {
+            auto positions = entitySet.getScalars<Position>();
+            auto velocities = std::as_const(entitySet).getScalars<Velocity>();
+            auto size = positions.size();
+            auto* __restrict x = positions.data();
+            const auto* __restrict v = velocities.data();
+            for (auto i = std::size_t(0); i < size; ++i)
+                x[i] += v[i] * dt;
+        }
+        benchmark::ClobberMemory();
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(updatePositions, UpdateMode::Iterator, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(updatePositions, UpdateMode::ForEach, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(updatePositions, UpdateMode::Chunks, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(updatePositions, UpdateMode::Iterator, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(updatePositions, UpdateMode::ForEach, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(updatePositions, UpdateMode::Chunks, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(updatePositions, UpdateMode::Scalars, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+enum class SortMode
+{
+    None,
+    EntitySet,
+    EntitySetAndComponents,
+    Incremental
+};
+
+// Long-running world where the positions and the velocities of random entities are removed and added back every frame,
+// which scatters the entity set relative to the storage of the components
+// Each frame the entity set is maintained according to Mode then iterated, only the iteration is timed and the average
+// time spent to maintain the set is reported in the maintenance counter
+template<SortMode Mode>
+void iterateFragmentedEntities(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto& entitySet = manager.getEntitySet<Position, Velocity>();
+    auto nbEntities = static_cast<std::size_t>(state.range());
+    auto entities = manager.createEntities<Position, Velocity>(nbEntities);
+    auto generator = std::mt19937(42);
+    auto distribution = std::uniform_int_distribution<std::size_t>(0, nbEntities - 1);
+    auto nbChurnedEntities = nbEntities / 100;
+    auto churn = [&]()
+    {
+        for (auto i = std::size_t(0); i < nbChurnedEntities; ++i)
+        {
+            auto entity = entities[distribution(generator)];
+            manager.removeComponent<Position>(entity);
+            manager.addComponent<Position>(entity);
+            entity = entities[distribution(generator)];
+            manager.removeComponent<Velocity>(entity);
+            manager.addComponent<Velocity>(entity);
+        }
+    };
+    auto maintain = [&]()
+    {
+        if constexpr (Mode == SortMode::EntitySet)
+            entitySet.sort<Position>();
+        else if constexpr (Mode == SortMode::EntitySetAndComponents)
+        {
+            entitySet.sort<Position>();
+            manager.sortComponents<Velocity>(entitySet);
+        }
+        else if constexpr (Mode == SortMode::Incremental)
+            entitySet.sortIncrementally<Position>(nbEntities);
+    };
+    constexpr auto dt = 0.016f;
+    auto update = [&entitySet]()
+    {
+        entitySet.forEach([]([[maybe_unused]] Entity entity, Position& position, const Velocity& velocity)
+        {
+            position.x += velocity.x * dt;
+            position.y += velocity.y * dt;
+        });
+    };
+    // Uptime
+    for (auto frame = 0; frame < 200; ++frame)
+    {
+        churn();
+        maintain();
+    }
+    auto maintenanceTime = 0.0;
+    for (auto _ : state)
+    {
+        churn();
+        auto start = std::chrono::steady_clock::now();
+        maintain();
+        auto end = std::chrono::steady_clock::now();
+        maintenanceTime += std::chrono::duration<double>(end - start).count();
+        update();
+        benchmark::ClobberMemory();
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - end).count());
+    }
+    state.counters["maintenance"] = benchmark::Counter(maintenanceTime, benchmark::Counter::kAvgIterations);
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+}
+BENCHMARK_TEMPLATE(iterateFragmentedEntities, SortMode::None)->Arg(MaxNbEntities)->Arg(10 * MaxNbEntities)->UseManualTime();
+BENCHMARK_TEMPLATE(iterateFragmentedEntities, SortMode::EntitySet)->Arg(MaxNbEntities)->Arg(10 * MaxNbEntities)->UseManualTime();
+BENCHMARK_TEMPLATE(iterateFragmentedEntities, SortMode::EntitySetAndComponents)->Arg(MaxNbEntities)->Arg(10 * MaxNbEntities)->UseManualTime();
+BENCHMARK_TEMPLATE(iterateFragmentedEntities, SortMode::Incremental)->Arg(MaxNbEntities)->Arg(10 * MaxNbEntities)->UseManualTime();
+
+// Visit the entities whose temperature changed since the last tick, state.range(1) is the percentage of modified entities
+// If it is 0, all the entities are scanned instead
+// Only the visit is timed
+void iterateChangedEntities(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto& entitySet = std::as_const(manager.getEntitySet<Temperature>());
+    auto nbEntities = static_cast<std::size_t>(state.range(0));
+    auto entities = manager.createEntities<Temperature>(nbEntities);
+    auto step = state.range(1) > 0 ? 100 / static_cast<std::size_t>(state.range(1)) : nbEntities;
+    for (auto _ : state)
+    {
+        auto tick = manager.getTick();
+        manager.nextTick();
+        for (auto i = std::size_t(0); i < nbEntities; i += step)
+            manager.getComponent<Temperature>(entities[i]).value += 1.0f;
+        auto start = std::chrono::steady_clock::now();
+        auto sum = 0.0f;
+        auto visit = [&sum]([[maybe_unused]] Entity entity, const Temperature& temperature)
+        {
+            sum += temperature.value;
+        };
+        if (state.range(1) > 0)
+            entitySet.forEach<Changed<Temperature>>(tick, visit);
+        else
+            entitySet.forEach(visit);
+        benchmark::DoNotOptimize(sum);
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    auto nbItems = state.iterations() * state.range(0);
+    state.SetItemsProcessed(nbItems);
+}
+BENCHMARK(iterateChangedEntities)->ArgsProduct({{MaxNbEntities}, {0, 1, 10, 100}})->UseManualTime();
+
+template<typename ...Components>
+void parallelIterateEntities(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto pool = ThreadPool(static_cast<std::size_t>(state.range(1)));
+    for (auto i = 0; i < state.range(0); ++i)
+    {
+        auto entity = manager.createEntity();
+        (manager.addComponent<Components>(entity), ...);
+    }
+    auto& entitySet = manager.getEntitySet<Components...>();
+    for (auto _ : state)
+    {
+        entitySet.parallelForEach([]([[maybe_unused]] Entity entity, Components&... components)
+        {
+            (benchmark::DoNotOptimize(components), ...);
+        }, 4096, pool);
+    }
+    auto nbItems = state.iterations() * state.range(0);
+    state.SetItemsProcessed(nbItems);
+}
+BENCHMARK_TEMPLATE(parallelIterateEntities, Position, Velocity)->ArgsProduct({{MaxNbEntities}, {1, 2, 4, 8}})->UseRealTime();
+BENCHMARK_TEMPLATE(parallelIterateEntities, Position, Velocity, Mass)->ArgsProduct({{MaxNbEntities}, {1, 2, 4, 8}})->UseRealTime();
+
+template<typename ...Components>
+void addThenRemoveComponents(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto entities = std::vector<Entity>();
+    for (auto i = 0; i < state.range(); ++i)
+    {
+        auto entity = manager.createEntity();
+        manager.addComponent<Position>(entity);
+        entities.push_back(entity);
+    }
+    for (auto _ : state)
+    {
+        for (const auto& entity : entities)
+            (manager.addComponent<Components>(entity), ...);
+        for (const auto& entity : entities)
+            (manager.removeComponent<Components>(entity), ...);
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(addThenRemoveComponents, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(addThenRemoveComponents, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+// All the permutations of Position, Velocity and Mass are requested, they share the same maintained set
+void addThenRemoveComponentsWithPermutations(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    manager.getEntitySet<Position, Velocity, Mass>();
+    manager.getEntitySet<Position, Mass, Velocity>();
+    manager.getEntitySet<Velocity, Position, Mass>();
+    manager.getEntitySet<Velocity, Mass, Position>();
+    manager.getEntitySet<Mass, Position, Velocity>();
+    manager.getEntitySet<Mass, Velocity, Position>();
+    auto entities = std::vector<Entity>();
+    for (auto i = 0; i < state.range(); ++i)
+    {
+        auto entity = manager.createEntity();
+        manager.addComponent<Position>(entity);
+        entities.push_back(entity);
+    }
+    for (auto _ : state)
+    {
+        for (const auto& entity : entities)
+        {
+            manager.addComponent<Velocity>(entity);
+            manager.addComponent<Mass>(entity);
+        }
+        for (const auto& entity : entities)
+        {
+            manager.removeComponent<Velocity>(entity);
+            manager.removeComponent<Mass>(entity);
+        }
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
     state.SetComplexityN(state.range());
 }
-BENCHMARK_TEMPLATE(iterateEntities, false, Position)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
-BENCHMARK_TEMPLATE(iterateEntities, false, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
-BENCHMARK_TEMPLATE(iterateEntities, false, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK(addThenRemoveComponentsWithPermutations)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+// Half of the handles are stale, they are detected either by the generation of the entities or by a side table of the
+// live entities as it was needed before entities were generational
+template<bool SideTable>
+void checkEntities(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto liveEntities = std::unordered_set<Entity>();
+    auto entities = std::vector<Entity>();
+    for (auto i = 0; i < state.range(); ++i)
+        entities.push_back(manager.createEntity());
+    for (auto i = 0; i < state.range(); i += 2)
+        manager.removeEntity(entities[static_cast<std::size_t>(i)]);
+    for (auto i = 0; i < state.range(); i += 2)
+        entities.push_back(manager.createEntity());
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        if (i % 2 == 1)
+            liveEntities.insert(entities[i]);
+    }
+    for (auto _ : state)
+    {
+        auto nbLiveEntities = std::size_t(0);
+        for (const auto& entity : entities)
+        {
+            if constexpr (SideTable)
+                nbLiveEntities += liveEntities.count(entity);
+            else
+                nbLiveEntities += manager.hasEntity(entity) ? std::size_t(1) : std::size_t(0);
+        }
+        benchmark::DoNotOptimize(nbLiveEntities);
+    }
+    auto nbItems = state.iterations() * static_cast<int64_t>(entities.size());
+    state.SetItemsProcessed(nbItems);
+}
+BENCHMARK_TEMPLATE(checkEntities, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(checkEntities, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+// Restore a world with an owning entity set either from a snapshot in memory or by replaying the creation of its
+// entities and components
+template<bool Snapshot>
+void restoreEntities(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    manager.getOwningEntitySet<Position, Velocity>();
+    for (auto i = 0; i < state.range(); ++i)
+    {
+        auto entity = manager.createEntity();
+        manager.addComponent<Position>(entity, static_cast<float>(i));
+        if (i % 2 == 0)
+            manager.addComponent<Velocity>(entity, static_cast<float>(i));
+        if (i % 3 == 0)
+            manager.addComponent<Mass>(entity, static_cast<float>(i));
+    }
+    auto stream = std::ostringstream();
+    manager.save(stream);
+    auto snapshot = stream.str();
+    // Align the snapshot as a memory-mapped file would be
+    auto data = std::vector<std::max_align_t>(snapshot.size() / sizeof(std::max_align_t) + 1);
+    std::memcpy(data.data(), snapshot.data(), snapshot.size());
+    for (auto _ : state)
+    {
+        auto restoredManager = EntityManager();
+        if constexpr (Snapshot)
+            restoredManager.load(Span<const std::byte>(reinterpret_cast<const std::byte*>(data.data()), snapshot.size()));
+        else
+        {
+            restoredManager.getOwningEntitySet<Position, Velocity>();
+            for (auto i = 0; i < state.range(); ++i)
+            {
+                auto entity = restoredManager.createEntity();
+                restoredManager.addComponent<Position>(entity, static_cast<float>(i));
+                if (i % 2 == 0)
+                    restoredManager.addComponent<Velocity>(entity, static_cast<float>(i));
+                if (i % 3 == 0)
+                    restoredManager.addComponent<Mass>(entity, static_cast<float>(i));
+            }
+        }
+        benchmark::DoNotOptimize(restoredManager);
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(restoreEntities, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(restoreEntities, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+// Time of the frame thread to checkpoint the world then update all the particles, either by saving the world or by
+// starting a background snapshot whose writing is not timed
+// A copy capture pauses for a bulk copy of the world, a fork capture pauses for the fork and the update then runs while
+// the child process writes the snapshot, so it takes a copy-on-write fault for each page it modifies
+template<bool Background, SnapshotWriter::Capture Capture = SnapshotWriter::Capture::Copy>
+void checkpointWorld(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    manager.createEntities<Position, Particle<false>>(static_cast<std::size_t>(state.range()));
+    auto& entitySet = manager.getEntitySet<Particle<false>>();
+    auto path = (std::filesystem::temp_directory_path() / "checkpoint.bin").string();
+    auto writer = SnapshotWriter(Capture);
+    for (auto _ : state)
+    {
+        if constexpr (Background)
+            writer.write(manager, path);
+        else
+            manager.save(path);
+        entitySet.forEach([]([[maybe_unused]] Entity entity, Particle<false>& particle)
+        {
+            particle.data[0] += 1.0f;
+        });
+        if constexpr (Background)
+        {
+            state.PauseTiming();
+            writer.wait();
+            state.ResumeTiming();
+        }
+    }
+    std::filesystem::remove(path);
+    auto worldSize = static_cast<double>(state.range()) * static_cast<double>(sizeof(Position) + sizeof(Particle<false>));
+    state.counters["world_MB"] = worldSize / (1024.0 * 1024.0);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(checkpointWorld, false)->Unit(benchmark::kMillisecond)->RangeMultiplier(10)->Range(MaxNbEntities, 10 * MaxNbEntities);
+BENCHMARK_TEMPLATE(checkpointWorld, true, SnapshotWriter::Capture::Copy)->Unit(benchmark::kMillisecond)->RangeMultiplier(10)->Range(MaxNbEntities, 10 * MaxNbEntities);
+#if defined(__unix__) || defined(__APPLE__)
+BENCHMARK_TEMPLATE(checkpointWorld, true, SnapshotWriter::Capture::Fork)->Unit(benchmark::kMillisecond)->RangeMultiplier(10)->Range(MaxNbEntities, 10 * MaxNbEntities);
+#endif
+
+// Checkpoint a world in which 5% of the temperatures are modified and 1% of the entities gain or lose a velocity between
+// two checkpoints, either by saving it fully or by saving a delta
+template<bool Delta>
+void checkpointChanges(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto entities = manager.createEntities<Position, Temperature>(static_cast<std::size_t>(state.range()));
+    manager.recordDeltas();
+    auto size = std::size_t(0);
+    auto k = std::size_t(0);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (auto i = k % 20; i < entities.size(); i += 20)
+            manager.getComponent<Temperature>(entities[i]).value += 1.0f;
+        for (auto i = k % 100; i < entities.size(); i += 100)
+        {
+            if (manager.hasComponent<Velocity>(entities[i]))
+                manager.removeComponent<Velocity>(entities[i]);
+            else
+                manager.addComponent<Velocity>(entities[i]);
+        }
+        ++k;
+        auto stream = std::ostringstream();
+        state.ResumeTiming();
+        if constexpr (Delta)
+            manager.saveDelta(stream);
+        else
+            manager.save(stream);
+        size = static_cast<std::size_t>(stream.tellp());
+    }
+    state.counters["size_kB"] = static_cast<double>(size) / 1024.0;
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(checkpointChanges, false)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(checkpointChanges, true)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
+enum class RollbackMode
+{
+    Rebuild,
+    Save,
+    Restore
+};
+
+// Save the state of the world in a rollback buffer or restore it, once the buffer is full, or rebuild it through the
+// API
+template<RollbackMode Mode>
+void rollbackWorld(benchmark::State& state)
+{
+    auto nbEntities = static_cast<std::size_t>(state.range());
+    auto manager = EntityManager();
+    manager.getOwningEntitySet<Position, Velocity>();
+    manager.getEntitySet<Position, Temperature>();
+    auto entities = manager.createEntities<Position, Velocity>(nbEntities);
+    for (auto i = std::size_t(0); i < nbEntities; i += 2)
+        manager.addComponent<Temperature>(entities[i]);
+    auto buffer = RollbackBuffer(8);
+    for (auto i = std::size_t(0); i < buffer.getCapacity(); ++i)
+        buffer.save(manager);
+    for (auto _ : state)
+    {
+        if constexpr (Mode == RollbackMode::Rebuild)
+        {
+            auto rebuiltManager = EntityManager();
+            rebuiltManager.getOwningEntitySet<Position, Velocity>();
+            rebuiltManager.getEntitySet<Position, Temperature>();
+            auto rebuiltEntities = rebuiltManager.createEntities<Position, Velocity>(nbEntities);
+            for (auto i = std::size_t(0); i < nbEntities; i += 2)
+                rebuiltManager.addComponent<Temperature>(rebuiltEntities[i]);
+            benchmark::DoNotOptimize(rebuiltManager);
+        }
+        else if constexpr (Mode == RollbackMode::Save)
+            buffer.save(manager);
+        else
+        {
+            buffer.restore(manager, 0);
+            benchmark::DoNotOptimize(manager);
+        }
+    }
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(rollbackWorld, RollbackMode::Rebuild)->Unit(benchmark::kMicrosecond)->Arg(50000);
+BENCHMARK_TEMPLATE(rollbackWorld, RollbackMode::Save)->Unit(benchmark::kMicrosecond)->Arg(50000);
+BENCHMARK_TEMPLATE(rollbackWorld, RollbackMode::Restore)->Unit(benchmark::kMicrosecond)->Arg(50000);
 
 template<bool Reserve, typename ...Components>
 void lookUpEntities(benchmark::State& state)
@@ -125,7 +818,7 @@ void lookUpEntities(benchmark::State& state)
     for (auto i = 0; i < state.range(); ++i)
     {
         auto entity = manager.createEntity();
-        (manager.addComponent<Components>(entity), ...);
+        (manager.template addComponent<Components>(entity), ...);
         entities.push_back(entity);
     }
     for (auto _ : state)
@@ -133,8 +826,8 @@ void lookUpEntities(benchmark::State& state)
         for (const auto& entity : entities)
             benchmark::DoNotOptimize(manager.getComponents<Components...>(entity));
     }
-    auto nbItems = static_cast<int>(state.iterations()) * state.range();
-    state.SetItemsProcessed(static_cast<std::size_t>(nbItems));
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
     state.SetComplexityN(state.range());
 }
 BENCHMARK_TEMPLATE(lookUpEntities, false, Position)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
@@ -151,7 +844,7 @@ void visitEntities(benchmark::State& state)
     for (auto i = 0; i < state.range(); ++i)
     {
         auto entity = manager.createEntity();
-        (manager.addComponent<Components>(entity), ...);
+        (manager.template addComponent<Components>(entity), ...);
         entities.push_back(entity);
     }
     auto visitor = Visitor();
@@ -161,14 +854,56 @@ void visitEntities(benchmark::State& state)
         for (const auto& entity : entities)
             manager.visitEntity(entity, visitor);
     }
-    auto nbItems = static_cast<int>(state.iterations()) * state.range();
-    state.SetItemsProcessed(static_cast<std::size_t>(nbItems));
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
     state.SetComplexityN(state.range());
 }
 BENCHMARK_TEMPLATE(visitEntities, false, Position)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
 BENCHMARK_TEMPLATE(visitEntities, false, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
 BENCHMARK_TEMPLATE(visitEntities, false, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
 
+enum class VisitMode
+{
+    Visitor,
+    Typed,
+    TypedInBulk
+};
+
+template<VisitMode Mode, typename ...Components>
+void visitEntitiesWithMode(benchmark::State& state)
+{
+    auto manager = EntityManager();
+    auto entities = manager.createEntities<Components...>(static_cast<std::size_t>(state.range()));
+    auto visitor = Visitor();
+    ((visitor.setHandler<Components>([](auto& component){ benchmark::DoNotOptimize(component); })), ...);
+    for (auto _ : state)
+    {
+        if constexpr (Mode == VisitMode::Visitor)
+        {
+            for (auto entity : entities)
+                manager.visitEntity(entity, visitor);
+        }
+        else if constexpr (Mode == VisitMode::Typed)
+        {
+            for (auto entity : entities)
+                manager.visitEntity<Components...>(entity, [](auto& component){ benchmark::DoNotOptimize(component); });
+        }
+        else
+        {
+            manager.visitEntities<Components...>(entities, []([[maybe_unused]] Entity entity, auto& component)
+            {
+                benchmark::DoNotOptimize(component);
+            });
+        }
+    }
+    auto nbItems = state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
+    state.SetComplexityN(state.range());
+}
+BENCHMARK_TEMPLATE(visitEntitiesWithMode, VisitMode::Visitor, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(visitEntitiesWithMode, VisitMode::Typed, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+BENCHMARK_TEMPLATE(visitEntitiesWithMode, VisitMode::TypedInBulk, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
+
 template<bool Reserve, std::size_t K, typename ...Components>
 void createThenRemoveEntities(benchmark::State& state)
 {
@@ -183,15 +918,15 @@ void createThenRemoveEntities(benchmark::State& state)
             for (auto i = 0; i < state.range(); ++i)
             {
                 auto entity = manager.createEntity();
-                (manager.addComponent<Components>(entity), ...);
+                (manager.template addComponent<Components>(entity), ...);
                 entities.push_back(entity);
             }
             for (const auto& entity : entities)
                 manager.removeEntity(entity);
         }
     }
-    auto nbItems = static_cast<int>(K * state.iterations()) * state.range();
-    state.SetItemsProcessed(static_cast<std::size_t>(nbItems));
+    auto nbItems = static_cast<int64_t>(K) * state.iterations() * state.range();
+    state.SetItemsProcessed(nbItems);
     state.SetComplexityN(state.range());
 }
 BENCHMARK_TEMPLATE(createThenRemoveEntities, true, 1)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
@@ -200,4 +935,4 @@ BENCHMARK_TEMPLATE(createThenRemoveEntities, false, 1, Position)->RangeMultiplie
 BENCHMARK_TEMPLATE(createThenRemoveEntities, false, 1, Position, Velocity)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
 BENCHMARK_TEMPLATE(createThenRemoveEntities, false, 1, Position, Velocity, Mass)->RangeMultiplier(10)->Range(MinNbEntities, MaxNbEntities);
 
-BENCHMARK_MAIN()
\ No newline at end of file
+BENCHMARK_MAIN();
\ No newline at end of file
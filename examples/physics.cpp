@@ -26,22 +26,49 @@ struct Velocity : public Component<Velocity>
     float y;
 };
 
+// List the fields of the components so that they can be accessed as columns
+template<>
+struct ecs::ComponentTraits<Position> : ecs::DefaultComponentTraits
+{
+    using Fields = ecs::Fields<&Position::x, &Position::y>;
+};
+
+template<>
+struct ecs::ComponentTraits<Velocity> : ecs::DefaultComponentTraits
+{
+    using Fields = ecs::Fields<&Velocity::x, &Velocity::y>;
+};
+
 class PhysicsSystem
 {
 public:
     PhysicsSystem(EntityManager& entityManager) : mEntityManager(entityManager)
     {
-
+        // The system is the only one to iterate over positions and velocities, it can keep them packed
+        mEntityManager.getOwningEntitySet<Position, Velocity>();
     }
 
     void update(float dt)
     {
-        for (auto [entity, components] : mEntityManager.getEntitySet<Position, Velocity>())
+        mEntityManager.getEntitySet<Position, Velocity>().forEach([dt]([[maybe_unused]] Entity entity, Position& position, const Velocity& velocity)
         {
-            auto [position, velocity] = components;
             position.x += velocity.x * dt;
             position.y += velocity.y * dt;
-        }
+        });
+    }
+
+    // Same as update but positions and velocities are processed as arrays of floats, the loop is vectorized by the compiler
+    // Position and Velocity have the same fields in the same order so the i-th float of both arrays match
+    void updateVectorized(float dt)
+    {
+        auto& entitySet = mEntityManager.getEntitySet<Position, Velocity>();
+        auto positions = entitySet.getScalars<Position>();
+        auto velocities = std::as_const(entitySet).getScalars<Velocity>();
+        auto size = positions.size();
+        auto* __restrict x = positions.data();
+        const auto* __restrict v = velocities.data();
+        for (auto i = std::size_t(0); i < size; ++i)
+            x[i] += v[i] * dt;
     }
 
 private:
@@ -67,7 +94,7 @@ int main()
         auto time = std::chrono::system_clock::now();
         auto dt = std::chrono::duration<float>(time - prevTime).count();
         prevTime = time;
-        system.update(dt);
+        system.updateVectorized(dt);
     }
     return 0;
 }
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <vector>
+#include "Component.h"
+#include "Config.h"
+#include "Entity.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Storage for all the entities sharing the same set of components
+// Entities are packed into fixed-size chunks, each chunk stores one column per component type
+class Archetype
+{
+    struct ChunkDeleter
+    {
+        void operator()(std::byte* data) const
+        {
+            ::operator delete(data, std::align_val_t(ChunkAlignment));
+        }
+    };
+
+    using Chunk = std::unique_ptr<std::byte[], ChunkDeleter>;
+
+public:
+    static constexpr auto ChunkSize = std::size_t(16384);
+    static constexpr auto ChunkAlignment = std::size_t(64);
+    static constexpr auto Undefined = std::numeric_limits<std::size_t>::max();
+
+    explicit Archetype(std::vector<ComponentType> componentTypes) :
+        mComponentTypes(std::move(componentTypes))
+    {
+        std::sort(std::begin(mComponentTypes), std::end(mComponentTypes));
+        // Compute the number of entities per chunk
+        auto rowSize = sizeof(Entity);
+        auto padding = std::size_t(0);
+        for (auto type : mComponentTypes)
+        {
+            const auto& descriptor = BaseComponent::getComponentDescriptor(type);
+            rowSize += descriptor.size;
+            padding += descriptor.alignment;
+        }
+        mChunkCapacity = std::max<std::size_t>(1, (ChunkSize - padding) / rowSize);
+        // Compute the offsets of the columns
+        auto offset = sizeof(Entity) * mChunkCapacity;
+        mTypeToColumn.resize(BaseComponent::getComponentCount(), Undefined);
+        for (auto i = std::size_t(0); i < mComponentTypes.size(); ++i)
+        {
+            const auto& descriptor = BaseComponent::getComponentDescriptor(mComponentTypes[i]);
+            offset = (offset + descriptor.alignment - 1) / descriptor.alignment * descriptor.alignment;
+            mColumns.push_back(Column{offset, descriptor.size, &descriptor});
+            mTypeToColumn[mComponentTypes[i]] = i;
+            offset += descriptor.size * mChunkCapacity;
+        }
+        mChunkByteSize = std::max(offset, ChunkSize);
+    }
+
+    Archetype(const Archetype&) = delete;
+    Archetype& operator=(const Archetype&) = delete;
+
+    ~Archetype()
+    {
+        for (auto row = std::size_t(0); row < mSize; ++row)
+        {
+            for (auto& column : mColumns)
+                column.descriptor->destroy(getComponent(row, column));
+        }
+    }
+
+    const std::vector<ComponentType>& getComponentTypes() const
+    {
+        return mComponentTypes;
+    }
+
+    bool hasComponent(ComponentType type) const
+    {
+        return type < mTypeToColumn.size() && mTypeToColumn[type] != Undefined;
+    }
+
+    std::size_t getSize() const
+    {
+        return mSize;
+    }
+
+    // Chunks
+
+    std::size_t getChunkCapacity() const
+    {
+        return mChunkCapacity;
+    }
+
+    std::size_t getChunkCount() const
+    {
+        return (mSize + mChunkCapacity - 1) / mChunkCapacity;
+    }
+
+    std::size_t getChunkSize(std::size_t chunk) const
+    {
+        return std::min(mChunkCapacity, mSize - chunk * mChunkCapacity);
+    }
+
+    Entity* getEntities(std::size_t chunk)
+    {
+        return reinterpret_cast<Entity*>(mChunks[chunk].get());
+    }
+
+    const Entity* getEntities(std::size_t chunk) const
+    {
+        return reinterpret_cast<const Entity*>(mChunks[chunk].get());
+    }
+
+    template<typename T>
+    T* getColumn(std::size_t chunk)
+    {
+        return reinterpret_cast<T*>(mChunks[chunk].get() + mColumns[mTypeToColumn[T::Type]].offset);
+    }
+
+    template<typename T>
+    const T* getColumn(std::size_t chunk) const
+    {
+        return reinterpret_cast<const T*>(mChunks[chunk].get() + mColumns[mTypeToColumn[T::Type]].offset);
+    }
+
+    // Rows
+
+    Entity getEntity(std::size_t row) const
+    {
+        return getEntities(row / mChunkCapacity)[row % mChunkCapacity];
+    }
+
+    void* getComponent(std::size_t row, ComponentType type)
+    {
+        return getComponent(row, mColumns[mTypeToColumn[type]]);
+    }
+
+    template<typename T>
+    T& getComponent(std::size_t row)
+    {
+        return getColumn<T>(row / mChunkCapacity)[row % mChunkCapacity];
+    }
+
+    template<typename T>
+    const T& getComponent(std::size_t row) const
+    {
+        return getColumn<T>(row / mChunkCapacity)[row % mChunkCapacity];
+    }
+
+    // Allocate a row for entity, the components of the row are left uninitialized
+    std::size_t allocate(Entity entity)
+    {
+        auto row = mSize;
+        if (row / mChunkCapacity == mChunks.size())
+            mChunks.emplace_back(static_cast<std::byte*>(::operator new(mChunkByteSize, std::align_val_t(ChunkAlignment))));
+        getEntities(row / mChunkCapacity)[row % mChunkCapacity] = entity;
+        ++mSize;
+        return row;
+    }
+
+    // Release the last row, whose components have not been constructed, to undo allocate
+    void deallocate()
+    {
+        --mSize;
+    }
+
+    // Move the components of row into a newly allocated row of archetype, the components of row are left in a moved-from state
+    std::size_t moveTo(std::size_t row, Archetype& archetype)
+    {
+        auto newRow = archetype.allocate(getEntity(row));
+        moveTo(row, archetype, newRow);
+        return newRow;
+    }
+
+    // Same as above but the row of archetype is already allocated, its components that row does not have are left as is
+    void moveTo(std::size_t row, Archetype& archetype, std::size_t newRow)
+    {
+        for (auto i = std::size_t(0); i < mColumns.size(); ++i)
+        {
+            if (archetype.hasComponent(mComponentTypes[i]))
+                mColumns[i].descriptor->moveConstruct(archetype.getComponent(newRow, mComponentTypes[i]), getComponent(row, mColumns[i]));
+        }
+    }
+
+    // Destroy the components of row and fill the hole with the last row
+    // Return the entity that has been moved into row
+    Entity erase(std::size_t row)
+    {
+        auto last = mSize - 1;
+        for (auto& column : mColumns)
+        {
+            auto component = getComponent(row, column);
+            column.descriptor->destroy(component);
+            if (row != last)
+            {
+                auto lastComponent = getComponent(last, column);
+                column.descriptor->moveConstruct(component, lastComponent);
+                column.descriptor->destroy(lastComponent);
+            }
+        }
+        auto lastEntity = getEntity(last);
+        getEntities(row / mChunkCapacity)[row % mChunkCapacity] = lastEntity;
+        --mSize;
+        // Keep the reserved chunks and one spare chunk to avoid allocation ping-pong
+        if (mChunks.size() > std::max(getChunkCount() + 1, mNbReservedChunks))
+            mChunks.pop_back();
+        return lastEntity;
+    }
+
+    // The chunks allocated for size rows are kept when rows are erased
+    void reserve(std::size_t size)
+    {
+        mNbReservedChunks = std::max(mNbReservedChunks, (size + mChunkCapacity - 1) / mChunkCapacity);
+        while (mChunks.size() < mNbReservedChunks)
+            mChunks.emplace_back(static_cast<std::byte*>(::operator new(mChunkByteSize, std::align_val_t(ChunkAlignment))));
+    }
+
+    // Number of rows that can be allocated without allocating a chunk
+    std::size_t getCapacity() const
+    {
+        return mChunks.size() * mChunkCapacity;
+    }
+
+    // Edges of the archetype graph
+
+    std::size_t getAddEdge(ComponentType type) const
+    {
+        return type < mAddEdges.size() ? mAddEdges[type] : Undefined;
+    }
+
+    void setAddEdge(ComponentType type, std::size_t archetype)
+    {
+        if (type >= mAddEdges.size())
+            mAddEdges.resize(BaseComponent::getComponentCount(), Undefined);
+        mAddEdges[type] = archetype;
+    }
+
+    std::size_t getRemoveEdge(ComponentType type) const
+    {
+        return type < mRemoveEdges.size() ? mRemoveEdges[type] : Undefined;
+    }
+
+    void setRemoveEdge(ComponentType type, std::size_t archetype)
+    {
+        if (type >= mRemoveEdges.size())
+            mRemoveEdges.resize(BaseComponent::getComponentCount(), Undefined);
+        mRemoveEdges[type] = archetype;
+    }
+
+private:
+    struct Column
+    {
+        std::size_t offset;
+        std::size_t size;
+        const ComponentDescriptor* descriptor;
+    };
+
+    std::vector<ComponentType> mComponentTypes;
+    std::vector<std::size_t> mTypeToColumn;
+    std::vector<Column> mColumns;
+    std::size_t mChunkCapacity;
+    std::size_t mChunkByteSize;
+    std::vector<Chunk> mChunks;
+    std::size_t mNbReservedChunks = 0;
+    std::size_t mSize = 0;
+    std::vector<std::size_t> mAddEdges;
+    std::vector<std::size_t> mRemoveEdges;
+
+    void* getComponent(std::size_t row, const Column& column)
+    {
+        return mChunks[row / mChunkCapacity].get() + column.offset + column.size * (row % mChunkCapacity);
+    }
+};
+
+}
+
+}
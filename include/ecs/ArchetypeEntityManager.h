@@ -0,0 +1,227 @@
+#pragma once
+
+#include <map>
+#include "ArchetypeEntitySet.h"
+#include "Config.h"
+#include "SparseSet.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Standalone prototype of an entity manager where the entities sharing the same components are packed together
+// Iterating an entity set is a linear walk over chunks but adding or removing a component moves the whole entity
+// It is not interchangeable with EntityManager: it only supports creating and removing entities, adding, getting and
+// removing components and iterating entity sets, there are no memory resources, bulk operations, listeners, visitors,
+// filters, change tracking, snapshots nor clones
+class ArchetypeEntityManager
+{
+    struct EntityLocation
+    {
+        std::size_t archetype;
+        std::size_t row;
+    };
+
+public:
+    ArchetypeEntityManager()
+    {
+        // Archetype of the entities without component
+        createArchetype({});
+    }
+
+    void reserve(std::size_t size)
+    {
+        mEntities.reserve(size);
+        mArchetypes[0]->reserve(size);
+    }
+
+    // Entities
+
+    bool hasEntity(Entity entity) const
+    {
+        return mEntities.has(entity);
+    }
+
+    Entity createEntity()
+    {
+        auto [entity, location] = mEntities.emplace(EntityLocation{0, 0});
+        location.row = mArchetypes[0]->allocate(entity);
+        return entity;
+    }
+
+    void removeEntity(Entity entity)
+    {
+        const auto& location = mEntities.get(entity);
+        eraseRow(location.archetype, location.row);
+        mEntities.erase(entity);
+    }
+
+    // Components
+
+    template<typename T>
+    bool hasComponent(Entity entity) const
+    {
+        checkComponentType<T>();
+        return mArchetypes[mEntities.get(entity).archetype]->hasComponent(T::Type);
+    }
+
+    template<typename ...Ts>
+    bool hasComponents(Entity entity) const
+    {
+        checkComponentTypes<Ts...>();
+        const auto& archetype = *mArchetypes[mEntities.get(entity).archetype];
+        return (archetype.hasComponent(Ts::Type) && ...);
+    }
+
+    template<typename T>
+    T& getComponent(Entity entity)
+    {
+        checkComponentType<T>();
+        const auto& location = mEntities.get(entity);
+        return mArchetypes[location.archetype]->getComponent<T>(location.row);
+    }
+
+    template<typename T>
+    const T& getComponent(Entity entity) const
+    {
+        checkComponentType<T>();
+        const auto& location = mEntities.get(entity);
+        return std::as_const(*mArchetypes[location.archetype]).getComponent<T>(location.row);
+    }
+
+    template<typename ...Ts>
+    std::tuple<Ts&...> getComponents(Entity entity)
+    {
+        checkComponentTypes<Ts...>();
+        const auto& location = mEntities.get(entity);
+        auto& archetype = *mArchetypes[location.archetype];
+        return std::tie(archetype.getComponent<Ts>(location.row)...);
+    }
+
+    template<typename ...Ts>
+    std::tuple<const Ts&...> getComponents(Entity entity) const
+    {
+        checkComponentTypes<Ts...>();
+        const auto& location = mEntities.get(entity);
+        const auto& archetype = *mArchetypes[location.archetype];
+        return std::tie(archetype.getComponent<Ts>(location.row)...);
+    }
+
+    template<typename T, typename ...Args>
+    T& addComponent(Entity entity, Args&&... args)
+    {
+        checkComponentType<T>();
+        static_assert(alignof(T) <= Archetype::ChunkAlignment, "The alignment of T exceeds the alignment of the chunks");
+        auto& location = mEntities.get(entity);
+        auto archetype = mArchetypes[location.archetype]->getAddEdge(T::Type);
+        if (archetype == Archetype::Undefined)
+        {
+            auto componentTypes = mArchetypes[location.archetype]->getComponentTypes();
+            componentTypes.push_back(T::Type);
+            archetype = getOrCreateArchetype(std::move(componentTypes));
+            mArchetypes[location.archetype]->setAddEdge(T::Type, archetype);
+        }
+        // The component is constructed in the new row before the entity moves, so that the entity stays in its
+        // archetype if the constructor throws
+        auto row = mArchetypes[archetype]->allocate(entity);
+        auto component = static_cast<T*>(nullptr);
+        try
+        {
+            component = new (mArchetypes[archetype]->getComponent(row, T::Type)) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            mArchetypes[archetype]->deallocate();
+            throw;
+        }
+        mArchetypes[location.archetype]->moveTo(location.row, *mArchetypes[archetype], row);
+        eraseRow(location.archetype, location.row);
+        location.archetype = archetype;
+        location.row = row;
+        return *component;
+    }
+
+    template<typename T>
+    void removeComponent(Entity entity)
+    {
+        checkComponentType<T>();
+        const auto& location = mEntities.get(entity);
+        auto archetype = mArchetypes[location.archetype]->getRemoveEdge(T::Type);
+        if (archetype == Archetype::Undefined)
+        {
+            auto componentTypes = mArchetypes[location.archetype]->getComponentTypes();
+            componentTypes.erase(std::find(std::begin(componentTypes), std::end(componentTypes), T::Type));
+            archetype = getOrCreateArchetype(std::move(componentTypes));
+            mArchetypes[location.archetype]->setRemoveEdge(T::Type, archetype);
+        }
+        moveEntity(entity, archetype);
+    }
+
+    // Entity sets
+
+    template<typename ...Ts>
+    ArchetypeEntitySet<Ts...>& getEntitySet()
+    {
+        checkComponentTypes<Ts...>();
+        auto type = ArchetypeEntitySet<Ts...>::Type;
+        if (type >= mEntitySets.size())
+            mEntitySets.resize(type + 1);
+        if (!mEntitySets[type])
+        {
+            mEntitySets[type] = std::make_unique<ArchetypeEntitySet<Ts...>>();
+            for (auto& archetype : mArchetypes)
+                mEntitySets[type]->onArchetypeCreated(*archetype);
+        }
+        return *static_cast<ArchetypeEntitySet<Ts...>*>(mEntitySets[type].get());
+    }
+
+private:
+    SparseSet<Entity, EntityLocation> mEntities;
+    std::vector<std::unique_ptr<Archetype>> mArchetypes;
+    std::map<std::vector<ComponentType>, std::size_t> mComponentTypesToArchetype;
+    std::vector<std::unique_ptr<BaseArchetypeEntitySet>> mEntitySets;
+
+    std::size_t createArchetype(std::vector<ComponentType> componentTypes)
+    {
+        auto archetype = mArchetypes.size();
+        mArchetypes.push_back(std::make_unique<Archetype>(std::move(componentTypes)));
+        mComponentTypesToArchetype[mArchetypes.back()->getComponentTypes()] = archetype;
+        for (auto& entitySet : mEntitySets)
+        {
+            if (entitySet)
+                entitySet->onArchetypeCreated(*mArchetypes.back());
+        }
+        return archetype;
+    }
+
+    std::size_t getOrCreateArchetype(std::vector<ComponentType> componentTypes)
+    {
+        std::sort(std::begin(componentTypes), std::end(componentTypes));
+        auto it = mComponentTypesToArchetype.find(componentTypes);
+        if (it != std::end(mComponentTypesToArchetype))
+            return it->second;
+        return createArchetype(std::move(componentTypes));
+    }
+
+    void moveEntity(Entity entity, std::size_t archetype)
+    {
+        auto& location = mEntities.get(entity);
+        auto row = mArchetypes[location.archetype]->moveTo(location.row, *mArchetypes[archetype]);
+        eraseRow(location.archetype, location.row);
+        location.archetype = archetype;
+        location.row = row;
+    }
+
+    void eraseRow(std::size_t archetype, std::size_t row)
+    {
+        auto movedEntity = mArchetypes[archetype]->erase(row);
+        if (row < mArchetypes[archetype]->getSize())
+            mEntities.get(movedEntity).row = row;
+    }
+};
+
+}
+
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "Archetype.h"
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+class BaseArchetypeEntitySet
+{
+public:
+    virtual ~BaseArchetypeEntitySet() = default;
+
+    virtual void onArchetypeCreated(Archetype& archetype) = 0;
+
+protected:
+    static std::size_t generateArchetypeEntitySetType()
+    {
+        return sNbTypes++;
+    }
+
+private:
+    static std::size_t sNbTypes;
+};
+
+inline std::size_t BaseArchetypeEntitySet::sNbTypes = 0;
+
+template<typename ...Ts>
+class ArchetypeEntitySet : public BaseArchetypeEntitySet
+{
+    using Archetypes = std::vector<Archetype*>;
+
+public:
+    template<typename ArchetypeIterator, typename ...Us>
+    class EntitySetIterator
+    {
+    public:
+        EntitySetIterator(ArchetypeIterator it, ArchetypeIterator end) : mIt(it), mEnd(end)
+        {
+            skipEmptyChunks();
+        }
+
+        bool operator!=(const EntitySetIterator<ArchetypeIterator, Us...>& it)
+        {
+            return mIt != it.mIt || mChunk != it.mChunk || mRow != it.mRow;
+        }
+
+        std::pair<Entity, std::tuple<Us&...>> operator*()
+        {
+            return std::pair(mEntities[mRow], std::tie(std::get<Us*>(mColumns)[mRow]...));
+        }
+
+        EntitySetIterator<ArchetypeIterator, Us...>& operator++()
+        {
+            if (++mRow == mChunkSize)
+            {
+                mRow = 0;
+                ++mChunk;
+                skipEmptyChunks();
+            }
+            return *this;
+        }
+
+    private:
+        ArchetypeIterator mIt;
+        ArchetypeIterator mEnd;
+        std::size_t mChunk = 0;
+        std::size_t mRow = 0;
+        std::size_t mChunkSize = 0;
+        const Entity* mEntities = nullptr;
+        std::tuple<Us*...> mColumns;
+
+        // Move to the next non-empty chunk and cache its columns
+        void skipEmptyChunks()
+        {
+            while (mIt != mEnd && mChunk == (*mIt)->getChunkCount())
+            {
+                ++mIt;
+                mChunk = 0;
+            }
+            if (mIt != mEnd)
+            {
+                auto& archetype = **mIt;
+                mChunkSize = archetype.getChunkSize(mChunk);
+                mEntities = archetype.getEntities(mChunk);
+                mColumns = std::tuple<Us*...>(archetype.template getColumn<std::remove_const_t<Us>>(mChunk)...);
+            }
+        }
+    };
+
+    using Iterator = EntitySetIterator<typename Archetypes::const_iterator, Ts...>;
+    using ConstIterator = EntitySetIterator<typename Archetypes::const_iterator, const Ts...>;
+
+    static const std::size_t Type;
+
+    void onArchetypeCreated(Archetype& archetype) override
+    {
+        if ((archetype.hasComponent(Ts::Type) && ...))
+            mArchetypes.push_back(&archetype);
+    }
+
+    std::size_t getSize() const
+    {
+        auto size = std::size_t(0);
+        for (const auto archetype : mArchetypes)
+            size += archetype->getSize();
+        return size;
+    }
+
+    Iterator begin()
+    {
+        return Iterator(mArchetypes.begin(), mArchetypes.end());
+    }
+
+    ConstIterator begin() const
+    {
+        return ConstIterator(mArchetypes.begin(), mArchetypes.end());
+    }
+
+    Iterator end()
+    {
+        return Iterator(mArchetypes.end(), mArchetypes.end());
+    }
+
+    ConstIterator end() const
+    {
+        return ConstIterator(mArchetypes.end(), mArchetypes.end());
+    }
+
+    // Call callable(entity, components...) for each entity, walking the chunks linearly
+    template<typename Callable>
+    void forEach(Callable&& callable)
+    {
+        for (auto archetype : mArchetypes)
+        {
+            for (auto chunk = std::size_t(0); chunk < archetype->getChunkCount(); ++chunk)
+            {
+                auto size = archetype->getChunkSize(chunk);
+                auto entities = archetype->getEntities(chunk);
+                auto columns = std::tuple<Ts*...>(archetype->template getColumn<Ts>(chunk)...);
+                for (auto row = std::size_t(0); row < size; ++row)
+                    callable(entities[row], std::get<Ts*>(columns)[row]...);
+            }
+        }
+    }
+
+private:
+    Archetypes mArchetypes;
+};
+
+template<typename ...Ts>
+const std::size_t ArchetypeEntitySet<Ts...>::Type = BaseArchetypeEntitySet::generateArchetypeEntitySetType();
+
+}
+
+}
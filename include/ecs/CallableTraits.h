@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include "Config.h"
+#include "Span.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Arguments of a callable whose signature is known: functions, function pointers and objects with a single
+// non-template call operator
+template<typename Callable, typename = void>
+struct CallableArguments
+{
+    static constexpr auto IsKnown = false;
+};
+
+template<typename R, typename ...Args>
+struct CallableArguments<R(Args...)>
+{
+    static constexpr auto IsKnown = true;
+    using Types = std::tuple<Args...>;
+};
+
+template<typename R, typename ...Args>
+struct CallableArguments<R(Args...) noexcept> : CallableArguments<R(Args...)>
+{
+
+};
+
+template<typename R, typename ...Args>
+struct CallableArguments<R(*)(Args...)> : CallableArguments<R(Args...)>
+{
+
+};
+
+template<typename R, typename ...Args>
+struct CallableArguments<R(*)(Args...) noexcept> : CallableArguments<R(Args...)>
+{
+
+};
+
+template<typename R, typename C, typename ...Args>
+struct CallableArguments<R(C::*)(Args...)> : CallableArguments<R(Args...)>
+{
+
+};
+
+template<typename R, typename C, typename ...Args>
+struct CallableArguments<R(C::*)(Args...) const> : CallableArguments<R(Args...)>
+{
+
+};
+
+template<typename R, typename C, typename ...Args>
+struct CallableArguments<R(C::*)(Args...) noexcept> : CallableArguments<R(Args...)>
+{
+
+};
+
+template<typename R, typename C, typename ...Args>
+struct CallableArguments<R(C::*)(Args...) const noexcept> : CallableArguments<R(Args...)>
+{
+
+};
+
+template<typename Callable>
+struct CallableArguments<Callable, std::void_t<decltype(&Callable::operator())>> :
+    CallableArguments<decltype(&Callable::operator())>
+{
+
+};
+
+// Whether an argument of type T gives write access to the objects it refers to: a reference to a non-const object, or
+// a pointer or a span to non-const objects
+template<typename T>
+struct IsMutableArgument
+{
+    static constexpr auto value = std::is_lvalue_reference_v<T> && !std::is_const_v<std::remove_reference_t<T>>;
+};
+
+template<typename T>
+struct IsMutableArgument<T*>
+{
+    static constexpr auto value = !std::is_const_v<T>;
+};
+
+template<typename T>
+struct IsMutableArgument<Span<T>>
+{
+    static constexpr auto value = !std::is_const_v<T>;
+};
+
+template<typename Callable, std::size_t I, typename = void>
+struct HasArgumentAccess : std::false_type
+{
+
+};
+
+// Wrappers that forward their arguments to another callable declare the access of each argument with a static member
+// function template mayModifyArgument<I>()
+template<typename Callable, std::size_t I>
+struct HasArgumentAccess<Callable, I, std::void_t<decltype(Callable::template mayModifyArgument<I>())>> : std::true_type
+{
+
+};
+
+// Whether callable may modify the object passed as its I-th argument
+// The argument is only read if the parameter is a const reference, a copy, a pointer or a span to const objects
+// If the signature of callable is unknown, for instance for a generic lambda, the argument may be modified
+template<typename Callable, std::size_t I>
+constexpr bool mayModifyArgument()
+{
+    using Type = std::remove_cv_t<std::remove_reference_t<Callable>>;
+    if constexpr (HasArgumentAccess<Type, I>::value)
+        return Type::template mayModifyArgument<I>();
+    else if constexpr (CallableArguments<Type>::IsKnown)
+    {
+        using Arguments = typename CallableArguments<Type>::Types;
+        if constexpr (I < std::tuple_size_v<Arguments>)
+        {
+            using Argument = std::tuple_element_t<I, Arguments>;
+            return IsMutableArgument<Argument>::value ||
+                IsMutableArgument<std::remove_cv_t<std::remove_reference_t<Argument>>>::value;
+        }
+        else
+            return true;
+    }
+    else
+        return true;
+}
+
+}
+
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+#include "ComponentId.h"
+#include "Config.h"
+#include "Entity.h"
+#include "Serialization.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Ticks are incremented by EntityManager::nextTick, the first tick is 1
+using Tick = uint64_t;
+
+// Filter the entities whose component T has been added after a tick
+template<typename T>
+struct Added
+{
+    using Type = T;
+    static constexpr auto OnlyAdded = true;
+};
+
+// Filter the entities whose component T has been added or modified after a tick
+template<typename T>
+struct Changed
+{
+    using Type = T;
+    static constexpr auto OnlyAdded = false;
+};
+
+// Record the ticks at which components have been added and last modified
+// Each change is also appended to a log sorted by tick, so that the changes since a tick are found without scanning all
+// the components, the log is compacted when most of its entries are superseded by more recent ones
+class ChangeTracker
+{
+    static constexpr auto Undefined = std::numeric_limits<std::size_t>::max();
+    static constexpr auto MinLogSize = std::size_t(1024);
+
+public:
+    explicit ChangeTracker(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        mAddedTicks(resource), mModifiedTicks(resource), mEntities(resource), mLogIndices(resource), mLog(resource)
+    {
+
+    }
+
+    Tick getTick() const
+    {
+        return mTick;
+    }
+
+    void setTick(Tick tick)
+    {
+        mTick = tick;
+    }
+
+    void add(ComponentId componentId, Entity entity)
+    {
+        auto i = static_cast<std::size_t>(componentId);
+        if (i >= mAddedTicks.size())
+        {
+            mAddedTicks.resize(i + 1);
+            mModifiedTicks.resize(i + 1);
+            mEntities.resize(i + 1);
+            mLogIndices.resize(i + 1, Undefined);
+        }
+        mAddedTicks[i] = mTick;
+        mModifiedTicks[i] = mTick;
+        mEntities[i] = entity;
+        ++mNbTrackedComponents;
+        log(componentId);
+    }
+
+    // Different components can be modified concurrently, for instance by systems run in parallel
+    void modify(ComponentId componentId)
+    {
+        auto i = static_cast<std::size_t>(componentId);
+        if (mModifiedTicks[i] != mTick)
+        {
+            auto lock = std::lock_guard(mLogMutex);
+            mModifiedTicks[i] = mTick;
+            log(componentId);
+        }
+    }
+
+    // Same as calling modify for the components getComponentId(0), ..., getComponentId(n - 1), with a single lock
+    // Ids past the tracked components are skipped, such as the undefined ids of the missing optional components of
+    // filtered entity sets
+    template<typename GetComponentId>
+    void modify(std::size_t n, GetComponentId&& getComponentId)
+    {
+        auto lock = std::lock_guard(mLogMutex);
+        for (auto j = std::size_t(0); j < n; ++j)
+        {
+            auto componentId = getComponentId(j);
+            auto i = static_cast<std::size_t>(componentId);
+            if (i < mModifiedTicks.size() && mModifiedTicks[i] != mTick)
+            {
+                mModifiedTicks[i] = mTick;
+                log(componentId);
+            }
+        }
+    }
+
+    void erase(ComponentId componentId)
+    {
+        mLogIndices[static_cast<std::size_t>(componentId)] = Undefined;
+        --mNbTrackedComponents;
+    }
+
+    Tick getAddedTick(ComponentId componentId) const
+    {
+        return mAddedTicks[static_cast<std::size_t>(componentId)];
+    }
+
+    Tick getModifiedTick(ComponentId componentId) const
+    {
+        return mModifiedTicks[static_cast<std::size_t>(componentId)];
+    }
+
+    // Whether the component has been added and not erased
+    bool isTracked(ComponentId componentId) const
+    {
+        auto i = static_cast<std::size_t>(componentId);
+        return i < mLogIndices.size() && mLogIndices[i] != Undefined;
+    }
+
+    std::size_t getTrackedCount() const
+    {
+        return mNbTrackedComponents;
+    }
+
+    Entity getEntity(ComponentId componentId) const
+    {
+        return mEntities[static_cast<std::size_t>(componentId)];
+    }
+
+    // Call callable(entity) for each component added, or modified if onlyAdded is false, after tick
+    template<typename Callable>
+    void forEachSince(Tick tick, bool onlyAdded, Callable&& callable) const
+    {
+        auto it = std::upper_bound(std::begin(mLog), std::end(mLog), tick, [](Tick lhs, const Change& rhs)
+        {
+            return lhs < rhs.tick;
+        });
+        for (auto i = static_cast<std::size_t>(it - std::begin(mLog)); i < mLog.size(); ++i)
+        {
+            // Only the last entry of a component is valid
+            auto componentIndex = static_cast<std::size_t>(mLog[i].componentId);
+            if (mLogIndices[componentIndex] == i && (!onlyAdded || mAddedTicks[componentIndex] > tick))
+                callable(mEntities[componentIndex]);
+        }
+    }
+
+    // Forget all the components, the tick is kept
+    void clear()
+    {
+        mAddedTicks.clear();
+        mModifiedTicks.clear();
+        mEntities.clear();
+        mLogIndices.clear();
+        mLog.clear();
+        mNbTrackedComponents = 0;
+    }
+
+    void copy(const ChangeTracker& other)
+    {
+        mTick = other.mTick;
+        mAddedTicks = other.mAddedTicks;
+        mModifiedTicks = other.mModifiedTicks;
+        mEntities = other.mEntities;
+        mLogIndices = other.mLogIndices;
+        mLog = other.mLog;
+        mNbTrackedComponents = other.mNbTrackedComponents;
+    }
+
+    void save(BinaryWriter& writer) const
+    {
+        writer.write(mTick);
+        writer.writeArray(mAddedTicks);
+        writer.writeArray(mModifiedTicks);
+        writer.writeArray(mEntities);
+        writer.writeArray(mLogIndices);
+        writer.writeArray(mLog);
+        writer.write<uint64_t>(mNbTrackedComponents);
+    }
+
+    // Return false if the data is truncated or if the log does not refer to the loaded components
+    bool load(BinaryReader& reader)
+    {
+        auto nbTrackedComponents = uint64_t(0);
+        if (!reader.read(mTick) || !reader.readArray(mAddedTicks) || !reader.readArray(mModifiedTicks) ||
+            !reader.readArray(mEntities) || !reader.readArray(mLogIndices) || !reader.readArray(mLog) ||
+            !reader.read(nbTrackedComponents))
+        {
+            return false;
+        }
+        mNbTrackedComponents = nbTrackedComponents;
+        auto size = mAddedTicks.size();
+        if (mModifiedTicks.size() != size || mEntities.size() != size || mLogIndices.size() != size)
+            return false;
+        for (auto i = std::size_t(0); i < size; ++i)
+        {
+            auto logIndex = mLogIndices[i];
+            if (logIndex != Undefined &&
+                (logIndex >= mLog.size() || static_cast<std::size_t>(mLog[logIndex].componentId) != i))
+            {
+                return false;
+            }
+        }
+        return std::all_of(std::begin(mLog), std::end(mLog), [size](const Change& change)
+        {
+            return static_cast<std::size_t>(change.componentId) < size;
+        });
+    }
+
+private:
+    struct Change
+    {
+        static constexpr auto Readable = true;
+
+        Tick tick;
+        ComponentId componentId;
+    };
+
+    Tick mTick = 1;
+    std::pmr::vector<Tick> mAddedTicks;
+    std::pmr::vector<Tick> mModifiedTicks;
+    std::pmr::vector<Entity> mEntities;
+    std::pmr::vector<std::size_t> mLogIndices;
+    std::pmr::vector<Change> mLog;
+    std::size_t mNbTrackedComponents = 0;
+    std::mutex mLogMutex;
+
+    void log(ComponentId componentId)
+    {
+        if (mLog.size() >= std::max(MinLogSize, 2 * mNbTrackedComponents))
+            compact();
+        mLogIndices[static_cast<std::size_t>(componentId)] = mLog.size();
+        mLog.push_back(Change{mTick, componentId});
+    }
+
+    // Remove the superseded entries, the order of the log is preserved
+    void compact()
+    {
+        auto j = std::size_t(0);
+        for (auto i = std::size_t(0); i < mLog.size(); ++i)
+        {
+            auto componentIndex = static_cast<std::size_t>(mLog[i].componentId);
+            if (mLogIndices[componentIndex] == i)
+            {
+                mLog[j] = mLog[i];
+                mLogIndices[componentIndex] = j;
+                ++j;
+            }
+        }
+        mLog.resize(j);
+    }
+};
+
+}
+
+}
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include "Config.h"
+#include "EntityManager.h"
+#include "Span.h"
+#include "ThreadPool.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Linear allocator made of fixed-size blocks, the blocks are kept when the arena is cleared
+// The blocks are aligned on MaxAlignment, the alignment of the allocations must not exceed it
+class Arena
+{
+public:
+    static constexpr auto BlockSize = std::size_t(65536);
+    static constexpr auto MaxAlignment = std::size_t(64);
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        mOffset = (mOffset + alignment - 1) / alignment * alignment;
+        if (mBlock == mBlocks.size() || mOffset + size > mBlocks[mBlock].size)
+        {
+            // Find the next block that is large enough
+            if (mBlock < mBlocks.size())
+                ++mBlock;
+            while (mBlock < mBlocks.size() && mBlocks[mBlock].size < size)
+                ++mBlock;
+            if (mBlock == mBlocks.size())
+            {
+                auto blockSize = std::max(BlockSize, size);
+                auto data = static_cast<std::byte*>(::operator new(blockSize, std::align_val_t(MaxAlignment)));
+                mBlocks.push_back(Block{std::unique_ptr<std::byte[], BlockDeleter>(data), blockSize});
+            }
+            mOffset = 0;
+        }
+        auto pointer = mBlocks[mBlock].data.get() + mOffset;
+        mOffset += size;
+        return pointer;
+    }
+
+    void clear()
+    {
+        mBlock = 0;
+        mOffset = 0;
+    }
+
+private:
+    struct BlockDeleter
+    {
+        void operator()(std::byte* data) const
+        {
+            ::operator delete(data, std::align_val_t(MaxAlignment));
+        }
+    };
+
+    struct Block
+    {
+        std::unique_ptr<std::byte[], BlockDeleter> data;
+        std::size_t size;
+    };
+
+    std::vector<Block> mBlocks;
+    std::size_t mBlock = 0;
+    std::size_t mOffset = 0;
+};
+
+// Record structural changes to play them back later into an entity manager
+// A command buffer is not thread-safe, each thread must record into its own buffer (see CommandBuffers)
+// Components are constructed in place in an arena owned by the buffer
+class CommandBuffer
+{
+public:
+    // Entity created by the buffer, it is only usable with this buffer
+    enum class DeferredEntity : uint32_t {};
+
+    CommandBuffer() = default;
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer(CommandBuffer&&) = default;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+    // The recorded components of this buffer are destroyed before taking the ones of other
+    CommandBuffer& operator=(CommandBuffer&& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            mCommands = std::move(other.mCommands);
+            mArena = std::move(other.mArena);
+            mNbDeferredEntities = std::exchange(other.mNbDeferredEntities, 0);
+            mCreatedEntities = std::move(other.mCreatedEntities);
+            other.mCommands.clear();
+            other.mArena.clear();
+        }
+        return *this;
+    }
+
+    ~CommandBuffer()
+    {
+        clear();
+    }
+
+    bool isEmpty() const
+    {
+        return mCommands.empty() && mNbDeferredEntities == 0;
+    }
+
+    // Entities
+
+    DeferredEntity createEntity()
+    {
+        return static_cast<DeferredEntity>(mNbDeferredEntities++);
+    }
+
+    void removeEntity(Entity entity)
+    {
+        mCommands.push_back(Command{CommandType::RemoveEntity, Target{entity, false}, 0, nullptr, nullptr, nullptr});
+    }
+
+    void removeEntity(DeferredEntity entity)
+    {
+        mCommands.push_back(Command{CommandType::RemoveEntity, Target{toEntity(entity), true}, 0, nullptr, nullptr, nullptr});
+    }
+
+    // Components
+
+    template<typename T, typename ...Args>
+    void addComponent(Entity entity, Args&&... args)
+    {
+        addComponent<T>(Target{entity, false}, std::forward<Args>(args)...);
+    }
+
+    template<typename T, typename ...Args>
+    void addComponent(DeferredEntity entity, Args&&... args)
+    {
+        addComponent<T>(Target{toEntity(entity), true}, std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    void removeComponent(Entity entity)
+    {
+        checkComponentType<T>();
+        mCommands.push_back(Command{CommandType::RemoveComponent, Target{entity, false}, T::Type, nullptr, nullptr, nullptr});
+    }
+
+    template<typename T>
+    void removeComponent(DeferredEntity entity)
+    {
+        checkComponentType<T>();
+        mCommands.push_back(Command{CommandType::RemoveComponent, Target{toEntity(entity), true}, T::Type, nullptr, nullptr, nullptr});
+    }
+
+    // Playback
+
+    // Apply the recorded commands of buffers to entityManager then clear the buffers
+    // Entities are created first, then the component commands are applied sorted by component type, and the entities
+    // are removed last, so an entity removed by a buffer cannot be recycled by another one during the same playback
+    // Each entity set is notified once for all the updated entities of all the buffers
+    // Commands on entities that are not alive are skipped, adding a component that the entity already has and removing a
+    // component that it does not have are ignored, so when several buffers add the same component, the first addition
+    // wins, and an entity removed by several buffers is removed once
+    static void playback(Span<CommandBuffer> buffers, EntityManager& entityManager)
+    {
+        auto pointers = std::vector<CommandBuffer*>();
+        for (auto& buffer : buffers)
+            pointers.push_back(&buffer);
+        playback(Span<CommandBuffer* const>(pointers), entityManager);
+    }
+
+    static void playback(Span<CommandBuffer* const> buffers, EntityManager& entityManager)
+    {
+        for (auto buffer : buffers)
+            buffer->createEntities(entityManager);
+        // Apply component commands without notifying the entity sets
+        auto updatedEntities = std::vector<Entity>();
+        auto updatedComponentTypes = ComponentMask();
+        auto removedComponents = std::vector<std::pair<ComponentType, ComponentId>>();
+        for (auto buffer : buffers)
+            buffer->applyComponentCommands(entityManager, updatedEntities, updatedComponentTypes, removedComponents);
+        std::sort(std::begin(updatedEntities), std::end(updatedEntities));
+        updatedEntities.erase(std::unique(std::begin(updatedEntities), std::end(updatedEntities)), std::end(updatedEntities));
+        entityManager.notifyEntitySets(updatedEntities, updatedComponentTypes);
+        // Destroy the removed components once the entity sets have been notified
+        for (auto [componentType, componentId] : removedComponents)
+            entityManager.mComponentContainers[componentType]->remove(componentId);
+        // Remove the entities of all the buffers at once
+        auto removedEntities = std::vector<Entity>();
+        for (auto buffer : buffers)
+            buffer->getRemovedEntities(removedEntities);
+        std::sort(std::begin(removedEntities), std::end(removedEntities));
+        removedEntities.erase(std::unique(std::begin(removedEntities), std::end(removedEntities)), std::end(removedEntities));
+        removedEntities.erase(std::remove_if(std::begin(removedEntities), std::end(removedEntities), [&entityManager](Entity entity)
+        {
+            return !entityManager.hasEntity(entity);
+        }), std::end(removedEntities));
+        entityManager.removeEntities(removedEntities);
+        for (auto buffer : buffers)
+            buffer->clear();
+    }
+
+    void playback(EntityManager& entityManager)
+    {
+        playback(Span<CommandBuffer>(this, 1), entityManager);
+    }
+
+    // Return the entities created by the last playback, indexed by their deferred entity
+    const std::vector<Entity>& getCreatedEntities() const
+    {
+        return mCreatedEntities;
+    }
+
+    // Destroy the recorded commands without applying them
+    void clear()
+    {
+        for (auto& command : mCommands)
+        {
+            if (command.component != nullptr)
+                command.destroy(command.component);
+        }
+        mCommands.clear();
+        mArena.clear();
+        mNbDeferredEntities = 0;
+    }
+
+private:
+    enum class CommandType
+    {
+        AddComponent,
+        RemoveComponent,
+        RemoveEntity
+    };
+
+    struct Target
+    {
+        Entity entity;
+        bool deferred;
+    };
+
+    struct Command
+    {
+        CommandType type;
+        Target target;
+        ComponentType componentType;
+        void* component;
+        void (*add)(EntityManager&, Entity, void*);
+        void (*destroy)(void*);
+    };
+
+    std::vector<Command> mCommands;
+    Arena mArena;
+    std::size_t mNbDeferredEntities = 0;
+    std::vector<Entity> mCreatedEntities;
+
+    static Entity toEntity(DeferredEntity entity)
+    {
+        return static_cast<Entity>(static_cast<std::underlying_type_t<DeferredEntity>>(entity));
+    }
+
+    template<typename T, typename ...Args>
+    void addComponent(Target target, Args&&... args)
+    {
+        checkComponentType<T>();
+        static_assert(alignof(T) <= Arena::MaxAlignment, "The alignment of T is not supported by the arena");
+        auto component = new (mArena.allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        mCommands.push_back(Command{CommandType::AddComponent, target, T::Type, component,
+            [](EntityManager& entityManager, Entity entity, void* pointer)
+            {
+                auto& recordedComponent = *static_cast<T*>(pointer);
+                entityManager.emplaceComponent<T>(entity, std::move(recordedComponent));
+                recordedComponent.~T();
+            },
+            [](void* pointer)
+            {
+                static_cast<T*>(pointer)->~T();
+            }});
+    }
+
+    Entity resolve(const Target& target) const
+    {
+        return target.deferred ? mCreatedEntities[static_cast<std::size_t>(target.entity)] : target.entity;
+    }
+
+    void createEntities(EntityManager& entityManager)
+    {
+        mCreatedEntities.clear();
+        for (auto i = std::size_t(0); i < mNbDeferredEntities; ++i)
+            mCreatedEntities.push_back(entityManager.createEntity());
+        // Sort commands, component commands first then entity removals
+        // The sort is stable so the commands on the same component of the same entity keep their order
+        std::stable_sort(std::begin(mCommands), std::end(mCommands), [](const Command& lhs, const Command& rhs)
+        {
+            if (lhs.type == CommandType::RemoveEntity || rhs.type == CommandType::RemoveEntity)
+                return lhs.type != CommandType::RemoveEntity && rhs.type == CommandType::RemoveEntity;
+            return lhs.componentType < rhs.componentType;
+        });
+    }
+
+    void applyComponentCommands(EntityManager& entityManager, std::vector<Entity>& updatedEntities,
+        ComponentMask& updatedComponentTypes, std::vector<std::pair<ComponentType, ComponentId>>& removedComponents)
+    {
+        for (auto& command : mCommands)
+        {
+            if (command.type == CommandType::RemoveEntity)
+                break;
+            // The skipped additions are destroyed when the buffer is cleared
+            auto entity = resolve(command.target);
+            if (!entityManager.hasEntity(entity))
+                continue;
+            auto entityData = entityManager.mEntities.get(entity);
+            auto hasComponent = entityData.getComponentMask().test(command.componentType);
+            if (command.type == CommandType::AddComponent)
+            {
+                if (hasComponent)
+                    continue;
+                command.add(entityManager, entity, command.component);
+                command.component = nullptr;
+            }
+            else
+            {
+                if (!hasComponent)
+                    continue;
+                auto componentId = entityData.removeComponent(command.componentType);
+                entityManager.recordUpdatedEntity(entity);
+                removedComponents.emplace_back(command.componentType, componentId);
+            }
+            updatedEntities.push_back(entity);
+            updatedComponentTypes.set(command.componentType);
+        }
+    }
+
+    void getRemovedEntities(std::vector<Entity>& removedEntities) const
+    {
+        for (const auto& command : mCommands)
+        {
+            if (command.type == CommandType::RemoveEntity)
+                removedEntities.push_back(resolve(command.target));
+        }
+    }
+};
+
+// One command buffer per worker of a thread pool and one per other thread that records, such as the thread calling
+// ThreadPool::wait, so that every thread records into its own buffer
+class CommandBuffers
+{
+public:
+    explicit CommandBuffers(const ThreadPool& pool = ThreadPool::getDefault()) :
+        mPool(&pool), mWorkerBuffers(pool.getThreadCount() - 1)
+    {
+
+    }
+
+    // Return the buffer of the calling thread, the buffers of the threads that are not workers of the pool are created
+    // on their first call
+    CommandBuffer& getLocal()
+    {
+        auto index = mPool->getThreadIndex();
+        if (index != 0)
+            return mWorkerBuffers[index - 1];
+        auto lock = std::lock_guard(mMutex);
+        auto threadId = std::this_thread::get_id();
+        for (auto& [id, buffer] : mThreadBuffers)
+        {
+            if (id == threadId)
+                return buffer;
+        }
+        return mThreadBuffers.emplace_back(threadId, CommandBuffer()).second;
+    }
+
+    // The buffers of the threads that are not workers come first, in the order of their creation, then the buffers of
+    // the workers, in the order of the workers
+    // The methods below must not be called while threads are recording
+    CommandBuffer& operator[](std::size_t i)
+    {
+        return i < mThreadBuffers.size() ? mThreadBuffers[i].second : mWorkerBuffers[i - mThreadBuffers.size()];
+    }
+
+    std::size_t getSize() const
+    {
+        return mThreadBuffers.size() + mWorkerBuffers.size();
+    }
+
+    // Play back all the buffers at once, in the order above
+    void playback(EntityManager& entityManager)
+    {
+        auto buffers = std::vector<CommandBuffer*>();
+        for (auto i = std::size_t(0); i < getSize(); ++i)
+            buffers.push_back(&(*this)[i]);
+        CommandBuffer::playback(Span<CommandBuffer* const>(buffers), entityManager);
+    }
+
+private:
+    const ThreadPool* mPool;
+    std::vector<CommandBuffer> mWorkerBuffers;
+    std::mutex mMutex;
+    std::deque<std::pair<std::thread::id, CommandBuffer>> mThreadBuffers;
+};
+
+}
+
+}
@@ -1,12 +1,31 @@
 #pragma once
 
 #include <memory>
+#include <new>
+#include <stdexcept>
 #include "ComponentContainer.h"
+#include "ComponentMask.h"
 #include "ComponentType.h"
+#include "Config.h"
+#include "TypeOrder.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Type-erased description of a component, used by storages that manipulate raw memory
+struct ComponentDescriptor
+{
+    std::string_view name; // Identifies the type in snapshots
+    std::size_t size;
+    std::size_t alignment;
+    bool copyable; // Whether the components can be copied by EntityManager::restoreFrom
+    void (*moveConstruct)(void* destination, void* source);
+    void (*destroy)(void* component);
+};
+
 class BaseComponent
 {
 public:
@@ -15,29 +34,57 @@ public:
         return sFactories.size();
     }
 
-    static std::unique_ptr<BaseComponentContainer> createComponentContainer(std::size_t type)
+    static std::unique_ptr<BaseComponentContainer> createComponentContainer(std::size_t type,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource())
     {
-        return sFactories[type]();
+        return sFactories[type](resource);
+    }
+
+    static const ComponentDescriptor& getComponentDescriptor(std::size_t type)
+    {
+        return sDescriptors[type];
     }
 
 protected:
     template<typename T>
     static ComponentType generateComponentType()
     {
-        sFactories.push_back([]() -> std::unique_ptr<BaseComponentContainer>
+        // Checked in every build as component types are generated during static initialization, the exception
+        // terminates the program before main
+        if (sFactories.size() >= ComponentMask::MaxComponentCount)
+            throw std::length_error("Too many component types, increase ECS_MAX_COMPONENTS");
+        // Names identify the component types in snapshots, see getTypeName
+        for (const auto& descriptor : sDescriptors)
+        {
+            if (descriptor.name == getTypeName<T>())
+                throw std::logic_error("Two component types have the same name");
+        }
+        sFactories.push_back([](std::pmr::memory_resource* resource) -> std::unique_ptr<BaseComponentContainer>
         {
-            return std::make_unique<ComponentContainer<T>>();
+            return std::make_unique<ComponentContainer<T>>(resource);
         });
+        sDescriptors.push_back(ComponentDescriptor{getTypeName<T>(), sizeof(T), alignof(T),
+            std::is_copy_constructible_v<T> && std::is_copy_assignable_v<T>,
+            [](void* destination, void* source)
+            {
+                new (destination) T(std::move(*static_cast<T*>(source)));
+            },
+            [](void* component)
+            {
+                static_cast<T*>(component)->~T();
+            }});
         return static_cast<ComponentType>(sFactories.size() - 1);
     }
 
 private:
-    using ComponentContainerFactory = std::unique_ptr<BaseComponentContainer>(*)();
+    using ComponentContainerFactory = std::unique_ptr<BaseComponentContainer>(*)(std::pmr::memory_resource*);
 
     static std::vector<ComponentContainerFactory> sFactories;
+    static std::vector<ComponentDescriptor> sDescriptors;
 };
 
 inline std::vector<BaseComponent::ComponentContainerFactory> BaseComponent::sFactories;
+inline std::vector<ComponentDescriptor> BaseComponent::sDescriptors;
 
 template<typename T>
 class Component : public BaseComponent
@@ -61,4 +108,6 @@ constexpr void checkComponentTypes()
     (checkComponentType<Ts>(), ...);
 }
 
+}
+
 }
\ No newline at end of file
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <new>
+#include <vector>
 #include "ComponentSparseSet.h"
+#include "Config.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
 class BaseComponent;
 
 struct BaseComponentContainer
@@ -13,13 +19,47 @@ struct BaseComponentContainer
 
     virtual BaseComponent& get(ComponentId componentId) = 0;
     virtual void remove(ComponentId componentId) = 0;
+    virtual void remove(Span<const ComponentId> componentIds) = 0;
+    virtual void setTick(Tick tick) = 0;
+    // Does nothing if the components do not track changes
+    virtual void markModified(ComponentId componentId) = 0;
+    virtual void clear() = 0;
+    // other must be a container of the same type, return false without copying if the components are not copyable
+    virtual bool copy(const BaseComponentContainer& other) = 0;
+    // Return false if the components are not serializable
+    virtual bool save(BinaryWriter& writer) const = 0;
+    virtual bool load(BinaryReader& reader) = 0;
+    // Serialization of a single component, loading overwrites it and marks it as modified
+    virtual bool saveComponent(BinaryWriter& writer, ComponentId componentId) const = 0;
+    virtual bool loadComponent(BinaryReader& reader, ComponentId componentId) = 0;
+    // Add a component owned by entity from reader
+    virtual bool loadNewComponent(BinaryReader& reader, Entity entity, ComponentId& componentId) = 0;
+    // Append the entities whose component has been added or modified after tick, if the components track changes
+    virtual void getChangedEntities(Tick tick, std::vector<Entity>& entities) const = 0;
+    // Validation of loaded snapshots
+    virtual std::size_t getSize() const = 0;
+    // Index of the component in the container, getSize() if there is no such component
+    virtual std::size_t findIndex(ComponentId componentId) const = 0;
+    // owners[i] is the entity whose component is the i-th one, it must match the owner recorded by the change tracker
+    virtual bool checkOwners(Span<const Entity> owners) const = 0;
 };
 
+// Arrays are read in place from snapshots, so only trivially copyable components that are not aligned beyond
+// SerializationAlignment are serialized
+template<typename T>
+constexpr auto IsSerializable = std::is_trivially_copyable_v<T> && alignof(T) <= SerializationAlignment;
+
 template<typename T>
 struct ComponentContainer : public BaseComponentContainer
 {
     ComponentSparseSet<T> components;
 
+    explicit ComponentContainer(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        components(resource)
+    {
+
+    }
+
     BaseComponent& get(ComponentId componentId) override
     {
         return components.get(componentId);
@@ -29,6 +69,132 @@ struct ComponentContainer : public BaseComponentContainer
     {
         components.erase(componentId);
     }
+
+    void remove(Span<const ComponentId> componentIds) override
+    {
+        components.erase(componentIds);
+    }
+
+    void setTick(Tick tick) override
+    {
+        components.setTick(tick);
+    }
+
+    void markModified(ComponentId componentId) override
+    {
+        components.markModified(componentId);
+    }
+
+    void clear() override
+    {
+        components.clear();
+    }
+
+    bool copy([[maybe_unused]] const BaseComponentContainer& other) override
+    {
+        if constexpr (std::is_copy_constructible_v<T> && std::is_copy_assignable_v<T>)
+        {
+            components.copy(static_cast<const ComponentContainer<T>&>(other).components);
+            return true;
+        }
+        else
+            return false;
+    }
+
+    bool save([[maybe_unused]] BinaryWriter& writer) const override
+    {
+        if constexpr (IsSerializable<T>)
+        {
+            components.save(writer);
+            return true;
+        }
+        else
+            return false;
+    }
+
+    bool load([[maybe_unused]] BinaryReader& reader) override
+    {
+        if constexpr (IsSerializable<T>)
+            return components.load(reader);
+        else
+            return false;
+    }
+
+    bool saveComponent([[maybe_unused]] BinaryWriter& writer, [[maybe_unused]] ComponentId componentId) const override
+    {
+        if constexpr (IsSerializable<T>)
+        {
+            writer.write(components.get(componentId));
+            return true;
+        }
+        else
+            return false;
+    }
+
+    bool loadComponent([[maybe_unused]] BinaryReader& reader, [[maybe_unused]] ComponentId componentId) override
+    {
+        if constexpr (IsSerializable<T>)
+        {
+            components.markModified(componentId);
+            return reader.readObject(components.get(componentId));
+        }
+        else
+            return false;
+    }
+
+    bool loadNewComponent([[maybe_unused]] BinaryReader& reader, [[maybe_unused]] Entity entity,
+        [[maybe_unused]] ComponentId& componentId) override
+    {
+        if constexpr (IsSerializable<T>)
+        {
+            // T may not be default-constructible, it is copied from raw storage
+            auto storage = std::aligned_storage_t<sizeof(T), alignof(T)>();
+            if (!reader.readObject(storage))
+                return false;
+            componentId = components.emplace(entity, *std::launder(reinterpret_cast<const T*>(&storage))).first;
+            return true;
+        }
+        else
+            return false;
+    }
+
+    void getChangedEntities([[maybe_unused]] Tick tick, [[maybe_unused]] std::vector<Entity>& entities) const override
+    {
+        if constexpr (ComponentSparseSet<T>::TrackChanges)
+        {
+            components.getChanges().forEachSince(tick, false, [&entities](Entity entity)
+            {
+                entities.push_back(entity);
+            });
+        }
+    }
+
+    std::size_t getSize() const override
+    {
+        return components.getSize();
+    }
+
+    std::size_t findIndex(ComponentId componentId) const override
+    {
+        return components.has(componentId) ? components.getIndex(componentId) : components.getSize();
+    }
+
+    bool checkOwners(Span<const Entity> owners) const override
+    {
+        if (owners.size() != components.getSize())
+            return false;
+        if constexpr (ComponentSparseSet<T>::TrackChanges)
+        {
+            for (auto i = std::size_t(0); i < owners.size(); ++i)
+            {
+                if (components.getChanges().getEntity(components.getId(i)) != owners[i])
+                    return false;
+            }
+        }
+        return true;
+    }
 };
 
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "ComponentType.h"
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Fixed-width set of component types
+class ComponentMask
+{
+    using Word = uint64_t;
+
+    static constexpr auto NbBitsPerWord = std::size_t(64);
+
+public:
+    static constexpr auto MaxComponentCount = std::size_t(ECS_MAX_COMPONENTS);
+
+    template<typename ...Ts>
+    static ComponentMask create()
+    {
+        auto mask = ComponentMask();
+        (mask.set(Ts::Type), ...);
+        return mask;
+    }
+
+    bool test(ComponentType type) const
+    {
+        return (mWords[type / NbBitsPerWord] & getBit(type)) != 0;
+    }
+
+    void set(ComponentType type)
+    {
+        mWords[type / NbBitsPerWord] |= getBit(type);
+    }
+
+    void reset(ComponentType type)
+    {
+        mWords[type / NbBitsPerWord] &= ~getBit(type);
+    }
+
+    // Return true if all the types of mask are in this mask
+    bool contains(const ComponentMask& mask) const
+    {
+        for (auto i = std::size_t(0); i < NbWords; ++i)
+        {
+            if ((mWords[i] & mask.mWords[i]) != mask.mWords[i])
+                return false;
+        }
+        return true;
+    }
+
+    bool intersects(const ComponentMask& mask) const
+    {
+        for (auto i = std::size_t(0); i < NbWords; ++i)
+        {
+            if ((mWords[i] & mask.mWords[i]) != 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Call callable(type) for each type in the mask in increasing order
+    template<typename Callable>
+    void forEach(Callable&& callable) const
+    {
+        for (auto i = std::size_t(0); i < NbWords; ++i)
+        {
+            for (auto word = mWords[i]; word != 0; word &= word - 1)
+                callable(static_cast<ComponentType>(i * NbBitsPerWord + static_cast<std::size_t>(__builtin_ctzll(word))));
+        }
+    }
+
+private:
+    static constexpr auto NbWords = (MaxComponentCount + NbBitsPerWord - 1) / NbBitsPerWord;
+
+    std::array<Word, NbWords> mWords = {};
+
+    static Word getBit(ComponentType type)
+    {
+        return Word(1) << (type % NbBitsPerWord);
+    }
+};
+
+}
+
+}
@@ -1,12 +1,149 @@
 #pragma once
 
+#include "ChangeTracker.h"
 #include "ComponentId.h"
+#include "ComponentTraits.h"
+#include "Config.h"
+#include "Entity.h"
+#include "PagedVector.h"
 #include "SparseSet.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
+template<typename T>
+using ComponentStorage = std::conditional_t<ComponentTraits<T>::PagedStorage, PagedVector<T>, std::pmr::vector<T>>;
+
+// Sparse set of the components of type T
+// If the components track changes, adding a component and each mutable access to it are recorded in a ChangeTracker
 template<typename T>
-using ComponentSparseSet = SparseSet<ComponentId, T>;
+class ComponentSparseSet : public SparseSet<ComponentId, T, ComponentStorage<T>>
+{
+    using Base = SparseSet<ComponentId, T, ComponentStorage<T>>;
+
+    struct NoChangeTracker
+    {
+        explicit NoChangeTracker(std::pmr::memory_resource*)
+        {
+
+        }
+    };
+
+public:
+    static constexpr auto TrackChanges = ComponentTraits<T>::TrackChanges;
+
+    explicit ComponentSparseSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        Base(resource), mChanges(resource)
+    {
+
+    }
+
+    // Add a component owned by entity
+    template<typename ...Args>
+    std::pair<ComponentId, T&> emplace(Entity entity, Args&& ...args)
+    {
+        auto result = Base::emplace(std::forward<Args>(args)...);
+        if constexpr (TrackChanges)
+            mChanges.add(result.first, entity);
+        return result;
+    }
+
+    void erase(ComponentId componentId)
+    {
+        if constexpr (TrackChanges)
+            mChanges.erase(componentId);
+        Base::erase(componentId);
+    }
+
+    void erase(Span<const ComponentId> componentIds)
+    {
+        if constexpr (TrackChanges)
+        {
+            for (auto componentId : componentIds)
+                mChanges.erase(componentId);
+        }
+        Base::erase(componentIds);
+    }
+
+    // Changes
+
+    void setTick([[maybe_unused]] Tick tick)
+    {
+        if constexpr (TrackChanges)
+            mChanges.setTick(tick);
+    }
+
+    // Record that the component may have been modified during the current tick
+    void markModified([[maybe_unused]] ComponentId componentId)
+    {
+        if constexpr (TrackChanges)
+            mChanges.modify(componentId);
+    }
+
+    template<typename GetComponentId>
+    void markModified([[maybe_unused]] std::size_t n, [[maybe_unused]] GetComponentId&& getComponentId)
+    {
+        if constexpr (TrackChanges)
+            mChanges.modify(n, std::forward<GetComponentId>(getComponentId));
+    }
+
+    void clear()
+    {
+        Base::clear();
+        if constexpr (TrackChanges)
+            mChanges.clear();
+    }
+
+    // T must be copyable
+    void copy(const ComponentSparseSet& other)
+    {
+        Base::copy(other);
+        if constexpr (TrackChanges)
+            mChanges.copy(other.mChanges);
+    }
+
+    // Serialization, T must be trivially copyable
+
+    void save(BinaryWriter& writer) const
+    {
+        Base::save(writer);
+        if constexpr (TrackChanges)
+            mChanges.save(writer);
+    }
+
+    // Return false if the data is not valid, the changes must then track exactly the loaded components
+    bool load(BinaryReader& reader)
+    {
+        if (!Base::load(reader))
+            return false;
+        if constexpr (TrackChanges)
+        {
+            if (!mChanges.load(reader) || mChanges.getTrackedCount() != Base::getSize())
+                return false;
+            for (auto i = std::size_t(0); i < Base::getSize(); ++i)
+            {
+                if (!mChanges.isTracked(Base::getId(i)))
+                    return false;
+            }
+            return true;
+        }
+        else
+            return true;
+    }
+
+    const ChangeTracker& getChanges() const
+    {
+        static_assert(TrackChanges, "T must track changes, set TrackChanges in ComponentTraits<T>");
+        return mChanges;
+    }
+
+private:
+    std::conditional_t<TrackChanges, ChangeTracker, NoChangeTracker> mChanges;
+};
+
+}
 
-}
\ No newline at end of file
+}
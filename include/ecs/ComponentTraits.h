@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// List of pointers to the data members of a component
+template<auto ...Members>
+struct Fields
+{
+    static constexpr auto Count = sizeof...(Members);
+};
+
+template<typename M>
+struct MemberTraits;
+
+template<typename C, typename U>
+struct MemberTraits<U C::*>
+{
+    using Class = C;
+    using Type = U;
+};
+
+// Options of a component type, specialize ComponentTraits to change them
+// A component type opts in column access by listing its fields, for instance:
+// template<> struct ecs::ComponentTraits<Position> : ecs::DefaultComponentTraits
+// {
+//     using Fields = ecs::Fields<&Position::x, &Position::y>;
+// };
+// If PagedStorage is true, the components are stored in a PagedVector: adding a component never moves the others but
+// owning entity sets cannot expose their components as columns
+// Components are still moved when another component of the same type is removed, as the last one takes its place, and
+// when an owning entity set packs or sorts its components, so references to components are only valid until the next
+// structural change of their container
+// If TrackChanges is true, the ticks at which components are added and modified are recorded, entity sets can then
+// iterate over the entities whose component changed with the Added and Changed filters
+// A component is marked as modified when forEach passes it to a parameter taking a non-const reference, a pointer or a
+// span to non-const components, or to a generic lambda, and by mutable iterators and mutable columns
+struct DefaultComponentTraits
+{
+    using Fields = ecs::Fields<>;
+    static constexpr auto PagedStorage = false;
+    static constexpr auto TrackChanges = false;
+};
+
+template<typename T>
+struct ComponentTraits : DefaultComponentTraits
+{
+
+};
+
+template<auto Lhs, auto Rhs>
+constexpr bool isSameMember()
+{
+    if constexpr (std::is_same_v<decltype(Lhs), decltype(Rhs)>)
+        return Lhs == Rhs;
+    else
+        return false;
+}
+
+template<typename Fields, auto Member>
+struct HasField;
+
+template<auto Member, auto ...Members>
+struct HasField<Fields<Members...>, Member> : std::bool_constant<(isSameMember<Member, Members>() || ...)>
+{
+
+};
+
+template<typename T>
+struct FieldsScalar;
+
+template<auto Member, auto ...Members>
+struct FieldsScalar<Fields<Member, Members...>>
+{
+    using Type = typename MemberTraits<decltype(Member)>::Type;
+    static constexpr auto Uniform = (std::is_same_v<Type, typename MemberTraits<decltype(Members)>::Type> && ...);
+};
+
+// A component is a flat array of scalars if all its fields have the same type and there is nothing else in it
+template<typename T, typename = void>
+struct IsScalarArray : std::false_type
+{
+
+};
+
+template<typename T>
+struct IsScalarArray<T, std::enable_if_t<(ComponentTraits<T>::Fields::Count > 0)>> :
+    std::bool_constant<std::is_standard_layout_v<T> && FieldsScalar<typename ComponentTraits<T>::Fields>::Uniform &&
+        sizeof(T) == ComponentTraits<T>::Fields::Count * sizeof(typename FieldsScalar<typename ComponentTraits<T>::Fields>::Type)>
+{
+
+};
+
+}
+
+}
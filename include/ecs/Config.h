@@ -0,0 +1,13 @@
+#pragma once
+
+// Maximum number of component types, it can be defined before including the library to raise the limit
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 64
+#endif
+
+// The library is declared in an inline namespace named after the configuration, so that translation units built with
+// different values of ECS_MAX_COMPONENTS fail to link instead of silently violating the one definition rule when they
+// share types of the library
+#define ECS_CONCATENATE_IMPL(a, b) a##b
+#define ECS_CONCATENATE(a, b) ECS_CONCATENATE_IMPL(a, b)
+#define ECS_ABI_NAMESPACE ECS_CONCATENATE(max_components_, ECS_MAX_COMPONENTS)
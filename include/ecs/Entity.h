@@ -1,10 +1,46 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include "Config.h"
+#include "IdTraits.h"
 
 namespace ecs
 {
 
-enum class Entity : uint32_t {};
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// The low IndexBits bits are the index of the entity and the high bits its generation
+enum class Entity : uint64_t {};
+
+template<>
+struct IdTraits<Entity>
+{
+    static constexpr auto Generational = true;
+    static constexpr auto IndexBits = 32;
+    static constexpr auto IndexMask = (uint64_t(1) << IndexBits) - 1;
+    static constexpr auto GenerationMask = uint32_t(~uint64_t(0) >> IndexBits);
+    // The last index and the last generation are never used so that no entity is equal to ~uint64_t(0), which marks
+    // undefined and removed entities, an index is retired once it reaches its last generation
+    static constexpr auto MaxCount = std::size_t(IndexMask);
+
+    static constexpr std::size_t getIndex(Entity entity)
+    {
+        return static_cast<uint64_t>(entity) & IndexMask;
+    }
+
+    static constexpr uint32_t getGeneration(Entity entity)
+    {
+        return static_cast<uint32_t>(static_cast<uint64_t>(entity) >> IndexBits);
+    }
+
+    static constexpr Entity create(std::size_t index, uint32_t generation)
+    {
+        return static_cast<Entity>(index | (uint64_t(generation) << IndexBits));
+    }
+};
+
+}
 
-}
\ No newline at end of file
+}
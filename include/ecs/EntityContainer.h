@@ -1,9 +1,12 @@
 #pragma once
 
-#include <unordered_map>
-#include <unordered_set>
+#include <algorithm>
+#include <memory_resource>
+#include <type_traits>
 #include "ComponentId.h"
+#include "ComponentMask.h"
 #include "ComponentType.h"
+#include "Config.h"
 #include "Entity.h"
 #include "EntitySetType.h"
 #include "SparseSet.h"
@@ -11,18 +14,44 @@
 namespace ecs
 {
 
-class EntityData
+inline namespace ECS_ABI_NAMESPACE
 {
-    using ComponentIdContainer = std::unordered_map<ComponentType, ComponentId>;
-    using EntitySetTypeContainer = std::unordered_set<EntitySetType>;
+
+// View of the data of an entity stored in an EntityContainer, it is invalidated when an entity is created
+template<bool IsConst>
+class BasicEntityData
+{
+    template<typename T>
+    using Pointer = std::conditional_t<IsConst, const T*, T*>;
+
+    using Word = uint64_t;
+
+    static constexpr auto NbBitsPerWord = std::size_t(64);
 
 public:
+    BasicEntityData(Pointer<ComponentMask> componentMask, Pointer<ComponentId> componentIds,
+        Pointer<Word> entitySetWords, std::size_t nbEntitySetWords) :
+        mComponentMask(componentMask), mComponentIds(componentIds), mEntitySetWords(entitySetWords),
+        mNbEntitySetWords(nbEntitySetWords)
+    {
+
+    }
+
+    // A mutable view converts to a const view
+    template<bool OtherIsConst, typename = std::enable_if_t<IsConst && !OtherIsConst>>
+    BasicEntityData(const BasicEntityData<OtherIsConst>& other) :
+        mComponentMask(other.mComponentMask), mComponentIds(other.mComponentIds),
+        mEntitySetWords(other.mEntitySetWords), mNbEntitySetWords(other.mNbEntitySetWords)
+    {
+
+    }
+
     // Components
 
     template<typename T>
     bool hasComponent() const
     {
-        return findComponent<T>() != std::end(mComponentIds);
+        return mComponentMask->test(T::Type);
     }
 
     template<typename ...Ts>
@@ -34,60 +63,255 @@ public:
     template<typename T>
     ComponentId getComponent() const
     {
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wnull-dereference"
-        return findComponent<T>()->second;
-        #pragma GCC diagnostic pop
+        return mComponentIds[T::Type];
+    }
+
+    ComponentId getComponent(ComponentType type) const
+    {
+        return mComponentIds[type];
     }
 
-    const ComponentIdContainer& getComponents() const
+    const ComponentMask& getComponentMask() const
     {
-        return mComponentIds;
+        return *mComponentMask;
     }
 
     template<typename T>
     void addComponent(ComponentId componentId)
     {
-        mComponentIds[T::Type] = componentId;
+        addComponent(T::Type, componentId);
+    }
+
+    void addComponent(ComponentType type, ComponentId componentId)
+    {
+        static_assert(!IsConst, "The entity data is const");
+        mComponentMask->set(type);
+        mComponentIds[type] = componentId;
     }
 
     template<typename T>
     ComponentId removeComponent()
     {
-        auto it = findComponent<T>();
-        auto componentId = it->second;
-        mComponentIds.erase(it);
-        return componentId;
+        return removeComponent(T::Type);
+    }
+
+    ComponentId removeComponent(ComponentType type)
+    {
+        static_assert(!IsConst, "The entity data is const");
+        mComponentMask->reset(type);
+        return mComponentIds[type];
     }
 
-    // Types
+    // Entity sets
 
-    const EntitySetTypeContainer& getEntitySets() const
+    // Call callable(entitySetType) for each entity set the entity belongs to
+    template<typename Callable>
+    void forEachEntitySet(Callable&& callable) const
     {
-        return mEntitySetTypes;
+        for (auto i = std::size_t(0); i < mNbEntitySetWords; ++i)
+        {
+            for (auto word = mEntitySetWords[i]; word != 0; word &= word - 1)
+                callable(EntitySetType(i * NbBitsPerWord + static_cast<std::size_t>(__builtin_ctzll(word))));
+        }
     }
 
     void addEntitySet(EntitySetType entitySetType)
     {
-        mEntitySetTypes.insert(entitySetType);
+        static_assert(!IsConst, "The entity data is const");
+        mEntitySetWords[entitySetType / NbBitsPerWord] |= Word(1) << (entitySetType % NbBitsPerWord);
     }
 
     void removeEntitySet(EntitySetType entitySetType)
     {
-        mEntitySetTypes.erase(entitySetType);
+        static_assert(!IsConst, "The entity data is const");
+        mEntitySetWords[entitySetType / NbBitsPerWord] &= ~(Word(1) << (entitySetType % NbBitsPerWord));
     }
 
 private:
-    ComponentIdContainer mComponentIds;
-    EntitySetTypeContainer mEntitySetTypes;
+    template<bool OtherIsConst>
+    friend class BasicEntityData;
 
-    template<typename T>
-    ComponentIdContainer::const_iterator findComponent() const
+    Pointer<ComponentMask> mComponentMask;
+    Pointer<ComponentId> mComponentIds;
+    Pointer<Word> mEntitySetWords;
+    std::size_t mNbEntitySetWords;
+};
+
+using EntityData = BasicEntityData<false>;
+using ConstEntityData = BasicEntityData<true>;
+
+// Entities with their component masks, the ids of their components and the entity sets they belong to
+// The masks are stored in a sparse set, the component ids and the entity sets in two flat tables with a row per entity
+// index, so that copying and saving the container copies a few arrays in bulk instead of an object per entity
+class EntityContainer
+{
+    using Word = uint64_t;
+
+    static constexpr auto NbBitsPerWord = std::size_t(64);
+    // The tables grow by blocks of rows so that creating an entity rarely resizes them
+    static constexpr auto NbRowsPerBlock = std::size_t(64);
+
+public:
+    EntityContainer(std::size_t nbComponentTypes, std::size_t nbEntitySetTypes,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        mEntities(resource), mComponentIds(resource), mEntitySetWords(resource), mNbComponentTypes(nbComponentTypes),
+        mNbEntitySetWords((nbEntitySetTypes + NbBitsPerWord - 1) / NbBitsPerWord)
+    {
+
+    }
+
+    // std::length_error is thrown if all the entity indices are used
+    Entity create()
+    {
+        auto entity = mEntities.emplace().first;
+        auto index = IdTraits<Entity>::getIndex(entity);
+        if (index >= mNbRows)
+            resizeRows((index / NbRowsPerBlock + 1) * NbRowsPerBlock);
+        return entity;
+    }
+
+    bool has(Entity entity) const
+    {
+        return mEntities.has(entity);
+    }
+
+    EntityData get(Entity entity)
+    {
+        auto index = IdTraits<Entity>::getIndex(entity);
+        return EntityData(&mEntities.get(entity), mComponentIds.data() + index * mNbComponentTypes,
+            mEntitySetWords.data() + index * mNbEntitySetWords, mNbEntitySetWords);
+    }
+
+    ConstEntityData get(Entity entity) const
+    {
+        auto index = IdTraits<Entity>::getIndex(entity);
+        return ConstEntityData(&mEntities.get(entity), mComponentIds.data() + index * mNbComponentTypes,
+            mEntitySetWords.data() + index * mNbEntitySetWords, mNbEntitySetWords);
+    }
+
+    // The entity must have been removed from its entity sets
+    void erase(Entity entity)
+    {
+        clearEntitySets(entity);
+        mEntities.erase(entity);
+    }
+
+    void erase(Span<const Entity> entities)
+    {
+        for (auto entity : entities)
+            clearEntitySets(entity);
+        mEntities.erase(entities);
+    }
+
+    std::size_t getSize() const
+    {
+        return mEntities.getSize();
+    }
+
+    // Number of entities that can still be created
+    std::size_t getAvailableCount() const
+    {
+        return mEntities.getAvailableCount();
+    }
+
+    // Entity at position i, in [0, getSize())
+    Entity getId(std::size_t i) const
+    {
+        return mEntities.getId(i);
+    }
+
+    void reserve(std::size_t size)
+    {
+        auto nbRows = (size + NbRowsPerBlock - 1) / NbRowsPerBlock * NbRowsPerBlock;
+        mEntities.reserve(size);
+        mComponentIds.reserve(nbRows * mNbComponentTypes);
+        mEntitySetWords.reserve(nbRows * mNbEntitySetWords);
+    }
+
+    // Copy the entities of other, the memory already allocated is reused
+    void copy(const EntityContainer& other)
+    {
+        mEntities.copy(other.mEntities);
+        mComponentIds = other.mComponentIds;
+        mEntitySetWords = other.mEntitySetWords;
+        mNbRows = other.mNbRows;
+    }
+
+    // Serialization, the entity sets are not saved, they record their entities again when they are loaded
+
+    // Only the rows of the indices used so far are saved
+    void save(BinaryWriter& writer) const
+    {
+        mEntities.save(writer);
+        writer.write<uint64_t>(mNbComponentTypes);
+        writer.writeArray(Span<const ComponentId>(mComponentIds.data(), mEntities.getIndexCount() * mNbComponentTypes));
+    }
+
+    // The container must be empty
+    // componentTypes maps the component types of the snapshot to the current ones, it is empty if they are the same
+    bool load(BinaryReader& reader, Span<const ComponentType> componentTypes)
+    {
+        auto nbComponentTypes = uint64_t(0);
+        auto componentIds = Span<const ComponentId>();
+        if (!mEntities.load(reader) || !reader.read(nbComponentTypes) || !reader.readArray(componentIds) ||
+            nbComponentTypes != (componentTypes.empty() ? mNbComponentTypes : componentTypes.size()))
+        {
+            return false;
+        }
+        mNbRows = mEntities.getIndexCount();
+        if (componentIds.size() != mNbRows * nbComponentTypes)
+            return false;
+        mEntitySetWords.assign(mNbRows * mNbEntitySetWords, Word(0));
+        if (componentTypes.empty())
+            mComponentIds.assign(componentIds.begin(), componentIds.end());
+        else
+            mComponentIds.assign(mNbRows * mNbComponentTypes, ComponentId());
+        // Check the masks and map the component types of the snapshot to the current ones
+        auto valid = true;
+        for (auto i = std::size_t(0); i < mEntities.getSize(); ++i)
+        {
+            auto index = IdTraits<Entity>::getIndex(mEntities.getId(i));
+            auto& componentMask = mEntities.getObjects()[i];
+            auto loadedComponentMask = componentMask;
+            if (!componentTypes.empty())
+                componentMask = ComponentMask();
+            loadedComponentMask.forEach([&](ComponentType type)
+            {
+                if (type >= nbComponentTypes)
+                    valid = false;
+                else if (!componentTypes.empty())
+                {
+                    componentMask.set(componentTypes[type]);
+                    mComponentIds[index * mNbComponentTypes + componentTypes[type]] =
+                        componentIds[index * nbComponentTypes + type];
+                }
+            });
+        }
+        return valid;
+    }
+
+private:
+    SparseSet<Entity, ComponentMask> mEntities;
+    std::pmr::vector<ComponentId> mComponentIds; // Row of mNbComponentTypes ids per entity index
+    std::pmr::vector<Word> mEntitySetWords; // Row of mNbEntitySetWords bit words per entity index
+    std::size_t mNbComponentTypes;
+    std::size_t mNbEntitySetWords;
+    std::size_t mNbRows = 0;
+
+    void resizeRows(std::size_t nbRows)
+    {
+        mNbRows = nbRows;
+        mComponentIds.resize(mNbRows * mNbComponentTypes);
+        mEntitySetWords.resize(mNbRows * mNbEntitySetWords);
+    }
+
+    void clearEntitySets(Entity entity)
     {
-        return mComponentIds.find(T::Type);
+        auto index = IdTraits<Entity>::getIndex(entity);
+        std::fill_n(mEntitySetWords.data() + index * mNbEntitySetWords, mNbEntitySetWords, Word(0));
     }
 };
 
-using EntityContainer = SparseSet<Entity, EntityData>;
+}
 
-}
\ No newline at end of file
+}
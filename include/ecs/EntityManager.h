@@ -1,31 +1,72 @@
 #pragma once
 
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "Component.h"
+#include "Config.h"
 #include "EntitySet.h"
+#include "FilteredEntitySet.h"
+#include "MappedFile.h"
 #include "Visitor.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
 template<typename T>
 class Component;
 
+class CommandBuffer;
+
 class EntityManager
 {
 public:
     static constexpr auto UndefinedEntity = static_cast<Entity>(std::numeric_limits<std::underlying_type_t<Entity>>::max());
 
-    EntityManager()
+    // The entities, the components and the entities of the entity sets are stored in memory allocated from resource
+    // The component container and entity set objects themselves, the tables that index them and the delta journals are
+    // allocated with new
+    // resource must outlive the entity manager
+    // Component containers and entity sets are created on first use
+    explicit EntityManager(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        mResource(resource), mEntities(BaseComponent::getComponentCount(), BaseEntitySet::getEntitySetCount(), resource)
     {
         auto nbComponents = BaseComponent::getComponentCount();
-        // Component containers
         mComponentContainers.resize(nbComponents);
-        for (auto type = std::size_t(0); type < mComponentContainers.size(); ++type)
-            mComponentContainers[type] = BaseComponent::createComponentContainer(type);
-        // Entity sets
         mComponentToEntitySets.resize(nbComponents);
+        mComponentOwners.resize(nbComponents);
         mEntitySets.resize(BaseEntitySet::getEntitySetCount());
-        for (auto type = std::size_t(0); type < mEntitySets.size(); ++type)
-            mEntitySets[type] = BaseEntitySet::createEntitySet(type, mEntities, mComponentContainers, mComponentToEntitySets);
+    }
+
+    std::pmr::memory_resource* getResource() const
+    {
+        return mResource;
+    }
+
+    // Ticks
+
+    // Changes of components that track changes are recorded at the current tick
+    Tick getTick() const
+    {
+        return mTick;
+    }
+
+    // Start a new tick and return it, a system that only processes changes remembers the tick of its last run
+    Tick nextTick()
+    {
+        ++mTick;
+        for (auto& componentContainer : mComponentContainers)
+        {
+            if (componentContainer)
+                componentContainer->setTick(mTick);
+        }
+        return mTick;
     }
 
     void reserve(std::size_t size)
@@ -35,33 +76,144 @@ public:
 
     // Entities
 
+    // Entities are generational, a removed entity is not valid anymore once its index is reused by a new entity
     bool hasEntity(Entity entity) const
     {
         return mEntities.has(entity);
     }
 
+    // std::length_error is thrown if all the entity indices are used or retired
     Entity createEntity()
     {
-        return mEntities.emplace().first;
+        auto entity = mEntities.create();
+        recordEntityEvent(entity, true);
+        return entity;
+    }
+
+    // Create count entities with components Ts and return them
+    // Each initializer is either a component that is copied or a callable taking the index of the entity and returning
+    // the component, if there is no initializer the components are default-constructed
+    // Each entity set is notified once for all the entities
+    // std::length_error is thrown before any entity is created if there would be too many entities
+    template<typename ...Ts, typename ...Initializers>
+    std::vector<Entity> createEntities(std::size_t count, Initializers&&... initializers)
+    {
+        checkComponentTypes<Ts...>();
+        static_assert(sizeof...(Initializers) == 0 || sizeof...(Initializers) == sizeof...(Ts),
+            "There must be one initializer per component type or none");
+        if (count > mEntities.getAvailableCount())
+            throw std::length_error("Too many entities, their indices do not fit in Entity");
+        auto entities = std::vector<Entity>();
+        entities.reserve(count);
+        mEntities.reserve(mEntities.getSize() + count);
+        (getComponentSparseSet<Ts>().reserve(getComponentSparseSet<Ts>().getSize() + count), ...);
+        for (auto i = std::size_t(0); i < count; ++i)
+        {
+            auto entity = entities.emplace_back(mEntities.create());
+            recordEntityEvent(entity, true);
+            if constexpr (sizeof...(Initializers) == 0)
+                (emplaceComponent<Ts>(entity), ...);
+            else
+                (emplaceComponent<Ts>(entity, initialize(initializers, i)), ...);
+        }
+        notifyEntitySets(entities, ComponentMask::create<Ts...>());
+        return entities;
     }
 
     void removeEntity(Entity entity)
     {
         const auto& entityData = mEntities.get(entity);
-        // Remove components
-        for (auto& [componentType, componentId] : entityData.getComponents())
-            mComponentContainers[componentType]->remove(componentId);
         // Send message to entity sets
-        for (auto entitySetType : entityData.getEntitySets())
+        entityData.forEachEntitySet([this, entity](EntitySetType entitySetType)
+        {
             mEntitySets[entitySetType]->onEntityRemoved(entity);
+        });
+        // Remove components
+        entityData.getComponentMask().forEach([this, &entityData](ComponentType componentType)
+        {
+            mComponentContainers[componentType]->remove(entityData.getComponent(componentType));
+        });
         // Remove entity
         mEntities.erase(entity);
+        recordEntityEvent(entity, false);
     }
 
+    // Remove distinct entities
+    // Each entity set and each component container is compacted once for all the entities
+    void removeEntities(Span<const Entity> entities)
+    {
+        // Group the entities by entity set and the components by type
+        auto entitySetToEntities = std::vector<std::vector<Entity>>(mEntitySets.size());
+        auto componentTypeToIds = std::vector<std::vector<ComponentId>>(mComponentContainers.size());
+        for (auto entity : entities)
+        {
+            const auto& entityData = mEntities.get(entity);
+            entityData.forEachEntitySet([&entitySetToEntities, entity](EntitySetType entitySetType)
+            {
+                entitySetToEntities[entitySetType].push_back(entity);
+            });
+            entityData.getComponentMask().forEach([&componentTypeToIds, &entityData](ComponentType componentType)
+            {
+                componentTypeToIds[componentType].push_back(entityData.getComponent(componentType));
+            });
+        }
+        // Send messages to entity sets
+        for (auto type = std::size_t(0); type < mEntitySets.size(); ++type)
+        {
+            if (!entitySetToEntities[type].empty())
+                mEntitySets[type]->onEntitiesRemoved(entitySetToEntities[type]);
+        }
+        // Remove components
+        for (auto type = std::size_t(0); type < mComponentContainers.size(); ++type)
+        {
+            if (!componentTypeToIds[type].empty())
+                mComponentContainers[type]->remove(componentTypeToIds[type]);
+        }
+        // Remove entities
+        mEntities.erase(entities);
+        for (auto entity : entities)
+            recordEntityEvent(entity, false);
+    }
+
+    // The handlers get mutable components, so the handled components are marked as modified
     void visitEntity(Entity entity, const Visitor& visitor)
     {
-        for (const auto& [componentType, componentId] : mEntities.get(entity).getComponents())
-            visitor.handle(componentType, mComponentContainers[componentType]->get(componentId));
+        const auto& entityData = mEntities.get(entity);
+        entityData.getComponentMask().forEach([this, &entityData, &visitor](ComponentType componentType)
+        {
+            if (!visitor.hasHandler(componentType))
+                return;
+            auto& componentContainer = *mComponentContainers[componentType];
+            auto componentId = entityData.getComponent(componentType);
+            componentContainer.markModified(componentId);
+            visitor.handle(componentType, componentContainer.get(componentId));
+        });
+    }
+
+    // Call callable(component) for each component of entity whose type is in Ts
+    // The types are known at compile time so the calls are direct and can be inlined
+    // As in forEach, the components are only marked as modified if callable may modify them
+    template<typename T, typename ...Ts, typename Callable>
+    void visitEntity(Entity entity, Callable&& callable)
+    {
+        checkComponentTypes<T, Ts...>();
+        const auto& entityData = mEntities.get(entity);
+        visitComponent<T>(entityData, callable);
+        (visitComponent<Ts>(entityData, callable), ...);
+    }
+
+    // Call callable(entity, component) for each component of the entities whose type is in Ts
+    // Each entity is looked up once for all the types, looking it up is the main cost of a visit
+    template<typename T, typename ...Ts, typename Callable>
+    void visitEntities(Span<const Entity> entities, Callable&& callable)
+    {
+        checkComponentTypes<T, Ts...>();
+        for (auto entity : entities)
+        {
+            const auto& entityData = mEntities.get(entity);
+            visitComponent<T>(entityData, callable, entity);
+            (visitComponent<Ts>(entityData, callable, entity), ...);
+        }
     }
 
     // Components
@@ -80,11 +232,14 @@ public:
         return mEntities.get(entity).hasComponents<Ts...>();
     }
 
+    // Mutable accesses mark the components as modified
     template<typename T>
     T& getComponent(Entity entity)
     {
         checkComponentType<T>();
-        return getComponentSparseSet<T>().get(mEntities.get(entity).getComponent<T>());
+        auto componentId = mEntities.get(entity).getComponent<T>();
+        getComponentSparseSet<T>().markModified(componentId);
+        return getComponentSparseSet<T>().get(componentId);
     }
 
     template<typename T>
@@ -98,7 +253,8 @@ public:
     std::tuple<Ts&...> getComponents(Entity entity)
     {
         checkComponentTypes<Ts...>();
-        auto& entityData = mEntities.get(entity);
+        auto entityData = mEntities.get(entity);
+        (getComponentSparseSet<Ts>().markModified(entityData.getComponent<Ts>()), ...);
         return std::tie(getComponentSparseSet<Ts>().get(entityData.getComponent<Ts>())...);
     }
 
@@ -106,7 +262,7 @@ public:
     std::tuple<const Ts&...> getComponents(Entity entity) const
     {
         checkComponentTypes<Ts...>();
-        auto& entityData = mEntities.get(entity);
+        auto entityData = mEntities.get(entity);
         return std::tie(std::as_const(getComponentSparseSet<Ts>().get(entityData.getComponent<Ts>()))...);
     }
 
@@ -114,8 +270,7 @@ public:
     T& addComponent(Entity entity, Args&&... args)
     {
         checkComponentType<T>();
-        auto [componentId, component] = getComponentSparseSet<T>().emplace(std::forward<Args>(args)...);
-        mEntities.get(entity).addComponent<T>(componentId);
+        auto& component = emplaceComponent<T>(entity, std::forward<Args>(args)...);
         // Send message to entity sets
         for (auto entitySet : mComponentToEntitySets[T::Type])
             entitySet->onEntityUpdated(entity);
@@ -127,47 +282,826 @@ public:
     void removeComponent(Entity entity)
     {
         checkComponentType<T>();
-        // Remove component from entity and component container
-        getComponentSparseSet<T>().erase(mEntities.get(entity).removeComponent<T>());
+        // Remove component from entity
+        auto componentId = mEntities.get(entity).removeComponent<T>();
+        recordUpdatedEntity(entity);
         // Send message to entity sets
         for (auto entitySet : mComponentToEntitySets[T::Type])
             entitySet->onEntityUpdated(entity);
+        // Remove component from component container, owning entity sets have already moved it out of their range
+        getComponentSparseSet<T>().erase(componentId);
+    }
+
+    // Remove the component T of distinct entities
+    // Each entity set is notified once and the component container is compacted once for all the entities
+    template<typename T>
+    void removeComponents(Span<const Entity> entities)
+    {
+        checkComponentType<T>();
+        // Remove component from entities
+        auto componentIds = std::vector<ComponentId>();
+        componentIds.reserve(entities.size());
+        for (auto entity : entities)
+        {
+            componentIds.push_back(mEntities.get(entity).template removeComponent<T>());
+            recordUpdatedEntity(entity);
+        }
+        // Send message to entity sets
+        notifyEntitySets(entities, ComponentMask::create<T>());
+        // Remove components from component container
+        getComponentSparseSet<T>().erase(componentIds);
     }
 
     // Entity sets
 
+    // The entity set is created by the first call, it is then filled with the existing entities by a single scan and
+    // maintained from then on
+    // Ts are either component types or filters: EntitySet<With<...>, Without<...>, Optional<...>>
     template<typename ...Ts>
     EntitySet<Ts...>& getEntitySet()
     {
-        checkComponentTypes<Ts...>();
-        return *static_cast<EntitySet<Ts...>*>(mEntitySets[EntitySet<Ts...>::Type].get());
+        return getOrCreateEntitySet<EntitySet<Ts...>>();
     }
 
+    // The const overload never creates the entity set, so that concurrent const accesses do not modify the entity
+    // manager, std::logic_error is thrown if the set has not been created by the non-const overload
     template<typename ...Ts>
     const EntitySet<Ts...>& getEntitySet() const
     {
-        checkComponentTypes<Ts...>();
-        return *static_cast<EntitySet<Ts...>*>(mEntitySets[EntitySet<Ts...>::Type].get());
+        const auto& entitySet = mEntitySets[EntitySet<Ts...>::Type];
+        if (!entitySet)
+            throw std::logic_error("The entity set must be created by the non-const getEntitySet first");
+        return *static_cast<const EntitySet<Ts...>*>(entitySet.get());
+    }
+
+    // Call the batch listeners of all the entity sets, typically once per frame
+    void notifyListeners()
+    {
+        for (auto& entitySet : mEntitySets)
+        {
+            if (entitySet)
+                entitySet->notifyListeners();
+        }
+    }
+
+    // Sort the components T with compare(lhs, rhs) where lhs and rhs are components, entity sets can then follow this
+    // order with EntitySet::sort<T>
+    // The components must not be owned by an entity set, std::logic_error is thrown otherwise
+    template<typename T, typename Compare>
+    void sortComponents(Compare compare)
+    {
+        checkComponentType<T>();
+        checkNotOwned<T>();
+        getComponentSparseSet<T>().sort(std::move(compare));
+    }
+
+    // Reorder the components T so that their first objects are the components of the entities of entitySet, in the same
+    // order, T must be one of the component types of entitySet
+    // The components must not be owned by an entity set, std::logic_error is thrown otherwise
+    template<typename T, typename ...Ts>
+    void sortComponents(const EntitySet<Ts...>& entitySet)
+    {
+        static_assert((std::is_same_v<T, Ts> || ...), "The components must be components of the entity set");
+        checkComponentType<T>();
+        checkNotOwned<T>();
+        auto& componentSparseSet = getComponentSparseSet<T>();
+        auto i = std::size_t(0);
+        entitySet.forEach([this, &componentSparseSet, &i](Entity entity, const auto&...)
+        {
+            componentSparseSet.swap(componentSparseSet.getIndex(mEntities.get(entity).template getComponent<T>()), i++);
+        });
+    }
+
+    // Return the entity set after making it own the component containers of Ts
+    // A component type can be owned by only one entity set, std::logic_error is thrown otherwise
+    template<typename ...Ts>
+    EntitySet<Ts...>& getOwningEntitySet()
+    {
+        auto& entitySet = getEntitySet<Ts...>();
+        if (!entitySet.isOwning())
+        {
+            if (((mComponentOwners[Ts::Type] != nullptr) || ...))
+                throw std::logic_error("A component type is already owned by another entity set");
+            // The canonical set is the owner, permutations are views that copies do not have
+            auto& canonical = getOrCreateEntitySet<typename EntitySet<Ts...>::Canonical>();
+            ((mComponentOwners[Ts::Type] = &canonical), ...);
+            entitySet.own();
+        }
+        return entitySet;
+    }
+
+    // Copies
+
+    // Return a copy of the entity manager whose entity sets are bound to its own containers, or nullptr if the
+    // components of a type are not copyable
+    // The listeners are not copied
+    std::unique_ptr<EntityManager> clone() const
+    {
+        auto manager = std::make_unique<EntityManager>(mResource);
+        if (!manager->restoreFrom(*this))
+            return nullptr;
+        return manager;
+    }
+
+    // Make the entity manager a copy of source by copying all the arrays in bulk, the memory already allocated is reused
+    // so restoring states of similar sizes does not allocate
+    // The entity sets of source missing here are created, the ones missing in source are refilled from the copied
+    // entities, the listeners are kept and not called
+    // source is not modified, so it can be read concurrently
+    // Return false without modifying the entity manager if either manager has components of a type that is not copyable
+    bool restoreFrom(const EntityManager& source)
+    {
+        if (&source == this)
+            return true;
+        for (auto type = ComponentType(0); type < mComponentContainers.size(); ++type)
+        {
+            auto used = mComponentContainers[type] || source.mComponentContainers[type];
+            if (used && !BaseComponent::getComponentDescriptor(type).copyable)
+                return false;
+        }
+        // Components and entities
+        mTick = source.mTick;
+        for (auto type = ComponentType(0); type < mComponentContainers.size(); ++type)
+        {
+            if (source.mComponentContainers[type])
+                getComponentContainer(type).copy(*source.mComponentContainers[type]);
+            else if (mComponentContainers[type])
+            {
+                // Emptied in place as the entity sets are bound to it
+                mComponentContainers[type]->clear();
+                mComponentContainers[type]->setTick(mTick);
+            }
+        }
+        mEntities.copy(source.mEntities);
+        // Entity sets
+        for (auto type = std::size_t(0); type < mEntitySets.size(); ++type)
+        {
+            auto copy = BaseEntitySet::getEntitySetDescriptor(type).copy;
+            if ((mEntitySets[type] || source.mEntitySets[type]) && copy != nullptr)
+                copy(*this, source);
+        }
+        for (auto type = std::size_t(0); type < mComponentOwners.size(); ++type)
+        {
+            auto owner = source.mComponentOwners[type];
+            mComponentOwners[type] = owner != nullptr ? mEntitySets[owner->getType()].get() : nullptr;
+        }
+        // Deltas
+        mRecordingDeltas = source.mRecordingDeltas;
+        mDeltaTick = source.mDeltaTick;
+        mDeltaEntityEvents = source.mDeltaEntityEvents;
+        mDeltaUpdatedEntities = source.mDeltaUpdatedEntities;
+        return true;
+    }
+
+    // Snapshots
+
+    // Write the entities, the components and the entity sets to stream, return false if a component type is not
+    // serializable or if the stream fails
+    // Component types and entity sets are identified by name, so a snapshot can be loaded by another build of the
+    // program that has the same component types, and by a build made with another compiler if the component types
+    // declare their Name, see getTypeName
+    bool save(std::ostream& stream) const
+    {
+        auto writer = BinaryWriter(stream);
+        writer.write(SnapshotMagic);
+        writer.write(SnapshotVersion);
+        writer.write<uint64_t>(sizeof(ComponentMask));
+        writer.write(mTick);
+        // Components
+        writer.write<uint64_t>(mComponentContainers.size());
+        for (auto type = std::size_t(0); type < mComponentContainers.size(); ++type)
+        {
+            const auto& descriptor = BaseComponent::getComponentDescriptor(type);
+            writer.writeString(descriptor.name);
+            writer.write<uint64_t>(descriptor.size);
+            writer.write(static_cast<uint8_t>(mComponentContainers[type] ? 1 : 0));
+            if (mComponentContainers[type] && !mComponentContainers[type]->save(writer))
+                return false;
+        }
+        // Entities
+        mEntities.save(writer);
+        // Entity sets, views are recreated on first use
+        auto nbEntitySets = uint64_t(0);
+        for (const auto& entitySet : mEntitySets)
+            nbEntitySets += isSaved(entitySet.get()) ? uint64_t(1) : uint64_t(0);
+        writer.write(nbEntitySets);
+        for (const auto& entitySet : mEntitySets)
+        {
+            if (isSaved(entitySet.get()))
+            {
+                writer.writeString(BaseEntitySet::getEntitySetDescriptor(entitySet->getType()).name);
+                entitySet->save(writer);
+            }
+        }
+        return writer.isGood();
+    }
+
+    bool save(const std::string& path) const
+    {
+        auto file = std::ofstream(path, std::ios::binary);
+        return save(file) && static_cast<bool>(file.flush());
+    }
+
+    // Restore a snapshot written by save, the entity manager must be newly created
+    // Trivially copyable arrays are copied directly from data, no object is rebuilt entity by entity
+    // data must be aligned on SerializationAlignment, as the memory of a mapped file or of operator new is
+    // Return false if data is not a valid snapshot or is misaligned, the entity manager must then be discarded
+    // Ids and indices are checked: every component belongs to exactly one entity and entity sets hold exactly the
+    // entities that satisfy their requirements, with their components
+    // Components are copied byte for byte, so components loaded from untrusted data must be valid for every byte pattern,
+    // for instance they must not have bool members
+    bool load(Span<const std::byte> data)
+    {
+        if (mEntities.getSize() != 0 || !isEmpty(mComponentContainers) || !isEmpty(mEntitySets))
+            return false;
+        auto reader = BinaryReader(data);
+        auto magic = uint32_t(0);
+        auto version = uint32_t(0);
+        auto componentMaskSize = uint64_t(0);
+        if (!reader.read(magic) || magic != SnapshotMagic || !reader.read(version) || version != SnapshotVersion ||
+            !reader.read(componentMaskSize) || componentMaskSize != sizeof(ComponentMask) || !reader.read(mTick))
+        {
+            return false;
+        }
+        // Components, mapped by name to the component types of the program
+        auto nbComponents = uint64_t(0);
+        if (!reader.read(nbComponents) || nbComponents > ComponentMask::MaxComponentCount)
+            return false;
+        auto componentTypes = std::vector<ComponentType>(nbComponents);
+        auto identity = nbComponents == BaseComponent::getComponentCount();
+        auto loadedTypes = ComponentMask();
+        for (auto i = std::size_t(0); i < componentTypes.size(); ++i)
+        {
+            auto name = std::string_view();
+            auto size = uint64_t(0);
+            auto present = uint8_t(0);
+            if (!reader.readString(name) || !reader.read(size) || !reader.read(present) ||
+                !findComponentType(name, size, componentTypes[i]) || loadedTypes.test(componentTypes[i]))
+            {
+                return false;
+            }
+            loadedTypes.set(componentTypes[i]);
+            identity = identity && componentTypes[i] == i;
+            if (present && !getComponentContainer(componentTypes[i]).load(reader))
+                return false;
+        }
+        // Entities
+        if (!mEntities.load(reader, identity ? Span<const ComponentType>() : Span<const ComponentType>(componentTypes)) ||
+            !checkComponentOwners())
+        {
+            return false;
+        }
+        // Entity sets
+        auto nbEntitySets = uint64_t(0);
+        if (!reader.read(nbEntitySets))
+            return false;
+        for (auto i = uint64_t(0); i < nbEntitySets; ++i)
+        {
+            auto name = std::string_view();
+            if (!reader.readString(name))
+                return false;
+            auto load = findEntitySetLoader(name);
+            if (load == nullptr || !load(*this, reader))
+                return false;
+        }
+        return true;
+    }
+
+    bool load(const std::string& path)
+    {
+        auto file = MappedFile(path);
+        return file.isOpen() && load(file.getData());
+    }
+
+    // Deltas
+
+    // Start recording the structural changes written by saveDelta, the current state is the baseline of the first
+    // delta: a replica must start from a snapshot saved after this call
+    // Components modified in place are only found if they track changes, the others are only written when they are added
+    void recordDeltas()
+    {
+        mRecordingDeltas = true;
+        mDeltaTick = nextTick();
+        mDeltaEntityEvents.clear();
+        mDeltaUpdatedEntities.clear();
+    }
+
+    // Write the changes since the baseline, the current state becomes the baseline of the next delta
+    // The size of the delta and the time to write it are proportional to the number of changes
+    // Return false if deltas are not recorded, if a changed component is not serializable or if the stream fails
+    bool saveDelta(std::ostream& stream)
+    {
+        if (!mRecordingDeltas)
+            return false;
+        auto baselineTick = mDeltaTick;
+        auto tick = nextTick();
+        auto writer = BinaryWriter(stream);
+        writer.write(DeltaMagic);
+        writer.write(SnapshotVersion);
+        writer.write(baselineTick);
+        writer.write(tick);
+        writer.write<uint64_t>(mComponentContainers.size());
+        for (auto type = std::size_t(0); type < mComponentContainers.size(); ++type)
+        {
+            const auto& descriptor = BaseComponent::getComponentDescriptor(type);
+            writer.writeString(descriptor.name);
+            writer.write<uint64_t>(descriptor.size);
+        }
+        // Entities created and removed, in order, so that a replica recycles the same ids
+        writer.writeArray(Span<const EntityEvent>(mDeltaEntityEvents));
+        // Entities whose components have been added or removed, all their components are written
+        std::sort(std::begin(mDeltaUpdatedEntities), std::end(mDeltaUpdatedEntities));
+        mDeltaUpdatedEntities.erase(std::unique(std::begin(mDeltaUpdatedEntities), std::end(mDeltaUpdatedEntities)),
+            std::end(mDeltaUpdatedEntities));
+        auto updatedEntities = std::vector<Entity>();
+        std::copy_if(std::begin(mDeltaUpdatedEntities), std::end(mDeltaUpdatedEntities),
+            std::back_inserter(updatedEntities), [this](Entity entity){ return mEntities.has(entity); });
+        writer.write<uint64_t>(updatedEntities.size());
+        for (auto entity : updatedEntities)
+        {
+            const auto& entityData = mEntities.get(entity);
+            auto componentTypes = std::vector<ComponentType>();
+            entityData.getComponentMask().forEach([&componentTypes](ComponentType type)
+            {
+                componentTypes.push_back(type);
+            });
+            writer.write(entity);
+            writer.writeArray(Span<const ComponentType>(componentTypes));
+            for (auto type : componentTypes)
+            {
+                if (!mComponentContainers[type]->saveComponent(writer, entityData.getComponent(type)))
+                    return false;
+            }
+        }
+        // Components modified in place
+        auto nbModifiedTypes = uint64_t(0);
+        auto modifiedEntities = std::vector<std::vector<Entity>>(mComponentContainers.size());
+        for (auto type = std::size_t(0); type < mComponentContainers.size(); ++type)
+        {
+            if (!mComponentContainers[type])
+                continue;
+            mComponentContainers[type]->getChangedEntities(baselineTick - 1, modifiedEntities[type]);
+            auto& entities = modifiedEntities[type];
+            entities.erase(std::remove_if(std::begin(entities), std::end(entities), [this, &updatedEntities](Entity entity)
+            {
+                return !mEntities.has(entity) ||
+                    std::binary_search(std::begin(updatedEntities), std::end(updatedEntities), entity);
+            }), std::end(entities));
+            nbModifiedTypes += entities.empty() ? uint64_t(0) : uint64_t(1);
+        }
+        writer.write(nbModifiedTypes);
+        for (auto type = ComponentType(0); type < modifiedEntities.size(); ++type)
+        {
+            if (modifiedEntities[type].empty())
+                continue;
+            writer.write(type);
+            writer.writeArray(Span<const Entity>(modifiedEntities[type]));
+            for (auto entity : modifiedEntities[type])
+            {
+                if (!mComponentContainers[type]->saveComponent(writer, mEntities.get(entity).getComponent(type)))
+                    return false;
+            }
+        }
+        if (!writer.isGood())
+            return false;
+        mDeltaTick = tick;
+        mDeltaEntityEvents.clear();
+        mDeltaUpdatedEntities.clear();
+        return true;
+    }
+
+    // Patch the entity manager with a delta written by saveDelta, the entity manager must be in the baseline state of
+    // the delta: loaded from the snapshot it starts from or patched by the previous delta
+    // Entity sets are notified once for all the updated entities, entities keep their ids but entity sets do not keep
+    // the order they have in the source
+    // data must be aligned on SerializationAlignment as in load
+    // Return false if data is not a valid delta for this state or is misaligned, the entity manager must then be discarded
+    bool applyDelta(Span<const std::byte> data)
+    {
+        auto reader = BinaryReader(data);
+        auto magic = uint32_t(0);
+        auto version = uint32_t(0);
+        auto baselineTick = Tick(0);
+        auto tick = Tick(0);
+        if (!reader.read(magic) || magic != DeltaMagic || !reader.read(version) || version != SnapshotVersion ||
+            !reader.read(baselineTick) || baselineTick != mTick || !reader.read(tick))
+        {
+            return false;
+        }
+        auto nbComponents = uint64_t(0);
+        if (!reader.read(nbComponents) || nbComponents > ComponentMask::MaxComponentCount)
+            return false;
+        auto componentTypes = std::vector<ComponentType>(nbComponents);
+        for (auto& componentType : componentTypes)
+        {
+            auto name = std::string_view();
+            auto size = uint64_t(0);
+            if (!reader.readString(name) || !reader.read(size) || !findComponentType(name, size, componentType))
+                return false;
+        }
+        // Replay the creations and removals
+        auto entityEvents = Span<const EntityEvent>();
+        if (!reader.readArray(entityEvents))
+            return false;
+        for (const auto& entityEvent : entityEvents)
+        {
+            if (entityEvent.created != 0 && createEntity() != entityEvent.entity)
+                return false;
+            if (entityEvent.created == 0)
+            {
+                if (!hasEntity(entityEvent.entity))
+                    return false;
+                removeEntity(entityEvent.entity);
+            }
+        }
+        // Set the components of the updated entities
+        auto nbUpdatedEntities = uint64_t(0);
+        if (!reader.read(nbUpdatedEntities))
+            return false;
+        auto updatedEntities = std::vector<Entity>();
+        auto updatedComponentTypes = ComponentMask();
+        auto removedComponents = std::vector<std::pair<ComponentType, ComponentId>>();
+        auto applied = true;
+        for (auto i = uint64_t(0); i < nbUpdatedEntities && applied; ++i)
+        {
+            auto entity = Entity();
+            auto types = Span<const ComponentType>();
+            if (!reader.read(entity) || !hasEntity(entity) || !reader.readArray(types))
+                return false;
+            auto entityData = mEntities.get(entity);
+            auto componentMask = ComponentMask();
+            for (auto type : types)
+            {
+                if (type >= componentTypes.size())
+                    return false;
+                componentMask.set(componentTypes[type]);
+            }
+            // Remove the components the entity does not have anymore
+            auto currentMask = entityData.getComponentMask();
+            currentMask.forEach([&](ComponentType type)
+            {
+                if (!componentMask.test(type))
+                {
+                    removedComponents.emplace_back(type, entityData.removeComponent(type));
+                    updatedComponentTypes.set(type);
+                }
+            });
+            // Overwrite the components it keeps and add the new ones
+            for (auto type : types)
+            {
+                auto componentType = componentTypes[type];
+                auto& componentContainer = getComponentContainer(componentType);
+                if (currentMask.test(componentType))
+                    applied = applied && componentContainer.loadComponent(reader, entityData.getComponent(componentType));
+                else
+                {
+                    auto componentId = ComponentId();
+                    applied = applied && componentContainer.loadNewComponent(reader, entity, componentId);
+                    if (applied)
+                    {
+                        entityData.addComponent(componentType, componentId);
+                        updatedComponentTypes.set(componentType);
+                    }
+                }
+            }
+            updatedEntities.push_back(entity);
+        }
+        // Notify the entity sets once for all the updated entities then destroy the removed components
+        notifyEntitySets(updatedEntities, updatedComponentTypes);
+        for (auto [componentType, componentId] : removedComponents)
+            mComponentContainers[componentType]->remove(componentId);
+        if (!applied)
+            return false;
+        // Set the components modified in place
+        auto nbModifiedTypes = uint64_t(0);
+        if (!reader.read(nbModifiedTypes))
+            return false;
+        for (auto i = uint64_t(0); i < nbModifiedTypes; ++i)
+        {
+            auto type = ComponentType();
+            auto entities = Span<const Entity>();
+            if (!reader.read(type) || type >= componentTypes.size() || !reader.readArray(entities))
+                return false;
+            auto componentType = componentTypes[type];
+            auto& componentContainer = getComponentContainer(componentType);
+            for (auto entity : entities)
+            {
+                if (!hasEntity(entity) || !mEntities.get(entity).getComponentMask().test(componentType) ||
+                    !componentContainer.loadComponent(reader, mEntities.get(entity).getComponent(componentType)))
+                {
+                    return false;
+                }
+            }
+        }
+        mTick = tick;
+        for (auto& componentContainer : mComponentContainers)
+        {
+            if (componentContainer)
+                componentContainer->setTick(mTick);
+        }
+        return true;
     }
 
 private:
+    friend class CommandBuffer;
+    template<typename Set>
+    friend bool loadEntitySet(EntityManager& manager, BinaryReader& reader);
+    template<typename Set>
+    friend void copyEntitySet(EntityManager& manager, const EntityManager& source);
+
+    static constexpr auto SnapshotMagic = uint32_t(0x53534345); // "ECSS"
+    static constexpr auto SnapshotVersion = uint32_t(4);
+    static constexpr auto DeltaMagic = uint32_t(0x44534345); // "ECSD"
+
+    struct EntityEvent
+    {
+        static constexpr auto Readable = true;
+
+        Entity entity;
+        uint64_t created; // As wide as Entity so that the event has no padding
+    };
+
+    std::pmr::memory_resource* mResource;
+    Tick mTick = 1;
+    // Created on first use by non-const accessors
     std::vector<std::unique_ptr<BaseComponentContainer>> mComponentContainers;
     EntityContainer mEntities;
     std::vector<std::unique_ptr<BaseEntitySet>> mEntitySets;
     std::vector<std::vector<BaseEntitySet*>> mComponentToEntitySets;
+    std::vector<BaseEntitySet*> mComponentOwners;
+    // Changes since the baseline of the next delta
+    bool mRecordingDeltas = false;
+    Tick mDeltaTick = 0;
+    std::vector<EntityEvent> mDeltaEntityEvents;
+    std::vector<Entity> mDeltaUpdatedEntities;
+
+
+    void recordEntityEvent(Entity entity, bool created)
+    {
+        if (mRecordingDeltas)
+            mDeltaEntityEvents.push_back(EntityEvent{entity, created ? 1u : 0u});
+    }
+
+    void recordUpdatedEntity(Entity entity)
+    {
+        if (mRecordingDeltas)
+            mDeltaUpdatedEntities.push_back(entity);
+    }
+
+    // Add a component without notifying the entity sets
+    template<typename T, typename ...Args>
+    T& emplaceComponent(Entity entity, Args&&... args)
+    {
+        auto [componentId, component] = getComponentSparseSet<T>().emplace(entity, std::forward<Args>(args)...);
+        mEntities.get(entity).addComponent<T>(componentId);
+        recordUpdatedEntity(entity);
+        return component;
+    }
+
+    // The component is passed after args, it is const and not marked as modified if callable only reads it
+    template<typename T, typename Callable, typename ...Args>
+    void visitComponent(EntityData entityData, Callable& callable, Args... args)
+    {
+        if (entityData.hasComponent<T>())
+        {
+            auto& components = getComponentSparseSet<T>();
+            auto componentId = entityData.getComponent<T>();
+            if constexpr (mayModifyArgument<Callable, sizeof...(Args)>())
+            {
+                components.markModified(componentId);
+                callable(args..., components.get(componentId));
+            }
+            else
+                callable(args..., std::as_const(components).get(componentId));
+        }
+    }
+
+    template<typename Initializer>
+    static decltype(auto) initialize(Initializer& initializer, std::size_t i)
+    {
+        if constexpr (std::is_invocable_v<Initializer&, std::size_t>)
+            return initializer(i);
+        else
+            return std::as_const(initializer);
+    }
+
+    // Send a single message to each entity set interested in one of the component types
+    void notifyEntitySets(Span<const Entity> entities, const ComponentMask& componentTypes)
+    {
+        auto notified = std::vector<bool>(mEntitySets.size());
+        componentTypes.forEach([this, entities, &notified](ComponentType componentType)
+        {
+            for (auto entitySet : mComponentToEntitySets[componentType])
+            {
+                auto type = entitySet->getType();
+                if (!notified[type])
+                {
+                    notified[type] = true;
+                    entitySet->onEntitiesUpdated(entities);
+                }
+            }
+        });
+    }
+
+    template<typename T>
+    void checkNotOwned() const
+    {
+        if (mComponentOwners[T::Type] != nullptr)
+            throw std::logic_error("The components are owned by an entity set");
+    }
 
+    BaseComponentContainer& getComponentContainer(ComponentType type)
+    {
+        auto& componentContainer = mComponentContainers[type];
+        if (!componentContainer)
+        {
+            componentContainer = BaseComponent::createComponentContainer(type, mResource);
+            componentContainer->setTick(mTick);
+        }
+        return *componentContainer;
+    }
 
     template<typename T>
     ComponentSparseSet<T>& getComponentSparseSet()
     {
-        return static_cast<ComponentContainer<T>*>(mComponentContainers[T::Type].get())->components;
+        return static_cast<ComponentContainer<T>&>(getComponentContainer(T::Type)).components;
     }
 
+    // Const accessors do not create containers, a missing container has no components
     template<typename T>
     const ComponentSparseSet<T>& getComponentSparseSet() const
     {
-        return static_cast<const ComponentContainer<T>*>(mComponentContainers[T::Type].get())->components;
+        const auto& componentContainer = mComponentContainers[T::Type];
+        if (!componentContainer)
+        {
+            static const auto noComponents = ComponentSparseSet<T>(std::pmr::new_delete_resource());
+            return noComponents;
+        }
+        return static_cast<const ComponentContainer<T>&>(*componentContainer).components;
+    }
+
+    // Permutations of a canonical set are views of it, only the canonical set is maintained
+    template<typename Set>
+    Set& getOrCreateEntitySet()
+    {
+        auto& entitySet = mEntitySets[Set::Type];
+        if (!entitySet)
+        {
+            if constexpr (Set::IsCanonical)
+                fillEntitySet(createEntitySet<Set>());
+            else
+                entitySet = std::make_unique<Set>(getOrCreateEntitySet<typename Set::Canonical>(), mResource);
+        }
+        return *static_cast<Set*>(entitySet.get());
+    }
+
+    // Add the existing entities to an empty entity set
+    void fillEntitySet(BaseEntitySet& entitySet)
+    {
+        auto entities = std::vector<Entity>();
+        entities.reserve(mEntities.getSize());
+        for (auto i = std::size_t(0); i < mEntities.getSize(); ++i)
+            entities.push_back(mEntities.getId(i));
+        if (!entities.empty())
+            entitySet.onEntitiesUpdated(entities);
+    }
+
+    // Create an empty canonical set and register it to the component types it depends on
+    template<typename Set>
+    Set& createEntitySet()
+    {
+        Set::forEachComponentType([this](ComponentType type)
+        {
+            getComponentContainer(type);
+        });
+        auto entitySet = Set::create(mEntities, mComponentContainers, mResource);
+        Set::forEachComponentType([this, &entitySet](ComponentType type)
+        {
+            mComponentToEntitySets[type].push_back(entitySet.get());
+        });
+        mEntitySets[Set::Type] = std::move(entitySet);
+        return *static_cast<Set*>(mEntitySets[Set::Type].get());
+    }
+
+    // Snapshots
+
+    static bool isSaved(const BaseEntitySet* entitySet)
+    {
+        return entitySet != nullptr && BaseEntitySet::getEntitySetDescriptor(entitySet->getType()).load != nullptr;
+    }
+
+    template<typename T>
+    static bool isEmpty(const std::vector<std::unique_ptr<T>>& objects)
+    {
+        return std::all_of(std::begin(objects), std::end(objects), [](const auto& object){ return !object; });
+    }
+
+    // Check that each loaded component belongs to exactly one entity, so that snapshots cannot make entities share or
+    // lose components
+    bool checkComponentOwners() const
+    {
+        static constexpr auto NoOwner = UndefinedEntity;
+        auto owners = std::vector<std::vector<Entity>>(mComponentContainers.size());
+        for (auto type = std::size_t(0); type < mComponentContainers.size(); ++type)
+        {
+            if (mComponentContainers[type])
+                owners[type].resize(mComponentContainers[type]->getSize(), NoOwner);
+        }
+        for (auto i = std::size_t(0); i < mEntities.getSize(); ++i)
+        {
+            auto entity = mEntities.getId(i);
+            auto entityData = mEntities.get(entity);
+            auto valid = true;
+            entityData.getComponentMask().forEach([this, entity, &entityData, &owners, &valid](ComponentType type)
+            {
+                if (!valid || type >= mComponentContainers.size() || !mComponentContainers[type])
+                {
+                    valid = false;
+                    return;
+                }
+                auto index = mComponentContainers[type]->findIndex(entityData.getComponent(type));
+                valid = index < owners[type].size() && owners[type][index] == NoOwner;
+                if (valid)
+                    owners[type][index] = entity;
+            });
+            if (!valid)
+                return false;
+        }
+        for (auto type = std::size_t(0); type < mComponentContainers.size(); ++type)
+        {
+            const auto& typeOwners = owners[type];
+            auto allOwned = std::find(std::begin(typeOwners), std::end(typeOwners), NoOwner) == std::end(typeOwners);
+            if (mComponentContainers[type] && (!allOwned || !mComponentContainers[type]->checkOwners(typeOwners)))
+                return false;
+        }
+        return true;
+    }
+
+    static bool findComponentType(std::string_view name, std::size_t size, ComponentType& type)
+    {
+        for (auto i = std::size_t(0); i < BaseComponent::getComponentCount(); ++i)
+        {
+            const auto& descriptor = BaseComponent::getComponentDescriptor(i);
+            if (descriptor.name == name)
+            {
+                type = static_cast<ComponentType>(i);
+                return descriptor.size == size;
+            }
+        }
+        return false;
+    }
+
+    static EntitySetLoader findEntitySetLoader(std::string_view name)
+    {
+        for (auto type = std::size_t(0); type < BaseEntitySet::getEntitySetCount(); ++type)
+        {
+            const auto& descriptor = BaseEntitySet::getEntitySetDescriptor(type);
+            if (descriptor.name == name)
+                return descriptor.load;
+        }
+        return nullptr;
     }
 };
 
+template<typename Set>
+bool loadEntitySet(EntityManager& manager, BinaryReader& reader)
+{
+    if (manager.mEntitySets[Set::Type])
+        return false;
+    auto& entitySet = manager.createEntitySet<Set>();
+    if (!entitySet.load(reader))
+        return false;
+    if (entitySet.isOwning())
+    {
+        auto owned = true;
+        Set::forEachComponentType([&manager, &owned](ComponentType type)
+        {
+            owned = owned && manager.mComponentOwners[type] == nullptr;
+        });
+        if (!owned)
+            return false;
+        Set::forEachComponentType([&manager, &entitySet](ComponentType type)
+        {
+            manager.mComponentOwners[type] = &entitySet;
+        });
+    }
+    return true;
+}
+
+template<typename Set>
+void copyEntitySet(EntityManager& manager, const EntityManager& source)
+{
+    auto& entitySet = manager.mEntitySets[Set::Type] ? *static_cast<Set*>(manager.mEntitySets[Set::Type].get()) :
+        manager.createEntitySet<Set>();
+    if (source.mEntitySets[Set::Type])
+        entitySet.copy(*static_cast<const Set*>(source.mEntitySets[Set::Type].get()));
+    else
+    {
+        entitySet.clear();
+        manager.fillEntitySet(entitySet);
+    }
+}
+
+}
+
 }
\ No newline at end of file
@@ -1,44 +1,129 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <limits>
 #include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "CallableTraits.h"
+#include "Component.h"
 #include "ComponentContainer.h"
+#include "ComponentTraits.h"
+#include "Config.h"
 #include "EntitySetIterator.h"
 #include "EntitySetType.h"
 #include "EntityContainer.h"
+#include "Serialization.h"
+#include "Span.h"
+#include "SparseIndex.h"
+#include "ThreadPool.h"
+#include "TypeOrder.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
 template<typename ...Ts>
 class EntitySet;
 
+// Filters of entity sets, they are defined in FilteredEntitySet.h
+template<typename ...Ts>
+struct With;
+
+template<typename ...Ts>
+struct Without;
+
+template<typename ...Ts>
+struct Optional;
+
+template<typename T>
+struct IsFilter : std::false_type
+{
+
+};
+
+template<typename ...Ts>
+struct IsFilter<With<Ts...>> : std::true_type
+{
+
+};
+
+template<typename ...Ts>
+struct IsFilter<Without<Ts...>> : std::true_type
+{
+
+};
+
+template<typename ...Ts>
+struct IsFilter<Optional<Ts...>> : std::true_type
+{
+
+};
+
+class BaseEntitySet;
+class EntityManager;
+
+// Create the entity set Set in manager then load its entities from reader, it is defined in EntityManager.h
+template<typename Set>
+bool loadEntitySet(EntityManager& manager, BinaryReader& reader);
+
+// Copy the entity set Set of source into manager, creating it in manager if needed, if source does not have the set,
+// the set of manager is refilled from its entities instead, it is defined in EntityManager.h
+template<typename Set>
+void copyEntitySet(EntityManager& manager, const EntityManager& source);
+
+using EntitySetLoader = bool (*)(EntityManager& manager, BinaryReader& reader);
+using EntitySetCopier = void (*)(EntityManager& manager, const EntityManager& source);
+
+// Type-erased description of an entity set type, used by snapshots
+struct EntitySetDescriptor
+{
+    std::string name; // Identifies the type in snapshots
+    EntitySetLoader load; // Null if the set is not saved in snapshots
+    EntitySetCopier copy; // Null if the set is a view of another one
+};
+
 class BaseEntitySet
 {
 public:
     static std::size_t getEntitySetCount()
     {
-        return sFactories.size();
+        return sDescriptors.size();
     }
 
-    static std::unique_ptr<BaseEntitySet> createEntitySet(std::size_t type,
-        EntityContainer& entities,
-        const std::vector<std::unique_ptr<BaseComponentContainer>>& componentContainers,
-        std::vector<std::vector<BaseEntitySet*>>& componentToEntitySets)
+    static const EntitySetDescriptor& getEntitySetDescriptor(EntitySetType type)
     {
-        return sFactories[type](entities, componentContainers, componentToEntitySets);
+        return sDescriptors[type];
     }
 
-    BaseEntitySet()
+    using ListenerId = uint32_t;
+    using EntitiesAddedListener = std::function<void(Span<const Entity>)>;
+    using EntitiesRemovedListener = std::function<void(Span<const Entity>)>;
+
+    explicit BaseEntitySet(std::pmr::memory_resource* resource) :
+        mEntityToIndex(resource), mEntitiesAddedListeners(resource), mEntitiesRemovedListeners(resource),
+        mAddedEntities(resource), mRemovedEntities(resource), mAddedEntityToIndex(resource)
     {
 
     }
 
     virtual ~BaseEntitySet() = default;
 
+    virtual EntitySetType getType() const = 0;
+
+    // Serialization of the entities of the set, the entities themselves must already be loaded
+    virtual void save(BinaryWriter& writer) const = 0;
+    virtual bool load(BinaryReader& reader) = 0;
+
+    // False for a stale entity even if its index has been reused by an entity of the set
     bool hasEntity(Entity entity) const
     {
-        return mEntityToIndex.find(entity) != std::end(mEntityToIndex);
+        return mEntityToIndex.has(entity);
     }
 
     void onEntityUpdated(Entity entity)
@@ -49,6 +134,8 @@ public:
             addEntity(entity);
         else if (!satisfied && managed)
             removeEntity(entity, true);
+        else if (satisfied)
+            refreshEntity(entity);
     }
 
     void onEntityRemoved(Entity entity)
@@ -56,125 +143,736 @@ public:
         removeEntity(entity, false);
     }
 
+    // Same as calling onEntityUpdated for each entity but with a single virtual call
+    virtual void onEntitiesUpdated(Span<const Entity> entities) = 0;
+
+    // Same as calling onEntityRemoved for each entity but the set is compacted once
+    void onEntitiesRemoved(Span<const Entity> entities)
+    {
+        removeEntities(entities, false);
+    }
+
+    // Batch listeners
+    // While there is a batch listener, the entities added to and removed from the set are buffered until
+    // notifyListeners is called, then each batch listener is called once with all of them
+    // An entity added then removed between two notifications is in neither batch
+
+    ListenerId addEntitiesAddedListener(EntitiesAddedListener listener)
+    {
+        return mEntitiesAddedListeners.emplace(std::move(listener)).first;
+    }
+
+    void removeEntitiesAddedListener(ListenerId listenerId)
+    {
+        mEntitiesAddedListeners.erase(listenerId);
+        if (!hasBatchListeners())
+            clearBufferedEntities();
+    }
+
+    ListenerId addEntitiesRemovedListener(EntitiesRemovedListener listener)
+    {
+        return mEntitiesRemovedListeners.emplace(std::move(listener)).first;
+    }
+
+    void removeEntitiesRemovedListener(ListenerId listenerId)
+    {
+        mEntitiesRemovedListeners.erase(listenerId);
+        if (!hasBatchListeners())
+            clearBufferedEntities();
+    }
+
+    // Call the batch listeners with the entities removed then with the entities added since the last notification
+    // The removed entities and their components may not exist anymore
+    void notifyListeners()
+    {
+        if (mAddedEntities.empty() && mRemovedEntities.empty())
+            return;
+        // Drop the entities that have been removed after being added
+        mAddedEntities.erase(std::remove(std::begin(mAddedEntities), std::end(mAddedEntities), RemovedEntity), std::end(mAddedEntities));
+        // Listeners may modify the set, the buffers are swapped out first
+        auto addedEntities = std::pmr::vector<Entity>(mAddedEntities.get_allocator());
+        auto removedEntities = std::pmr::vector<Entity>(mRemovedEntities.get_allocator());
+        std::swap(addedEntities, mAddedEntities);
+        std::swap(removedEntities, mRemovedEntities);
+        for (auto entity : addedEntities)
+            mAddedEntityToIndex.erase(entity);
+        if (!removedEntities.empty())
+        {
+            for (const auto& listener : mEntitiesRemovedListeners.getObjects())
+                listener(removedEntities);
+        }
+        if (!addedEntities.empty())
+        {
+            for (const auto& listener : mEntitiesAddedListeners.getObjects())
+                listener(addedEntities);
+        }
+    }
+
 protected:
     virtual bool satisfyRequirements(Entity entity) = 0;
     virtual void addEntity(Entity entity) = 0;
     virtual void removeEntity(Entity entity, bool updateEntity) = 0;
+    virtual void removeEntities(Span<const Entity> entities, bool updateEntities) = 0;
+
+    // Called when the components of an entity of the set change but the entity stays in the set
+    virtual void refreshEntity([[maybe_unused]] Entity entity)
+    {
+
+    }
+
+    SparseIndex<Entity> mEntityToIndex;
+
+    void bufferAddedEntity(Entity entity)
+    {
+        if (hasBatchListeners())
+        {
+            mAddedEntityToIndex.set(entity, mAddedEntities.size());
+            mAddedEntities.push_back(entity);
+        }
+    }
 
-    std::unordered_map<Entity, std::size_t> mEntityToIndex;
+    void bufferRemovedEntity(Entity entity)
+    {
+        if (hasBatchListeners())
+        {
+            // The entity is not notified if it has been added since the last notification
+            if (mAddedEntityToIndex.has(entity))
+            {
+                mAddedEntities[mAddedEntityToIndex.get(entity)] = RemovedEntity;
+                mAddedEntityToIndex.erase(entity);
+            }
+            else
+                mRemovedEntities.push_back(entity);
+        }
+    }
 
-    template<typename ...Ts>
+    template<typename Set>
     static EntitySetType generateEntitySetType()
     {
-        sFactories.push_back([](EntityContainer& entities,
-            const std::vector<std::unique_ptr<BaseComponentContainer>>& componentContainers,
-            std::vector<std::vector<BaseEntitySet*>>& componentToEntitySets)
-            -> std::unique_ptr<BaseEntitySet>
+        auto descriptor = EntitySetDescriptor{Set::getName(), nullptr, nullptr};
+        if constexpr (Set::IsCanonical)
         {
-            auto entitySet = std::make_unique<EntitySet<Ts...>>(entities,
-                std::tie(static_cast<ComponentContainer<Ts>*>(componentContainers[Ts::Type].get())->components...));
-            (componentToEntitySets[Ts::Type].push_back(entitySet.get()), ...);
-            return std::move(entitySet);
-        });
-        return sFactories.size() - 1;
+            descriptor.load = &loadEntitySet<Set>;
+            descriptor.copy = &copyEntitySet<Set>;
+        }
+        sDescriptors.push_back(descriptor);
+        return sDescriptors.size() - 1;
+    }
+
+    // Copy the index of other, the listeners are kept and the entities buffered for them are discarded
+    void copyIndex(const BaseEntitySet& other)
+    {
+        mEntityToIndex.copy(other.mEntityToIndex);
+        for (auto entity : mAddedEntities)
+        {
+            if (entity != RemovedEntity)
+                mAddedEntityToIndex.erase(entity);
+        }
+        mAddedEntities.clear();
+        mRemovedEntities.clear();
+    }
+
+    // Forget the entities without calling the listeners
+    void clearIndex(Span<const Entity> entities)
+    {
+        for (auto entity : entities)
+            mEntityToIndex.erase(entity);
+        for (auto entity : mAddedEntities)
+        {
+            if (entity != RemovedEntity)
+                mAddedEntityToIndex.erase(entity);
+        }
+        mAddedEntities.clear();
+        mRemovedEntities.clear();
+    }
+
+    // Index the loaded entities and record the membership in their data
+    // Return false if an entity does not exist, is loaded twice or does not satisfy the requirements of the set, or if
+    // an entity satisfying them is missing
+    bool indexEntities(EntityContainer& entityContainer, Span<const Entity> entities)
+    {
+        for (auto i = std::size_t(0); i < entities.size(); ++i)
+        {
+            if (!entityContainer.has(entities[i]) || mEntityToIndex.has(entities[i]) || !satisfyRequirements(entities[i]))
+                return false;
+            mEntityToIndex.set(entities[i], i);
+            entityContainer.get(entities[i]).addEntitySet(getType());
+        }
+        auto nbSatisfyingEntities = std::size_t(0);
+        for (auto i = std::size_t(0); i < entityContainer.getSize(); ++i)
+            nbSatisfyingEntities += satisfyRequirements(entityContainer.getId(i)) ? std::size_t(1) : std::size_t(0);
+        return nbSatisfyingEntities == entities.size();
+    }
+
+    template<typename T>
+    static ComponentSparseSet<T>& getComponentSparseSet(const std::vector<std::unique_ptr<BaseComponentContainer>>& componentContainers)
+    {
+        return static_cast<ComponentContainer<T>*>(componentContainers[T::Type].get())->components;
     }
 
 private:
-    using EntitySetFactory = std::unique_ptr<BaseEntitySet>(*)(
-        EntityContainer&,
-        const std::vector<std::unique_ptr<BaseComponentContainer>>&,
-        std::vector<std::vector<BaseEntitySet*>>&);
+    static constexpr auto RemovedEntity = static_cast<Entity>(std::numeric_limits<std::underlying_type_t<Entity>>::max());
 
-    static std::vector<EntitySetFactory> sFactories;
+    static std::vector<EntitySetDescriptor> sDescriptors;
+
+    SparseSet<ListenerId, EntitiesAddedListener> mEntitiesAddedListeners;
+    SparseSet<ListenerId, EntitiesRemovedListener> mEntitiesRemovedListeners;
+    std::pmr::vector<Entity> mAddedEntities;
+    std::pmr::vector<Entity> mRemovedEntities;
+    SparseIndex<Entity> mAddedEntityToIndex;
+
+    bool hasBatchListeners() const
+    {
+        return mEntitiesAddedListeners.getSize() > 0 || mEntitiesRemovedListeners.getSize() > 0;
+    }
+
+    void clearBufferedEntities()
+    {
+        for (auto entity : mAddedEntities)
+        {
+            if (entity != RemovedEntity)
+                mAddedEntityToIndex.erase(entity);
+        }
+        mAddedEntities.clear();
+        mRemovedEntities.clear();
+    }
 };
 
-inline std::vector<BaseEntitySet::EntitySetFactory> BaseEntitySet::sFactories;
+inline std::vector<EntitySetDescriptor> BaseEntitySet::sDescriptors;
+
+// Names of Ts separated by commas, used to name entity set types after their component types
+template<typename ...Ts>
+std::string joinTypeNames()
+{
+    auto names = std::string();
+    ((names += names.empty() ? "" : ", ", names += getTypeName<Ts>()), ...);
+    return names;
+}
+
+// Mark the components from row begin to row end of componentIds that callable may modify, callable receives the entity
+// then the components in the order of componentContainers
+// Containers skip the undefined ids of missing optional components
+template<typename Callable, typename ComponentContainers, typename ComponentIds, std::size_t ...Is>
+void markModifiedComponents([[maybe_unused]] ComponentContainers& componentContainers,
+    [[maybe_unused]] const ComponentIds& componentIds, [[maybe_unused]] std::size_t begin, [[maybe_unused]] std::size_t end,
+    std::index_sequence<Is...>)
+{
+    ([&]()
+    {
+        if constexpr (mayModifyArgument<Callable, 1 + Is>())
+        {
+            std::get<Is>(componentContainers).markModified(end - begin, [&componentIds, begin](std::size_t i)
+            {
+                return componentIds[begin + i][Is];
+            });
+        }
+    }(), ...);
+}
 
+// Entity sets whose component types are permutations of each other share the same entities: the set whose types are
+// in canonical order, sorted by name, is the only one to store and maintain them, the others forward their calls to it
+// and reorder the components so that each permutation keeps its own order at the API
 template<typename ...Ts>
 class EntitySet : public BaseEntitySet
 {
-    using ValueType = std::pair<Entity, std::array<ComponentId, sizeof...(Ts)>>;
-    using UIterator = typename std::vector<ValueType>::iterator; // Underlying iterator
-    using UConstIterator = typename std::vector<ValueType>::const_iterator; // Underlying const iterator
+    static_assert(!(IsFilter<Ts>::value || ...), "The filters must be With<...>, Without<...> and Optional<...> in order");
+
+    using ComponentIds = std::array<ComponentId, sizeof...(Ts)>;
+    using UIterator = typename std::pmr::vector<ComponentIds>::iterator; // Underlying iterator
+    using UConstIterator = typename std::pmr::vector<ComponentIds>::const_iterator; // Underlying const iterator
     using ComponentContainers = std::tuple<ComponentSparseSet<Ts>&...>;
+    using Order = TypeOrder<Ts...>;
+
+    template<typename ...Us>
+    using CanonicalIterator = EntitySetIterator<UIterator, Us...>;
+
+    template<typename ...Us>
+    using CanonicalConstIterator = EntitySetIterator<UConstIterator, const Us...>;
+
+    template<typename ...Us>
+    friend class EntitySet;
 
 public:
-    using Iterator = EntitySetIterator<UIterator, Ts...>;
-    using ConstIterator = EntitySetIterator<UConstIterator, const Ts...>;
-    using ListenerId = uint32_t;
+    using Canonical = typename Order::template Sorted<EntitySet>;
+    static constexpr auto IsCanonical = Order::IsSorted;
+    using Iterator = std::conditional_t<IsCanonical, EntitySetIterator<UIterator, Ts...>,
+        PermutedEntitySetIterator<typename Order::template Sorted<CanonicalIterator>, Ts...>>;
+    using ConstIterator = std::conditional_t<IsCanonical, EntitySetIterator<UConstIterator, const Ts...>,
+        PermutedEntitySetIterator<typename Order::template Sorted<CanonicalConstIterator>, const Ts...>>;
     using EntityAddedListener = std::function<void(Entity)>;
     using EntityRemovedListener = std::function<void(Entity)>;
 
     static const EntitySetType Type;
+    static constexpr auto ChunkSize = std::size_t(1024);
+
+    EntitySet(EntityContainer& entities, const ComponentContainers& componentContainers,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        BaseEntitySet(resource), mManagedEntities(resource), mManagedComponentIds(resource), mEntities(entities),
+        mComponentContainers(componentContainers), mComponentMask(ComponentMask::create<Ts...>()),
+        mEntityAddedListeners(resource), mEntityRemovedListeners(resource)
+    {
 
-    EntitySet(EntityContainer& entities, const ComponentContainers& componentContainers) :
-        mEntities(entities), mComponentContainers(componentContainers)
+    }
+
+    // Permutation of canonical, it stores nothing
+    EntitySet(Canonical& canonical, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        EntitySet(canonical.mEntities, std::tie(std::get<ComponentSparseSet<Ts>&>(canonical.mComponentContainers)...), resource)
+    {
+        mCanonical = &canonical;
+    }
+
+    // The component containers of Ts must exist
+    static std::unique_ptr<EntitySet> create(EntityContainer& entities,
+        const std::vector<std::unique_ptr<BaseComponentContainer>>& componentContainers, std::pmr::memory_resource* resource)
+    {
+        checkComponentTypes<Ts...>();
+        return std::make_unique<EntitySet>(entities, std::tie(getComponentSparseSet<Ts>(componentContainers)...), resource);
+    }
+
+    // Call callable(type) for each component type whose addition or removal may change the entities of the set
+    template<typename Callable>
+    static void forEachComponentType(Callable&& callable)
+    {
+        (callable(Ts::Type), ...);
+    }
+
+    // Name of the set type in snapshots
+    static std::string getName()
     {
+        return "EntitySet<" + joinTypeNames<Ts...>() + ">";
+    }
 
+    EntitySetType getType() const override
+    {
+        return Type;
     }
 
     std::size_t getSize() const
     {
+        if constexpr (!IsCanonical)
+            return mCanonical->getSize();
         return mManagedEntities.size();
     }
 
+    bool hasEntity(Entity entity) const
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->hasEntity(entity);
+        return BaseEntitySet::hasEntity(entity);
+    }
+
+    // Ownership
+
+    bool isOwning() const
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->isOwning();
+        return mOwning;
+    }
+
+    // Reorder the component containers so that their first objects are the components of the entities of the set,
+    // in the same order
+    // A component container must be owned by at most one entity set, use EntityManager::getOwningEntitySet
+    void own()
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->own();
+        mOwning = true;
+        for (auto i = std::size_t(0); i < mManagedEntities.size(); ++i)
+            moveComponents(mManagedComponentIds[i], i, std::index_sequence_for<Ts...>{});
+    }
+
+    // Dereferencing a mutable iterator marks all the components of the entity as modified, iterate over a const set to
+    // only read them
     Iterator begin()
     {
-        return Iterator(mManagedEntities.begin(), mComponentContainers);
+        if constexpr (!IsCanonical)
+            return Iterator(mCanonical->begin());
+        else
+            return Iterator(mManagedEntities.cbegin(), mManagedComponentIds.begin(), mComponentContainers);
     }
 
     ConstIterator begin() const
     {
-        return ConstIterator(mManagedEntities.begin(), mComponentContainers);
+        if constexpr (!IsCanonical)
+            return ConstIterator(std::as_const(*mCanonical).begin());
+        else
+            return ConstIterator(mManagedEntities.cbegin(), mManagedComponentIds.begin(), mComponentContainers);
     }
 
     Iterator end()
     {
-        return Iterator(mManagedEntities.end(), mComponentContainers);
+        if constexpr (!IsCanonical)
+            return Iterator(mCanonical->end());
+        else
+            return Iterator(mManagedEntities.cend(), mManagedComponentIds.end(), mComponentContainers);
     }
 
     ConstIterator end() const
     {
-        return ConstIterator(mManagedEntities.end(), mComponentContainers);
+        if constexpr (!IsCanonical)
+            return ConstIterator(std::as_const(*mCanonical).end());
+        else
+            return ConstIterator(mManagedEntities.cend(), mManagedComponentIds.end(), mComponentContainers);
+    }
+
+    // Call callable(entity, components...) for each entity
+    // If the set is owning, the components are accessed by a linear scan of the component containers
+    template<typename Callable>
+    void forEach(Callable&& callable)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->forEach(permute(callable));
+        forEach(callable, 0, mManagedEntities.size(), std::index_sequence_for<Ts...>{});
+    }
+
+    template<typename Callable>
+    void forEach(Callable&& callable) const
+    {
+        if constexpr (!IsCanonical)
+            return std::as_const(*mCanonical).forEach(permute(callable));
+        forEach(callable, 0, mManagedEntities.size(), std::index_sequence_for<Ts...>{});
+    }
+
+    // Call callable(entity, components...) for each entity whose component T has been added (Filter is Added<T>) or
+    // added or modified (Filter is Changed<T>) after tick, T must track changes
+    // The cost is proportional to the number of changes of T, not to the size of the set, entities are visited in the
+    // order of their last change
+    template<typename Filter, typename Callable>
+    void forEach(Tick tick, Callable&& callable)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->template forEach<Filter>(tick, permute(callable));
+        // Marking components as modified appends to the change log, so the entities are collected first
+        auto indices = std::vector<std::size_t>();
+        forEachChangedIndex<Filter>(tick, [&indices](std::size_t i)
+        {
+            indices.push_back(i);
+        });
+        for (auto i : indices)
+            forEachIndex(callable, i, std::index_sequence_for<Ts...>{});
+    }
+
+    template<typename Filter, typename Callable>
+    void forEach(Tick tick, Callable&& callable) const
+    {
+        if constexpr (!IsCanonical)
+            return std::as_const(*mCanonical).template forEach<Filter>(tick, permute(callable));
+        forEachChangedIndex<Filter>(tick, [this, &callable](std::size_t i)
+        {
+            forEachIndex(callable, i, std::index_sequence_for<Ts...>{});
+        });
+    }
+
+    // Call callable(entities, components...) for consecutive chunks of at most ChunkSize entities, where entities is a
+    // Span<const Entity> and components are Span<Ts> in the same order as the entities
+    // If the set is owning, the component spans point in the component containers and chunks also end at the page
+    // boundaries of paged containers, otherwise the components are gathered in temporary buffers and moved back to their
+    // containers after the call
+    template<typename Callable>
+    void forEachChunk(Callable&& callable)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->forEachChunk(permute(callable));
+        forEachChunk(callable, std::index_sequence_for<Ts...>{});
+    }
+
+    template<typename Callable>
+    void forEachChunk(Callable&& callable) const
+    {
+        if constexpr (!IsCanonical)
+            return std::as_const(*mCanonical).forEachChunk(permute(callable));
+        forEachChunk(callable, std::index_sequence_for<Ts...>{});
+    }
+
+    // Same as forEach but the entities are split in ranges of grainSize entities that are processed in parallel by pool
+    // callable is called concurrently, it may modify the components it receives and read any other component,
+    // but it must not create or remove entities, add or remove components, or modify the components of other entities
+    template<typename Callable>
+    void parallelForEach(Callable&& callable, std::size_t grainSize, ThreadPool& pool = ThreadPool::getDefault())
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->parallelForEach(permute(callable), grainSize, pool);
+        runParallelForEach(*this, callable, grainSize, pool);
+    }
+
+    template<typename Callable>
+    void parallelForEach(Callable&& callable, std::size_t grainSize, ThreadPool& pool = ThreadPool::getDefault()) const
+    {
+        if constexpr (!IsCanonical)
+            return std::as_const(*mCanonical).parallelForEach(permute(callable), grainSize, pool);
+        runParallelForEach(*this, callable, grainSize, pool);
+    }
+
+    // Columns
+    // The set must be owning, std::logic_error is thrown otherwise
+    // The spans are invalidated when an entity is added to or removed from the set
+    // Mutable spans mark all the components of the set as modified
+
+    // Return the components T of the entities, in the same order as the entities
+    template<typename T>
+    Span<T> getComponents()
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->template getComponents<T>();
+        auto& componentContainer = getOwnedComponents<T>();
+        if constexpr (ComponentSparseSet<T>::TrackChanges)
+        {
+            for (const auto& componentIds : mManagedComponentIds)
+                componentContainer.markModified(componentIds[getComponentIndex<T>()]);
+        }
+        return Span<T>(componentContainer.getObjects().data(), mManagedEntities.size());
+    }
+
+    template<typename T>
+    Span<const T> getComponents() const
+    {
+        if constexpr (!IsCanonical)
+            return std::as_const(*mCanonical).template getComponents<T>();
+        return Span<const T>(std::as_const(getOwnedComponents<T>()).getObjects().data(), mManagedEntities.size());
+    }
+
+    // Return the field Member of the components of the entities, Member must be listed in the traits of its component
+    template<auto Member>
+    StridedSpan<typename MemberTraits<decltype(Member)>::Type> getColumn()
+    {
+        using T = typename MemberTraits<decltype(Member)>::Class;
+        static_assert(HasField<typename ComponentTraits<T>::Fields, Member>::value, "Member must be a field of ComponentTraits<T>");
+        auto components = getComponents<T>();
+        if (components.empty())
+            return {};
+        return StridedSpan<typename MemberTraits<decltype(Member)>::Type>(&(components.data()->*Member), components.size(), sizeof(T));
+    }
+
+    template<auto Member>
+    StridedSpan<const typename MemberTraits<decltype(Member)>::Type> getColumn() const
+    {
+        using T = typename MemberTraits<decltype(Member)>::Class;
+        static_assert(HasField<typename ComponentTraits<T>::Fields, Member>::value, "Member must be a field of ComponentTraits<T>");
+        auto components = getComponents<T>();
+        if (components.empty())
+            return {};
+        return StridedSpan<const typename MemberTraits<decltype(Member)>::Type>(&(components.data()->*Member), components.size(), sizeof(T));
+    }
+
+    // Return the fields of the components T as a single array of scalars, the fields of a component are contiguous
+    // The traits of T must list all its fields and they must have the same type
+    // Loops over these arrays have no stride and are easy to vectorize for the compiler
+    template<typename T>
+    auto getScalars()
+    {
+        using Scalar = typename FieldsScalar<typename ComponentTraits<T>::Fields>::Type;
+        static_assert(IsScalarArray<T>::value, "T must be made of fields of the same type listed in ComponentTraits<T>");
+        auto components = getComponents<T>();
+        return Span<Scalar>(reinterpret_cast<Scalar*>(components.data()), components.size() * ComponentTraits<T>::Fields::Count);
+    }
+
+    template<typename T>
+    auto getScalars() const
+    {
+        using Scalar = typename FieldsScalar<typename ComponentTraits<T>::Fields>::Type;
+        static_assert(IsScalarArray<T>::value, "T must be made of fields of the same type listed in ComponentTraits<T>");
+        auto components = getComponents<T>();
+        return Span<const Scalar>(reinterpret_cast<const Scalar*>(components.data()), components.size() * ComponentTraits<T>::Fields::Count);
+    }
+
+    // Sorting
+    // Additions and removals scatter the entities of the set relative to the storage of their components, sorting
+    // restores the locality of the accesses, the components of owning sets are moved with the entities
+
+    // Sort the entities with compare(lhs, rhs) where lhs and rhs are entities
+    template<typename Compare>
+    void sort(Compare compare)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->sort(std::move(compare));
+        sortIndices(getEntityComparator(compare));
+    }
+
+    // Sort the entities in the storage order of their components T
+    template<typename T>
+    void sort()
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->template sort<T>();
+        sortIndices(getStorageComparator<T>());
+    }
+
+    // Same as sort but at most maxSteps comparisons are done per call, the sort resumes where the previous call stopped
+    // Return true when the set is sorted, then the next call starts a new pass to sort the changes made after
+    // The set may be modified between the calls, in which case a pass can leave it partially sorted
+    template<typename Compare>
+    bool sortIncrementally(Compare compare, std::size_t maxSteps)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->sortIncrementally(std::move(compare), maxSteps);
+        return sortIndicesIncrementally(getEntityComparator(compare), maxSteps);
+    }
+
+    template<typename T>
+    bool sortIncrementally(std::size_t maxSteps)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->template sortIncrementally<T>(maxSteps);
+        return sortIndicesIncrementally(getStorageComparator<T>(), maxSteps);
     }
 
     // Listeners
 
     ListenerId addEntityAddedListener(EntityAddedListener listener)
     {
+        if constexpr (!IsCanonical)
+            return mCanonical->addEntityAddedListener(std::move(listener));
         return mEntityAddedListeners.emplace(std::move(listener)).first;
     }
 
     void removeEntityAddedListener(ListenerId listenerId)
     {
+        if constexpr (!IsCanonical)
+            return mCanonical->removeEntityAddedListener(listenerId);
         mEntityAddedListeners.erase(listenerId);
     }
 
     ListenerId addEntityRemovedListener(EntityRemovedListener listener)
     {
+        if constexpr (!IsCanonical)
+            return mCanonical->addEntityRemovedListener(std::move(listener));
         return mEntityRemovedListeners.emplace(std::move(listener)).first;
     }
 
     void removeEntityRemovedListener(ListenerId listenerId)
     {
+        if constexpr (!IsCanonical)
+            return mCanonical->removeEntityRemovedListener(listenerId);
         mEntityRemovedListeners.erase(listenerId);
     }
 
+    ListenerId addEntitiesAddedListener(EntitiesAddedListener listener)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->addEntitiesAddedListener(std::move(listener));
+        return BaseEntitySet::addEntitiesAddedListener(std::move(listener));
+    }
+
+    void removeEntitiesAddedListener(ListenerId listenerId)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->removeEntitiesAddedListener(listenerId);
+        BaseEntitySet::removeEntitiesAddedListener(listenerId);
+    }
+
+    ListenerId addEntitiesRemovedListener(EntitiesRemovedListener listener)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->addEntitiesRemovedListener(std::move(listener));
+        return BaseEntitySet::addEntitiesRemovedListener(std::move(listener));
+    }
+
+    void removeEntitiesRemovedListener(ListenerId listenerId)
+    {
+        if constexpr (!IsCanonical)
+            return mCanonical->removeEntitiesRemovedListener(listenerId);
+        BaseEntitySet::removeEntitiesRemovedListener(listenerId);
+    }
+
+    // Copy the entities of other, the entities themselves must already be copied
+    void copy(const EntitySet& other)
+    {
+        static_assert(IsCanonical, "Views are bound to their canonical set, copy the canonical set instead");
+        copyIndex(other);
+        mManagedEntities = other.mManagedEntities;
+        mManagedComponentIds = other.mManagedComponentIds;
+        mOwning = other.mOwning;
+        mSortCursor = other.mSortCursor;
+        mSortPosition = other.mSortPosition;
+    }
+
+    // Remove all the entities without calling the listeners nor updating the entities, and stop owning the components
+    void clear()
+    {
+        static_assert(IsCanonical, "Views are bound to their canonical set, clear the canonical set instead");
+        clearIndex(mManagedEntities);
+        mManagedEntities.clear();
+        mManagedComponentIds.clear();
+        mOwning = false;
+        mSortCursor = 0;
+        mSortPosition = 0;
+    }
+
+    // Views are not saved, they are recreated from their canonical set
+    void save(BinaryWriter& writer) const override
+    {
+        if constexpr (!IsCanonical)
+            return;
+        writer.write(static_cast<uint8_t>(mOwning ? 1 : 0));
+        writer.writeArray(mManagedEntities);
+        writer.writeArray(mManagedComponentIds);
+    }
+
+    bool load(BinaryReader& reader) override
+    {
+        if constexpr (!IsCanonical)
+            return false;
+        auto owning = uint8_t(0);
+        if (!reader.read(owning) || owning > 1 || !reader.readArray(mManagedEntities) ||
+            !reader.readArray(mManagedComponentIds) || mManagedEntities.size() != mManagedComponentIds.size() ||
+            !indexEntities(mEntities, mManagedEntities))
+        {
+            return false;
+        }
+        mOwning = owning != 0;
+        mSortCursor = 0;
+        mSortPosition = 0;
+        // The component ids must be the ones of the entities, and be packed if the set owns the components
+        for (auto i = std::size_t(0); i < mManagedEntities.size(); ++i)
+        {
+            const auto& entityData = mEntities.get(mManagedEntities[i]);
+            if (mManagedComponentIds[i] != ComponentIds{entityData.template getComponent<Ts>()...} ||
+                (mOwning && !isPacked(mManagedComponentIds[i], i, std::index_sequence_for<Ts...>{})))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void onEntitiesUpdated(Span<const Entity> entities) override
+    {
+        auto removedEntities = std::vector<Entity>();
+        for (auto entity : entities)
+        {
+            auto satisfied = EntitySet::satisfyRequirements(entity);
+            auto managed = hasEntity(entity);
+            if (satisfied && !managed)
+                EntitySet::addEntity(entity);
+            else if (!satisfied && managed)
+                removedEntities.push_back(entity);
+            else if (satisfied)
+                EntitySet::refreshEntity(entity);
+        }
+        if (!removedEntities.empty())
+            EntitySet::removeEntities(removedEntities, true);
+    }
+
 protected:
     bool satisfyRequirements(Entity entity) override
     {
-        return mEntities.get(entity).template hasComponents<Ts...>();
+        return mEntities.get(entity).getComponentMask().contains(mComponentMask);
     }
 
     void addEntity(Entity entity) override
     {
-        mEntityToIndex[entity] = mManagedEntities.size();
-        auto& entityData = mEntities.get(entity);
+        mEntityToIndex.set(entity, mManagedEntities.size());
+        auto entityData = mEntities.get(entity);
         entityData.addEntitySet(Type);
-        mManagedEntities.emplace_back(entity, std::array<ComponentId, sizeof...(Ts)>{entityData.template getComponent<Ts>()...});
+        mManagedEntities.push_back(entity);
+        mManagedComponentIds.push_back(ComponentIds{entityData.template getComponent<Ts>()...});
+        if (mOwning)
+            moveComponents(mManagedComponentIds.back(), mManagedEntities.size() - 1, std::index_sequence_for<Ts...>{});
         // Call listeners
         for (const auto& listener : mEntityAddedListeners.getObjects())
             listener(entity);
+        bufferAddedEntity(entity);
     }
 
     void removeEntity(Entity entity, bool updateEntity) override
@@ -182,28 +880,456 @@ protected:
         // Call listeners
         for (const auto& listener : mEntityRemovedListeners.getObjects())
             listener(entity);
-        auto it = mEntityToIndex.find(entity);
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wnull-dereference"
-        auto index = it->second;
-        #pragma GCC diagnostic pop
-        mEntityToIndex[mManagedEntities.back().first] = index;
-        mEntityToIndex.erase(it);
-        mManagedEntities[index] = mManagedEntities.back();
-        mManagedEntities.pop_back();
-        if (updateEntity)
-            mEntities.get(entity).removeEntitySet(Type);
+        bufferRemovedEntity(entity);
+        eraseEntity(entity, updateEntity);
+    }
+
+    void removeEntities(Span<const Entity> entities, bool updateEntities) override
+    {
+        // Call listeners
+        for (const auto& listener : mEntityRemovedListeners.getObjects())
+        {
+            for (auto entity : entities)
+                listener(entity);
+        }
+        for (auto entity : entities)
+            bufferRemovedEntity(entity);
+        // Owning sets must move the components with the entities so they always swap with the last entity
+        if (mOwning || entities.size() * CompactionRatio < mManagedEntities.size())
+        {
+            for (auto entity : entities)
+                eraseEntity(entity, updateEntities);
+            return;
+        }
+        // Compact the remaining entities in a single pass
+        for (auto entity : entities)
+        {
+            mEntityToIndex.erase(entity);
+            if (updateEntities)
+                mEntities.get(entity).removeEntitySet(Type);
+        }
+        auto j = std::size_t(0);
+        for (auto i = std::size_t(0); i < mManagedEntities.size(); ++i)
+        {
+            auto entity = mManagedEntities[i];
+            if (mEntityToIndex.has(entity))
+            {
+                if (i != j)
+                {
+                    mManagedEntities[j] = entity;
+                    mManagedComponentIds[j] = mManagedComponentIds[i];
+                    mEntityToIndex.set(entity, j);
+                }
+                ++j;
+            }
+        }
+        mManagedEntities.resize(j);
+        mManagedComponentIds.resize(j);
+    }
+
+    // A component of the entity has been removed then added again in the same batch, the set removes then adds the
+    // entity so that it refers to the new component and owning sets pack it
+    void refreshEntity(Entity entity) override
+    {
+        const auto& entityData = mEntities.get(entity);
+        if (mManagedComponentIds[mEntityToIndex.get(entity)] != ComponentIds{entityData.template getComponent<Ts>()...})
+        {
+            EntitySet::removeEntity(entity, true);
+            EntitySet::addEntity(entity);
+        }
     }
 
 private:
-    std::vector<ValueType> mManagedEntities;
+    std::pmr::vector<Entity> mManagedEntities;
+    std::pmr::vector<ComponentIds> mManagedComponentIds;
     EntityContainer& mEntities;
     ComponentContainers mComponentContainers;
+    ComponentMask mComponentMask;
+    bool mOwning = false;
     SparseSet<ListenerId, EntityAddedListener> mEntityAddedListeners;
     SparseSet<ListenerId, EntityRemovedListener> mEntityRemovedListeners;
+    Canonical* mCanonical = nullptr;
+    // Incremental sort, the entities before mSortCursor are sorted and the entity at mSortCursor is at mSortPosition
+    std::size_t mSortCursor = 0;
+    std::size_t mSortPosition = 0;
+
+    static constexpr auto CompactionRatio = std::size_t(8);
+    static constexpr auto TrackChanges = (ComponentSparseSet<Ts>::TrackChanges || ...);
+
+    template<typename T>
+    ComponentSparseSet<T>& getOwnedComponents() const
+    {
+        static_assert((std::is_same_v<T, Ts> || ...), "T must be a component type of the entity set");
+        static_assert(!ComponentTraits<T>::PagedStorage, "Columns are not available for components in paged storage");
+        if (!mOwning)
+            throw std::logic_error("Columns are only available for owning entity sets");
+        return std::get<ComponentSparseSet<T>&>(mComponentContainers);
+    }
+
+    template<typename Compare>
+    auto getEntityComparator(Compare& compare) const
+    {
+        return [this, &compare](std::size_t i, std::size_t j)
+        {
+            return compare(mManagedEntities[i], mManagedEntities[j]);
+        };
+    }
+
+    template<typename T>
+    auto getStorageComparator() const
+    {
+        static_assert((std::is_same_v<T, Ts> || ...), "T must be a component type of the entity set");
+        const auto& componentContainer = std::as_const(std::get<ComponentSparseSet<T>&>(mComponentContainers));
+        return [this, &componentContainer](std::size_t i, std::size_t j)
+        {
+            return componentContainer.getIndex(mManagedComponentIds[i][getComponentIndex<T>()]) <
+                componentContainer.getIndex(mManagedComponentIds[j][getComponentIndex<T>()]);
+        };
+    }
+
+    // less(i, j) compares the entities at indices i and j
+    template<typename Less>
+    void sortIndices(Less less)
+    {
+        auto order = std::vector<std::size_t>(mManagedEntities.size());
+        std::iota(std::begin(order), std::end(order), 0);
+        std::sort(std::begin(order), std::end(order), less);
+        auto managedEntities = std::pmr::vector<Entity>(mManagedEntities.get_allocator());
+        auto managedComponentIds = std::pmr::vector<ComponentIds>(mManagedComponentIds.get_allocator());
+        managedEntities.reserve(order.size());
+        managedComponentIds.reserve(order.size());
+        for (auto i : order)
+        {
+            managedEntities.push_back(mManagedEntities[i]);
+            managedComponentIds.push_back(mManagedComponentIds[i]);
+        }
+        mManagedEntities = std::move(managedEntities);
+        mManagedComponentIds = std::move(managedComponentIds);
+        for (auto i = std::size_t(0); i < mManagedEntities.size(); ++i)
+            mEntityToIndex.set(mManagedEntities[i], i);
+        if (mOwning)
+        {
+            for (auto i = std::size_t(0); i < mManagedEntities.size(); ++i)
+                moveComponents(mManagedComponentIds[i], i, std::index_sequence_for<Ts...>{});
+        }
+        mSortCursor = 0;
+        mSortPosition = 0;
+    }
+
+    // Insertion sort, it is fast on almost sorted sets
+    template<typename Less>
+    bool sortIndicesIncrementally(Less less, std::size_t maxSteps)
+    {
+        auto size = mManagedEntities.size();
+        // Entities may have been removed since the last call
+        if (mSortCursor >= size)
+        {
+            mSortCursor = 0;
+            mSortPosition = 0;
+        }
+        for (auto step = std::size_t(0); step < maxSteps && mSortCursor < size; ++step)
+        {
+            if (mSortPosition > 0 && less(mSortPosition, mSortPosition - 1))
+            {
+                swapEntities(mSortPosition, mSortPosition - 1);
+                --mSortPosition;
+            }
+            else
+                mSortPosition = ++mSortCursor;
+        }
+        return mSortCursor >= size;
+    }
+
+    void swapEntities(std::size_t i, std::size_t j)
+    {
+        std::swap(mManagedEntities[i], mManagedEntities[j]);
+        std::swap(mManagedComponentIds[i], mManagedComponentIds[j]);
+        mEntityToIndex.set(mManagedEntities[i], i);
+        mEntityToIndex.set(mManagedEntities[j], j);
+        if (mOwning)
+            swapComponents(i, j, std::index_sequence_for<Ts...>{});
+    }
+
+    void eraseEntity(Entity entity, bool updateEntity)
+    {
+        auto index = mEntityToIndex.get(entity);
+        if (mOwning)
+            swapComponents(index, mManagedEntities.size() - 1, std::index_sequence_for<Ts...>{});
+        mEntityToIndex.set(mManagedEntities.back(), index);
+        mEntityToIndex.erase(entity);
+        mManagedEntities[index] = mManagedEntities.back();
+        mManagedEntities.pop_back();
+        mManagedComponentIds[index] = mManagedComponentIds.back();
+        mManagedComponentIds.pop_back();
+        if (updateEntity)
+            mEntities.get(entity).removeEntitySet(Type);
+    }
+
+    template<std::size_t ...Is>
+    void moveComponents(const std::array<ComponentId, sizeof...(Ts)>& componentIds, std::size_t index, std::index_sequence<Is...>)
+    {
+        (std::get<Is>(mComponentContainers).swap(std::get<Is>(mComponentContainers).getIndex(componentIds[Is]), index), ...);
+    }
+
+    template<std::size_t ...Is>
+    bool isPacked(const std::array<ComponentId, sizeof...(Ts)>& componentIds, std::size_t index, std::index_sequence<Is...>) const
+    {
+        return ((std::get<Is>(mComponentContainers).getIndex(componentIds[Is]) == index) && ...);
+    }
+
+    template<std::size_t ...Is>
+    void swapComponents(std::size_t i, std::size_t j, std::index_sequence<Is...>)
+    {
+        (std::get<Is>(mComponentContainers).swap(i, j), ...);
+    }
+
+    // Mutable accesses mark the components callable may modify, unless MarkModified is false because it has already been
+    // done
+    template<bool MarkModified = true, typename Callable, std::size_t ...Is>
+    void forEach(Callable&& callable, std::size_t begin, std::size_t end, std::index_sequence<Is...>)
+    {
+        if constexpr (MarkModified && TrackChanges)
+            markModified<Callable>(begin, end);
+        if (mOwning)
+        {
+            for (auto first = begin; first < end;)
+            {
+                auto last = first + getContiguousSize(first, end);
+                auto objects = std::tuple(&std::get<Is>(mComponentContainers).getObjects()[first]...);
+                for (auto i = first; i < last; ++i)
+                    callable(mManagedEntities[i], std::get<Is>(objects)[i - first]...);
+                first = last;
+            }
+        }
+        else
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                const auto& componentIds = mManagedComponentIds[i];
+                callable(mManagedEntities[i], std::get<Is>(mComponentContainers).get(componentIds[Is])...);
+            }
+        }
+    }
+
+    template<bool MarkModified = true, typename Callable, std::size_t ...Is>
+    void forEach(Callable&& callable, std::size_t begin, std::size_t end, std::index_sequence<Is...>) const
+    {
+        if (mOwning)
+        {
+            for (auto first = begin; first < end;)
+            {
+                auto last = first + getContiguousSize(first, end);
+                auto objects = std::tuple(&std::as_const(std::get<Is>(mComponentContainers)).getObjects()[first]...);
+                for (auto i = first; i < last; ++i)
+                    callable(mManagedEntities[i], std::get<Is>(objects)[i - first]...);
+                first = last;
+            }
+        }
+        else
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                const auto& componentIds = mManagedComponentIds[i];
+                callable(mManagedEntities[i], std::as_const(std::get<Is>(mComponentContainers).get(componentIds[Is]))...);
+            }
+        }
+    }
+
+    template<typename Callable, std::size_t ...Is>
+    void forEachChunk(Callable&& callable, std::index_sequence<Is...>)
+    {
+        auto buffers = std::tuple<std::vector<Ts>...>();
+        for (auto begin = std::size_t(0), end = std::size_t(0); begin < mManagedEntities.size(); begin = end)
+        {
+            end = std::min(begin + ChunkSize, mManagedEntities.size());
+            if (mOwning)
+                end = begin + getContiguousSize(begin, end);
+            auto entities = Span<const Entity>(mManagedEntities.data() + begin, end - begin);
+            if constexpr (TrackChanges)
+                markModified<Callable>(begin, end);
+            if (mOwning)
+                callable(entities, Span<Ts>(&std::get<Is>(mComponentContainers).getObjects()[begin], end - begin)...);
+            else
+            {
+                (gatherComponents<Is>(std::get<Is>(buffers), begin, end), ...);
+                callable(entities, Span<Ts>(std::get<Is>(buffers))...);
+                // Move the components back
+                for (auto i = begin; i < end; ++i)
+                {
+                    const auto& componentIds = mManagedComponentIds[i];
+                    ((std::get<Is>(mComponentContainers).get(componentIds[Is]) = std::move(std::get<Is>(buffers)[i - begin])), ...);
+                }
+            }
+        }
+    }
+
+    template<typename Callable, std::size_t ...Is>
+    void forEachChunk(Callable&& callable, std::index_sequence<Is...>) const
+    {
+        auto buffers = std::tuple<std::vector<Ts>...>();
+        for (auto begin = std::size_t(0), end = std::size_t(0); begin < mManagedEntities.size(); begin = end)
+        {
+            end = std::min(begin + ChunkSize, mManagedEntities.size());
+            if (mOwning)
+                end = begin + getContiguousSize(begin, end);
+            auto entities = Span<const Entity>(mManagedEntities.data() + begin, end - begin);
+            if (mOwning)
+                callable(entities, Span<const Ts>(&std::as_const(std::get<Is>(mComponentContainers)).getObjects()[begin], end - begin)...);
+            else
+            {
+                (gatherComponents<Is>(std::get<Is>(buffers), begin, end), ...);
+                callable(entities, Span<const Ts>(std::get<Is>(buffers))...);
+            }
+        }
+    }
+
+    // Call callable with the entity at index i and its components
+    template<typename Callable, std::size_t ...Is>
+    void forEachIndex(Callable& callable, std::size_t i, std::index_sequence<Is...>)
+    {
+        const auto& componentIds = mManagedComponentIds[i];
+        markModified<Callable>(componentIds, std::index_sequence_for<Ts...>{});
+        callable(mManagedEntities[i], std::get<Is>(mComponentContainers).get(componentIds[Is])...);
+    }
+
+    template<typename Callable, std::size_t ...Is>
+    void forEachIndex(Callable& callable, std::size_t i, std::index_sequence<Is...>) const
+    {
+        const auto& componentIds = mManagedComponentIds[i];
+        callable(mManagedEntities[i], std::as_const(std::get<Is>(mComponentContainers).get(componentIds[Is]))...);
+    }
+
+    // Call callable(i) for the index i of each entity whose component Filter::Type changed after tick
+    template<typename Filter, typename Callable>
+    void forEachChangedIndex(Tick tick, Callable&& callable) const
+    {
+        using T = typename Filter::Type;
+        static_assert((std::is_same_v<T, Ts> || ...), "T must be a component type of the entity set");
+        std::as_const(std::get<ComponentSparseSet<T>&>(mComponentContainers)).getChanges().forEachSince(tick, Filter::OnlyAdded,
+            [this, &callable](Entity entity)
+            {
+                if (hasEntity(entity))
+                    callable(mEntityToIndex.get(entity));
+            });
+    }
+
+    // Mark the components of the entities from begin to end that callable may modify, callable receives the entity then
+    // the components
+    template<typename Callable>
+    void markModified(std::size_t begin, std::size_t end)
+    {
+        markModifiedComponents<Callable>(mComponentContainers, mManagedComponentIds, begin, end,
+            std::index_sequence_for<Ts...>{});
+    }
+
+    template<typename Callable, std::size_t ...Is>
+    void markModified(const ComponentIds& componentIds, std::index_sequence<Is...>)
+    {
+        (markModified<Callable, Is>(componentIds[Is]), ...);
+    }
+
+    template<typename Callable, std::size_t I>
+    void markModified([[maybe_unused]] ComponentId componentId)
+    {
+        if constexpr (mayModifyArgument<Callable, 1 + I>())
+            std::get<I>(mComponentContainers).markModified(componentId);
+    }
+
+    template<typename T>
+    static constexpr std::size_t getComponentIndex()
+    {
+        auto index = std::size_t(0);
+        auto found = false;
+        ((found = found || std::is_same_v<T, Ts>, index += found ? 0 : 1), ...);
+        return index;
+    }
+
+    // Return the number of entities from begin to end whose owned components are contiguous in all the containers
+    std::size_t getContiguousSize(std::size_t begin, std::size_t end) const
+    {
+        auto size = end - begin;
+        ((size = std::min(size, getContiguousSize(std::as_const(std::get<ComponentSparseSet<Ts>&>(mComponentContainers)).getObjects(), begin))), ...);
+        return size;
+    }
+
+    template<typename Storage>
+    static std::size_t getContiguousSize(const Storage& objects, std::size_t i)
+    {
+        if constexpr (IsPagedVector<Storage>::value)
+            return objects.getContiguousSize(i);
+        else
+            return objects.size() - i;
+    }
+
+    template<std::size_t I, typename T>
+    void gatherComponents(std::vector<T>& buffer, std::size_t begin, std::size_t end) const
+    {
+        buffer.clear();
+        for (auto i = begin; i < end; ++i)
+            buffer.push_back(std::get<I>(mComponentContainers).get(mManagedComponentIds[i][I]));
+    }
+
+    // Wrapper of callable that can be called with the components in canonical order
+    template<typename Callable>
+    class PermutedCallable
+    {
+    public:
+        explicit PermutedCallable(Callable& callable) : mCallable(callable)
+        {
+
+        }
+
+        template<typename First, typename ...Components>
+        void operator()(First&& first, Components&&... components) const
+        {
+            call(std::forward<First>(first), std::forward_as_tuple(std::forward<Components>(components)...),
+                std::index_sequence_for<Ts...>{});
+        }
+
+        // The (I - 1)-th component in canonical order is the Order::Indices[I - 1]-th one of callable
+        template<std::size_t I>
+        static constexpr bool mayModifyArgument()
+        {
+            if constexpr (I == 0)
+                return ecs::mayModifyArgument<Callable, 0>();
+            else
+                return ecs::mayModifyArgument<Callable, 1 + Order::Indices[I - 1]>();
+        }
+
+    private:
+        Callable& mCallable;
+
+        template<typename First, typename Components, std::size_t ...Is>
+        void call(First&& first, Components&& components, std::index_sequence<Is...>) const
+        {
+            mCallable(std::forward<First>(first), std::get<Order::Positions[Is]>(std::move(components))...);
+        }
+    };
+
+    template<typename Callable>
+    static PermutedCallable<Callable> permute(Callable& callable)
+    {
+        return PermutedCallable<Callable>(callable);
+    }
+
+    template<typename Self, typename Callable>
+    static void runParallelForEach(Self& self, Callable& callable, std::size_t grainSize, ThreadPool& pool)
+    {
+        auto size = self.mManagedEntities.size();
+        // The components are marked as modified before the parallel loop so that the threads do not contend for the
+        // change logs
+        if constexpr (!std::is_const_v<Self> && TrackChanges)
+            self.template markModified<Callable>(0, size);
+        parallelFor(size, grainSize, pool, [&self, &callable](std::size_t begin, std::size_t end)
+        {
+            self.template forEach<false>(callable, begin, end, std::index_sequence_for<Ts...>{});
+        });
+    }
 };
 
 template<typename ...Ts>
-const EntitySetType EntitySet<Ts...>::Type = BaseEntitySet::generateEntitySetType<Ts...>();
+const EntitySetType EntitySet<Ts...>::Type = BaseEntitySet::generateEntitySetType<EntitySet<Ts...>>();
+
+}
 
 }
\ No newline at end of file
@@ -3,20 +3,26 @@
 #include <array>
 #include <tuple>
 #include <utility>
+#include <vector>
 #include "ComponentSparseSet.h"
+#include "Config.h"
 #include "Entity.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
 template<typename Iterator, typename ...Ts>
 class EntitySetIterator
 {
+    using EntityIterator = typename std::pmr::vector<Entity>::const_iterator;
     using ComponentContainers = std::tuple<ComponentSparseSet<std::remove_const_t<Ts>>&...>;
 
 public:
-    explicit EntitySetIterator(Iterator it, const ComponentContainers& componentContainers) :
-        mIt(it), mComponentContainers(componentContainers)
+    explicit EntitySetIterator(EntityIterator entityIt, Iterator it, const ComponentContainers& componentContainers) :
+        mEntityIt(entityIt), mIt(it), mComponentContainers(componentContainers)
     {
 
     }
@@ -28,22 +34,25 @@ public:
 
     std::pair<Entity, std::tuple<Ts&...>> operator*()
     {
-        return std::pair(mIt->first, getComponentsByIds(mIt->second, std::index_sequence_for<Ts...>{}));
+        return std::pair(*mEntityIt, getComponentsByIds(*mIt, std::index_sequence_for<Ts...>{}));
     }
 
     EntitySetIterator<Iterator, Ts...>& operator++()
     {
+        ++mEntityIt;
         ++mIt;
         return *this;
     }
 
 private:
+    EntityIterator mEntityIt;
     Iterator mIt;
     const ComponentContainers& mComponentContainers; // MAYBE: just copy the references
 
     template<std::size_t ...Is>
     std::tuple<Ts&...> getComponentsByIds(const std::array<ComponentId, sizeof...(Ts)>& componentIds, std::index_sequence<Is...>)
     {
+        (markModified<Ts>(std::get<Is>(mComponentContainers), componentIds[Is]), ...);
         return std::tie(std::get<Is>(mComponentContainers).get(componentIds[Is])...);
     }
 
@@ -52,6 +61,47 @@ private:
     {
         return std::tie(std::as_const(std::get<Is>(mComponentContainers).get(componentIds[Is]))...);
     }
+
+    // Mutable accesses mark the components as modified
+    template<typename T, typename Container>
+    static void markModified([[maybe_unused]] Container& componentContainer, [[maybe_unused]] ComponentId componentId)
+    {
+        if constexpr (!std::is_const_v<T>)
+            componentContainer.markModified(componentId);
+    }
+};
+
+// Iterator over a permutation of an entity set, it reorders the components returned by the iterator of the canonical set
+template<typename Iterator, typename ...Ts>
+class PermutedEntitySetIterator
+{
+public:
+    explicit PermutedEntitySetIterator(Iterator it) : mIt(it)
+    {
+
+    }
+
+    bool operator!=(const PermutedEntitySetIterator<Iterator, Ts...>& it)
+    {
+        return mIt != it.mIt;
+    }
+
+    std::pair<Entity, std::tuple<Ts&...>> operator*()
+    {
+        auto [entity, components] = *mIt;
+        return std::pair(entity, std::tuple<Ts&...>(std::get<Ts&>(components)...));
+    }
+
+    PermutedEntitySetIterator<Iterator, Ts...>& operator++()
+    {
+        ++mIt;
+        return *this;
+    }
+
+private:
+    Iterator mIt;
 };
 
-}
\ No newline at end of file
+}
+
+}
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <cstdint>
+#include "Config.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
 using EntitySetType = std::size_t;
 
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include "Component.h"
+#include "Config.h"
+#include "EntitySet.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Component types an entity must have
+template<typename ...Ts>
+struct With
+{
+
+};
+
+// Component types an entity must not have
+template<typename ...Ts>
+struct Without
+{
+
+};
+
+// Component types an entity may have
+template<typename ...Ts>
+struct Optional
+{
+
+};
+
+// Set of the entities that have the components Ts and none of the components Us
+// The ids of the components Ts and of the components Vs the entity has are stored with the entity and updated when
+// components Vs are added or removed, so iterating never looks up the entities
+template<typename ...Ts, typename ...Us, typename ...Vs>
+class EntitySet<With<Ts...>, Without<Us...>, Optional<Vs...>> : public BaseEntitySet
+{
+    // Entity sets are only notified of the entities whose components change, so they never see the entities created
+    // without components
+    static_assert(sizeof...(Ts) > 0, "With must list at least one component type");
+
+    static constexpr auto UndefinedComponent = std::numeric_limits<ComponentId>::max();
+
+    using ComponentIds = std::array<ComponentId, sizeof...(Ts) + sizeof...(Vs)>;
+    using ComponentContainers = std::tuple<ComponentSparseSet<Ts>&..., ComponentSparseSet<Vs>&...>;
+
+    static constexpr auto TrackChanges = (ComponentSparseSet<Ts>::TrackChanges || ...) ||
+        (ComponentSparseSet<Vs>::TrackChanges || ...);
+
+    // Iterator that returns the entity with the components Ts and pointers to the components Vs, null if the entity
+    // does not have them
+    template<bool IsConst>
+    class BasicIterator
+    {
+        using Set = std::conditional_t<IsConst, const EntitySet, EntitySet>;
+
+    public:
+        BasicIterator(Set& entitySet, std::size_t i) : mEntitySet(&entitySet), mI(i)
+        {
+
+        }
+
+        bool operator!=(const BasicIterator& it) const
+        {
+            return mI != it.mI;
+        }
+
+        auto operator*() const
+        {
+            return mEntitySet->getComponents(mI, std::index_sequence_for<Ts...>{}, std::index_sequence_for<Vs...>{});
+        }
+
+        BasicIterator& operator++()
+        {
+            ++mI;
+            return *this;
+        }
+
+    private:
+        Set* mEntitySet;
+        std::size_t mI;
+    };
+
+public:
+    using Iterator = BasicIterator<false>;
+    using ConstIterator = BasicIterator<true>;
+
+    // Filtered sets are not shared between permutations
+    using Canonical = EntitySet;
+    static constexpr auto IsCanonical = true;
+    static const EntitySetType Type;
+
+    EntitySet(EntityContainer& entities, const ComponentContainers& componentContainers,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        BaseEntitySet(resource), mManagedEntities(resource), mManagedComponentIds(resource), mEntities(entities),
+        mComponentContainers(componentContainers), mRequiredComponentMask(ComponentMask::create<Ts...>()),
+        mExcludedComponentMask(ComponentMask::create<Us...>())
+    {
+
+    }
+
+    // The component containers of Ts and Vs must exist
+    static std::unique_ptr<EntitySet> create(EntityContainer& entities,
+        const std::vector<std::unique_ptr<BaseComponentContainer>>& componentContainers, std::pmr::memory_resource* resource)
+    {
+        checkComponentTypes<Ts..., Us..., Vs...>();
+        return std::make_unique<EntitySet>(entities,
+            std::tie(getComponentSparseSet<Ts>(componentContainers)..., getComponentSparseSet<Vs>(componentContainers)...),
+            resource);
+    }
+
+    // Call callable(type) for each component type whose addition or removal may change the entities of the set or
+    // their optional components
+    template<typename Callable>
+    static void forEachComponentType(Callable&& callable)
+    {
+        (callable(Ts::Type), ...);
+        (callable(Us::Type), ...);
+        (callable(Vs::Type), ...);
+    }
+
+    // Name of the set type in snapshots
+    static std::string getName()
+    {
+        return "EntitySet<With<" + joinTypeNames<Ts...>() + ">, Without<" + joinTypeNames<Us...>() + ">, Optional<" +
+            joinTypeNames<Vs...>() + ">>";
+    }
+
+    EntitySetType getType() const override
+    {
+        return Type;
+    }
+
+    std::size_t getSize() const
+    {
+        return mManagedEntities.size();
+    }
+
+    // Dereferencing a mutable iterator marks all the components of the entity as modified, iterate over a const set to
+    // only read them
+    Iterator begin()
+    {
+        return Iterator(*this, 0);
+    }
+
+    ConstIterator begin() const
+    {
+        return ConstIterator(*this, 0);
+    }
+
+    Iterator end()
+    {
+        return Iterator(*this, mManagedEntities.size());
+    }
+
+    ConstIterator end() const
+    {
+        return ConstIterator(*this, mManagedEntities.size());
+    }
+
+    // Call callable(entity, ts..., vs...) for each entity, where ts are the components Ts and vs are pointers to the
+    // components Vs, null if the entity does not have them
+    template<typename Callable>
+    void forEach(Callable&& callable)
+    {
+        forEach(callable, 0, mManagedEntities.size(), std::index_sequence_for<Ts...>{},
+            std::index_sequence_for<Vs...>{});
+    }
+
+    template<typename Callable>
+    void forEach(Callable&& callable) const
+    {
+        forEach(callable, 0, mManagedEntities.size(), std::index_sequence_for<Ts...>{},
+            std::index_sequence_for<Vs...>{});
+    }
+
+    // Same as forEach but the entities are split in ranges of grainSize entities that are processed in parallel by pool,
+    // with the same restrictions as EntitySet::parallelForEach
+    template<typename Callable>
+    void parallelForEach(Callable&& callable, std::size_t grainSize, ThreadPool& pool = ThreadPool::getDefault())
+    {
+        runParallelForEach(*this, callable, grainSize, pool);
+    }
+
+    template<typename Callable>
+    void parallelForEach(Callable&& callable, std::size_t grainSize, ThreadPool& pool = ThreadPool::getDefault()) const
+    {
+        runParallelForEach(*this, callable, grainSize, pool);
+    }
+
+    // Filtered sets are never owning
+    bool isOwning() const
+    {
+        return false;
+    }
+
+    // Copy the entities of other, the entities themselves must already be copied
+    void copy(const EntitySet& other)
+    {
+        copyIndex(other);
+        mManagedEntities = other.mManagedEntities;
+        mManagedComponentIds = other.mManagedComponentIds;
+    }
+
+    // Remove all the entities without calling the listeners nor updating the entities
+    void clear()
+    {
+        clearIndex(mManagedEntities);
+        mManagedEntities.clear();
+        mManagedComponentIds.clear();
+    }
+
+    void save(BinaryWriter& writer) const override
+    {
+        writer.writeArray(mManagedEntities);
+        writer.writeArray(mManagedComponentIds);
+    }
+
+    bool load(BinaryReader& reader) override
+    {
+        if (!reader.readArray(mManagedEntities) || !reader.readArray(mManagedComponentIds) ||
+            mManagedEntities.size() != mManagedComponentIds.size() || !indexEntities(mEntities, mManagedEntities))
+        {
+            return false;
+        }
+        for (auto i = std::size_t(0); i < mManagedEntities.size(); ++i)
+        {
+            if (mManagedComponentIds[i] != getComponentIds(mEntities.get(mManagedEntities[i])))
+                return false;
+        }
+        return true;
+    }
+
+    void onEntitiesUpdated(Span<const Entity> entities) override
+    {
+        for (auto entity : entities)
+        {
+            auto satisfied = EntitySet::satisfyRequirements(entity);
+            auto managed = hasEntity(entity);
+            if (satisfied && !managed)
+                EntitySet::addEntity(entity);
+            else if (!satisfied && managed)
+                EntitySet::removeEntity(entity, true);
+            else if (satisfied)
+                EntitySet::refreshEntity(entity);
+        }
+    }
+
+protected:
+    bool satisfyRequirements(Entity entity) override
+    {
+        const auto& componentMask = mEntities.get(entity).getComponentMask();
+        return componentMask.contains(mRequiredComponentMask) && !componentMask.intersects(mExcludedComponentMask);
+    }
+
+    void addEntity(Entity entity) override
+    {
+        mEntityToIndex.set(entity, mManagedEntities.size());
+        auto entityData = mEntities.get(entity);
+        entityData.addEntitySet(Type);
+        mManagedEntities.push_back(entity);
+        mManagedComponentIds.push_back(getComponentIds(entityData));
+        bufferAddedEntity(entity);
+    }
+
+    void removeEntity(Entity entity, bool updateEntity) override
+    {
+        bufferRemovedEntity(entity);
+        auto index = mEntityToIndex.get(entity);
+        mEntityToIndex.set(mManagedEntities.back(), index);
+        mEntityToIndex.erase(entity);
+        mManagedEntities[index] = mManagedEntities.back();
+        mManagedEntities.pop_back();
+        mManagedComponentIds[index] = mManagedComponentIds.back();
+        mManagedComponentIds.pop_back();
+        if (updateEntity)
+            mEntities.get(entity).removeEntitySet(Type);
+    }
+
+    void removeEntities(Span<const Entity> entities, bool updateEntities) override
+    {
+        for (auto entity : entities)
+            EntitySet::removeEntity(entity, updateEntities);
+    }
+
+    void refreshEntity(Entity entity) override
+    {
+        mManagedComponentIds[mEntityToIndex.get(entity)] = getComponentIds(mEntities.get(entity));
+    }
+
+private:
+    std::pmr::vector<Entity> mManagedEntities;
+    std::pmr::vector<ComponentIds> mManagedComponentIds;
+    EntityContainer& mEntities;
+    ComponentContainers mComponentContainers;
+    ComponentMask mRequiredComponentMask;
+    ComponentMask mExcludedComponentMask;
+
+    static ComponentIds getComponentIds(ConstEntityData entityData)
+    {
+        return ComponentIds{entityData.getComponent<Ts>()...,
+            (entityData.hasComponent<Vs>() ? entityData.getComponent<Vs>() : UndefinedComponent)...};
+    }
+
+    // Mutable accesses mark the components callable may modify, unless MarkModified is false because it has already been
+    // done
+    template<bool MarkModified = true, typename Callable, std::size_t ...Is, std::size_t ...Js>
+    void forEach(Callable& callable, std::size_t begin, std::size_t end, std::index_sequence<Is...>,
+        std::index_sequence<Js...>)
+    {
+        if constexpr (MarkModified && TrackChanges)
+            markModified<Callable>(begin, end);
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto& componentIds = mManagedComponentIds[i];
+            callable(mManagedEntities[i], std::get<Is>(mComponentContainers).get(componentIds[Is])...,
+                getOptionalComponent<Vs, sizeof...(Ts) + Js>(componentIds)...);
+        }
+    }
+
+    template<bool MarkModified = true, typename Callable, std::size_t ...Is, std::size_t ...Js>
+    void forEach(Callable& callable, std::size_t begin, std::size_t end, std::index_sequence<Is...>,
+        std::index_sequence<Js...>) const
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto& componentIds = mManagedComponentIds[i];
+            callable(mManagedEntities[i], std::as_const(std::get<Is>(mComponentContainers).get(componentIds[Is]))...,
+                getOptionalComponent<Vs, sizeof...(Ts) + Js>(componentIds)...);
+        }
+    }
+
+    // Same as EntitySet::runParallelForEach
+    template<typename Self, typename Callable>
+    static void runParallelForEach(Self& self, Callable& callable, std::size_t grainSize, ThreadPool& pool)
+    {
+        auto size = self.mManagedEntities.size();
+        if constexpr (!std::is_const_v<Self> && TrackChanges)
+            self.template markModified<Callable>(0, size);
+        parallelFor(size, grainSize, pool, [&self, &callable](std::size_t begin, std::size_t end)
+        {
+            self.template forEach<false>(callable, begin, end, std::index_sequence_for<Ts...>{},
+                std::index_sequence_for<Vs...>{});
+        });
+    }
+
+    // Mark the components of the entities from begin to end that callable may modify, callable receives the entity, the
+    // components Ts then the pointers to the components Vs
+    template<typename Callable>
+    void markModified(std::size_t begin, std::size_t end)
+    {
+        markModifiedComponents<Callable>(mComponentContainers, mManagedComponentIds, begin, end,
+            std::make_index_sequence<sizeof...(Ts) + sizeof...(Vs)>{});
+    }
+
+    // Used by the iterators, mutable accesses mark all the components as modified
+    template<std::size_t ...Is, std::size_t ...Js>
+    std::pair<Entity, std::tuple<Ts&..., Vs*...>> getComponents(std::size_t i, std::index_sequence<Is...>,
+        std::index_sequence<Js...>)
+    {
+        const auto& componentIds = mManagedComponentIds[i];
+        (std::get<Is>(mComponentContainers).markModified(componentIds[Is]), ...);
+        auto optionalComponents = std::tuple<Vs*...>(getOptionalComponent<Vs, sizeof...(Ts) + Js>(componentIds)...);
+        ((std::get<Js>(optionalComponents) != nullptr ?
+            std::get<sizeof...(Ts) + Js>(mComponentContainers).markModified(componentIds[sizeof...(Ts) + Js]) :
+            void()), ...);
+        return std::pair(mManagedEntities[i], std::tuple_cat(
+            std::tie(std::get<Is>(mComponentContainers).get(componentIds[Is])...), optionalComponents));
+    }
+
+    template<std::size_t ...Is, std::size_t ...Js>
+    std::pair<Entity, std::tuple<const Ts&..., const Vs*...>> getComponents(std::size_t i, std::index_sequence<Is...>,
+        std::index_sequence<Js...>) const
+    {
+        const auto& componentIds = mManagedComponentIds[i];
+        return std::pair(mManagedEntities[i], std::tuple<const Ts&..., const Vs*...>(
+            std::as_const(std::get<Is>(mComponentContainers).get(componentIds[Is]))...,
+            getOptionalComponent<Vs, sizeof...(Ts) + Js>(componentIds)...));
+    }
+
+    template<typename V, std::size_t I>
+    V* getOptionalComponent(const ComponentIds& componentIds)
+    {
+        auto componentId = componentIds[I];
+        if (componentId == UndefinedComponent)
+            return nullptr;
+        return &std::get<I>(mComponentContainers).get(componentId);
+    }
+
+    template<typename V, std::size_t I>
+    const V* getOptionalComponent(const ComponentIds& componentIds) const
+    {
+        auto componentId = componentIds[I];
+        if (componentId == UndefinedComponent)
+            return nullptr;
+        return &std::as_const(std::get<I>(mComponentContainers)).get(componentId);
+    }
+};
+
+template<typename ...Ts, typename ...Us, typename ...Vs>
+const EntitySetType EntitySet<With<Ts...>, Without<Us...>, Optional<Vs...>>::Type =
+    BaseEntitySet::generateEntitySetType<EntitySet<With<Ts...>, Without<Us...>, Optional<Vs...>>>();
+
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Ids are indices by default, generational ids also store the number of times their index has been reused so that
+// a stale id can be told apart from the id that reuses its index
+template<typename Id>
+struct IdTraits
+{
+    static constexpr auto Generational = false;
+    // Number of indices that ids can encode
+    static constexpr auto MaxCount = std::numeric_limits<std::size_t>::max();
+
+    static constexpr std::size_t getIndex(Id id)
+    {
+        return static_cast<std::size_t>(id);
+    }
+
+    static constexpr uint32_t getGeneration(Id)
+    {
+        return 0;
+    }
+
+    static constexpr Id create(std::size_t index, uint32_t)
+    {
+        return static_cast<Id>(index);
+    }
+};
+
+}
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <new>
+#endif
+#include "Config.h"
+#include "Serialization.h"
+#include "Span.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Read-only view of a whole file, the file is memory-mapped on POSIX systems and read in a buffer aligned on
+// SerializationAlignment elsewhere
+class MappedFile
+{
+public:
+#if defined(__unix__) || defined(__APPLE__)
+    explicit MappedFile(const std::string& path)
+    {
+        auto file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return;
+        struct stat status;
+        if (::fstat(file, &status) == 0 && status.st_size > 0)
+        {
+            auto size = static_cast<std::size_t>(status.st_size);
+            auto address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (address != MAP_FAILED)
+            {
+                mAddress = address;
+                mSize = size;
+            }
+        }
+        ::close(file);
+    }
+#else
+    explicit MappedFile(const std::string& path)
+    {
+        auto file = std::ifstream(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return;
+        auto size = static_cast<std::size_t>(file.tellg());
+        if (size == 0)
+            return;
+        auto address = ::operator new(size, std::align_val_t(SerializationAlignment));
+        file.seekg(0);
+        if (file.read(static_cast<char*>(address), static_cast<std::streamsize>(size)))
+        {
+            mAddress = address;
+            mSize = size;
+        }
+        else
+            ::operator delete(address, std::align_val_t(SerializationAlignment));
+    }
+#endif
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (mAddress == nullptr)
+            return;
+#if defined(__unix__) || defined(__APPLE__)
+        ::munmap(mAddress, mSize);
+#else
+        ::operator delete(mAddress, std::align_val_t(SerializationAlignment));
+#endif
+    }
+
+    bool isOpen() const
+    {
+        return mAddress != nullptr;
+    }
+
+    Span<const std::byte> getData() const
+    {
+        return Span<const std::byte>(static_cast<const std::byte*>(mAddress), mSize);
+    }
+
+private:
+    void* mAddress = nullptr;
+    std::size_t mSize = 0;
+};
+
+}
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Sequence of objects stored in fixed-size pages, growing never moves the objects already stored
+// Only growth is covered: sparse sets move the last object into the place of an erased one and swap objects, so a
+// reference to a stored object does not stay valid until that object is erased
+// Objects are densely packed: the i-th object is the (i % PageCapacity)-th object of the (i / PageCapacity)-th page
+// Pages are kept when objects are removed and reused when the sequence grows again
+template<typename T>
+class PagedVector
+{
+public:
+    using value_type = T;
+    static constexpr auto PageSize = std::size_t(16384);
+    static constexpr auto PageCapacity = std::max<std::size_t>(PageSize / sizeof(T), 1);
+
+    explicit PagedVector(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        mPages(resource)
+    {
+
+    }
+
+    PagedVector(const PagedVector&) = delete;
+    PagedVector& operator=(const PagedVector&) = delete;
+
+    ~PagedVector()
+    {
+        clear();
+        auto allocator = getAllocator();
+        for (auto page : mPages)
+            allocator.deallocate(page, PageCapacity);
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    std::size_t capacity() const
+    {
+        return mPages.size() * PageCapacity;
+    }
+
+    T& operator[](std::size_t i)
+    {
+        return mPages[i / PageCapacity][i % PageCapacity];
+    }
+
+    const T& operator[](std::size_t i) const
+    {
+        return mPages[i / PageCapacity][i % PageCapacity];
+    }
+
+    T& back()
+    {
+        return (*this)[mSize - 1];
+    }
+
+    const T& back() const
+    {
+        return (*this)[mSize - 1];
+    }
+
+    // Number of objects stored contiguously from the i-th object
+    std::size_t getContiguousSize(std::size_t i) const
+    {
+        return std::min(PageCapacity - i % PageCapacity, mSize - i);
+    }
+
+    template<typename ...Args>
+    T& emplace_back(Args&&... args)
+    {
+        if (mSize == capacity())
+            mPages.push_back(getAllocator().allocate(PageCapacity));
+        auto object = &mPages[mSize / PageCapacity][mSize % PageCapacity];
+        // The allocator uses the memory resource for allocator-aware objects
+        getAllocator().construct(object, std::forward<Args>(args)...);
+        ++mSize;
+        return *object;
+    }
+
+    void pop_back()
+    {
+        --mSize;
+        (*this)[mSize].~T();
+    }
+
+    void clear()
+    {
+        while (mSize > 0)
+            pop_back();
+    }
+
+    // Copy the objects of other, the objects already constructed are assigned and the pages already allocated reused
+    void assign(const PagedVector& other)
+    {
+        while (mSize > other.mSize)
+            pop_back();
+        for (auto i = std::size_t(0); i < mSize; i += getContiguousSize(i))
+            std::copy_n(&other[i], getContiguousSize(i), &(*this)[i]);
+        while (mSize < other.mSize)
+            emplace_back(other[mSize]);
+    }
+
+    void reserve(std::size_t size)
+    {
+        auto allocator = getAllocator();
+        while (capacity() < size)
+            mPages.push_back(allocator.allocate(PageCapacity));
+    }
+
+private:
+    std::pmr::vector<T*> mPages;
+    std::size_t mSize = 0;
+
+    std::pmr::polymorphic_allocator<T> getAllocator() const
+    {
+        return std::pmr::polymorphic_allocator<T>(mPages.get_allocator().resource());
+    }
+};
+
+template<typename Storage>
+struct IsPagedVector : std::false_type
+{
+
+};
+
+template<typename T>
+struct IsPagedVector<PagedVector<T>> : std::true_type
+{
+
+};
+
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "Config.h"
+#include "EntityManager.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Ring buffer of the last states of an entity manager, to roll it back a few frames
+// Saving a state overwrites the oldest one and reuses its memory, so once the buffer has been filled saving and
+// restoring states do not allocate as long as the world does not grow
+class RollbackBuffer
+{
+public:
+    // std::invalid_argument is thrown if capacity is 0
+    explicit RollbackBuffer(std::size_t capacity, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    {
+        if (capacity == 0)
+            throw std::invalid_argument("The capacity of a rollback buffer must be positive");
+        mStates.reserve(capacity);
+        for (auto i = std::size_t(0); i < capacity; ++i)
+            mStates.push_back(std::make_unique<EntityManager>(resource));
+    }
+
+    std::size_t getCapacity() const
+    {
+        return mStates.size();
+    }
+
+    // Number of states that can be restored
+    std::size_t getSize() const
+    {
+        return mSize;
+    }
+
+    // Return false if the components of a type are not copyable, no state is saved then
+    bool save(const EntityManager& manager)
+    {
+        auto next = (mLast + 1) % mStates.size();
+        if (!mStates[next]->restoreFrom(manager))
+            return false;
+        mLast = next;
+        mSize = std::min(mSize + 1, mStates.size());
+        return true;
+    }
+
+    // State saved age saves ago, 0 is the last saved state
+    // std::out_of_range is thrown if the state has not been saved or has been overwritten
+    const EntityManager& getState(std::size_t age) const
+    {
+        if (age >= mSize)
+            throw std::out_of_range("The state has not been saved or has been overwritten");
+        return *mStates[getIndex(age)];
+    }
+
+    // Restore the state saved age saves ago into manager, the states saved after it are discarded
+    // Return false if the state has not been saved or has been overwritten or if the components of a type are not
+    // copyable, manager and the states are not modified then
+    bool restore(EntityManager& manager, std::size_t age)
+    {
+        if (age >= mSize || !manager.restoreFrom(*mStates[getIndex(age)]))
+            return false;
+        mLast = getIndex(age);
+        mSize -= age;
+        return true;
+    }
+
+private:
+    std::vector<std::unique_ptr<EntityManager>> mStates;
+    std::size_t mLast = 0;
+    std::size_t mSize = 0;
+
+    std::size_t getIndex(std::size_t age) const
+    {
+        return (mLast + mStates.size() - age) % mStates.size();
+    }
+};
+
+}
+
+}
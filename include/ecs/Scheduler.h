@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include "Config.h"
+#include "EntityManager.h"
+#include "ThreadPool.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Component types read by a system
+template<typename ...Ts>
+struct Read
+{
+
+};
+
+// Component types written by a system
+template<typename ...Ts>
+struct Write
+{
+
+};
+
+template<typename T, typename ...Ws>
+constexpr bool isWritten()
+{
+    return (std::is_same_v<T, Ws> || ...);
+}
+
+// Components of an entity set, in the order they are passed to callables
+template<typename Set>
+struct SetComponents;
+
+template<typename ...Ts>
+struct SetComponents<EntitySet<Ts...>>
+{
+    using Types = std::tuple<Ts...>;
+};
+
+template<typename ...Ts, typename ...Us, typename ...Vs>
+struct SetComponents<EntitySet<With<Ts...>, Without<Us...>, Optional<Vs...>>>
+{
+    using Types = std::tuple<Ts..., Vs...>;
+};
+
+// Entity set given to a system that does not write all the components of the set
+// The components Ws are passed to the callables as mutable references or pointers, the others as const ones
+template<typename Set, typename ...Ws>
+class SystemEntitySet
+{
+public:
+    explicit SystemEntitySet(Set& entitySet) : mEntitySet(entitySet)
+    {
+
+    }
+
+    const Set& getEntitySet() const
+    {
+        return mEntitySet;
+    }
+
+    std::size_t getSize() const
+    {
+        return mEntitySet.getSize();
+    }
+
+    bool hasEntity(Entity entity) const
+    {
+        return mEntitySet.hasEntity(entity);
+    }
+
+    template<typename Callable>
+    void forEach(Callable&& callable)
+    {
+        mEntitySet.forEach(restrictCallable(callable));
+    }
+
+    template<typename Callable>
+    void parallelForEach(Callable&& callable, std::size_t grainSize, ThreadPool& pool = ThreadPool::getDefault())
+    {
+        mEntitySet.parallelForEach(restrictCallable(callable), grainSize, pool);
+    }
+
+private:
+    Set& mEntitySet;
+
+    // Wrapper of callable that only passes the components Ws as mutable
+    template<typename Callable>
+    class RestrictedCallable
+    {
+    public:
+        explicit RestrictedCallable(Callable& callable) : mCallable(callable)
+        {
+
+        }
+
+        template<typename ...Components>
+        void operator()(Entity entity, Components&&... components) const
+        {
+            mCallable(entity, restrictAccess(components)...);
+        }
+
+        // The components that are not written are never modified
+        template<std::size_t I>
+        static constexpr bool mayModifyArgument()
+        {
+            if constexpr (I == 0)
+                return ecs::mayModifyArgument<Callable, 0>();
+            else
+            {
+                return isWritten<std::tuple_element_t<I - 1, typename SetComponents<Set>::Types>, Ws...>() &&
+                    ecs::mayModifyArgument<Callable, I>();
+            }
+        }
+
+    private:
+        Callable& mCallable;
+    };
+
+    template<typename Callable>
+    static RestrictedCallable<Callable> restrictCallable(Callable& callable)
+    {
+        return RestrictedCallable<Callable>(callable);
+    }
+
+    template<typename T>
+    static auto& restrictAccess(T& component)
+    {
+        if constexpr (isWritten<T, Ws...>())
+            return component;
+        else
+            return std::as_const(component);
+    }
+
+    // Optional components
+    template<typename T>
+    static auto restrictAccess(T* component)
+    {
+        if constexpr (isWritten<T, Ws...>())
+            return component;
+        else
+            return static_cast<const T*>(component);
+    }
+};
+
+template<typename EntitySet, typename Reads, typename Writes>
+struct SystemAccess;
+
+// The system receives the entity set itself only if it writes all its components
+template<bool WritesAll, typename ...Ws, typename Set, typename Callable>
+std::function<void()> bindSystem(Set& entitySet, Callable&& callable)
+{
+    if constexpr (WritesAll)
+    {
+        return [&entitySet, callable = std::forward<Callable>(callable)]() mutable
+        {
+            callable(entitySet);
+        };
+    }
+    else
+    {
+        return [entitySet = SystemEntitySet<Set, Ws...>(entitySet), callable = std::forward<Callable>(callable)]() mutable
+        {
+            callable(entitySet);
+        };
+    }
+}
+
+template<typename ...Ts, typename ...Rs, typename ...Ws>
+struct SystemAccess<EntitySet<Ts...>, Read<Rs...>, Write<Ws...>>
+{
+    static ComponentMask getReads()
+    {
+        // The components of the entity set are at least read
+        return ComponentMask::create<Ts..., Rs...>();
+    }
+
+    static ComponentMask getWrites()
+    {
+        return ComponentMask::create<Ws...>();
+    }
+
+    template<typename Callable>
+    static std::function<void()> bind(EntityManager& entityManager, Callable&& callable)
+    {
+        checkComponentTypes<Ts..., Rs..., Ws...>();
+        return bindSystem<(isWritten<Ts, Ws...>() && ...), Ws...>(entityManager.getEntitySet<Ts...>(),
+            std::forward<Callable>(callable));
+    }
+};
+
+template<typename ...Ts, typename ...Us, typename ...Vs, typename ...Rs, typename ...Ws>
+struct SystemAccess<EntitySet<With<Ts...>, Without<Us...>, Optional<Vs...>>, Read<Rs...>, Write<Ws...>>
+{
+    static ComponentMask getReads()
+    {
+        // The required and optional components of the entity set are at least read
+        return ComponentMask::create<Ts..., Vs..., Rs...>();
+    }
+
+    static ComponentMask getWrites()
+    {
+        return ComponentMask::create<Ws...>();
+    }
+
+    template<typename Callable>
+    static std::function<void()> bind(EntityManager& entityManager, Callable&& callable)
+    {
+        checkComponentTypes<Rs..., Ws...>();
+        return bindSystem<(isWritten<Ts, Ws...>() && ...) && (isWritten<Vs, Ws...>() && ...), Ws...>(
+            entityManager.getEntitySet<With<Ts...>, Without<Us...>, Optional<Vs...>>(), std::forward<Callable>(callable));
+    }
+};
+
+// Run systems concurrently when their accesses to components do not conflict
+// A system conflicts with a previously added system if one of them writes a component type the other reads or writes,
+// conflicting systems are run in the order they have been added
+// Systems must not create or remove entities, nor add or remove components
+class Scheduler
+{
+public:
+    using SystemId = std::size_t;
+    using Duration = std::chrono::steady_clock::duration;
+
+    explicit Scheduler(EntityManager& entityManager, ThreadPool& pool = ThreadPool::getDefault()) :
+        mEntityManager(entityManager), mPool(pool)
+    {
+
+    }
+
+    // Add a system that iterates over EntitySet, callable is called with the entity set if Writes contains all its
+    // components, otherwise with a SystemEntitySet that only gives mutable access to the components in Writes
+    template<typename EntitySet, typename Reads = Read<>, typename Writes = Write<>, typename Callable>
+    SystemId addSystem(std::string name, Callable&& callable)
+    {
+        using Access = SystemAccess<EntitySet, Reads, Writes>;
+        auto id = mSystems.size();
+        auto& system = mSystems.emplace_back();
+        system.name = std::move(name);
+        system.reads = Access::getReads();
+        system.writes = Access::getWrites();
+        system.function = Access::bind(mEntityManager, std::forward<Callable>(callable));
+        for (auto previous = SystemId(0); previous < id; ++previous)
+        {
+            if (conflict(mSystems[previous], system))
+            {
+                system.dependencies.push_back(previous);
+                mSystems[previous].dependents.push_back(id);
+            }
+        }
+        return id;
+    }
+
+    // If a system throws, the systems that depend on it are not run and the first exception is rethrown once the
+    // running systems are done
+    void run()
+    {
+        auto group = TaskGroup();
+        for (auto& system : mSystems)
+            system.nbRemainingDependencies.store(system.dependencies.size(), std::memory_order_relaxed);
+        for (auto id = SystemId(0); id < mSystems.size(); ++id)
+        {
+            if (mSystems[id].dependencies.empty())
+                submit(group, id);
+        }
+        mPool.wait(group);
+    }
+
+    // Systems
+
+    std::size_t getSystemCount() const
+    {
+        return mSystems.size();
+    }
+
+    const std::string& getName(SystemId id) const
+    {
+        return mSystems[id].name;
+    }
+
+    const std::vector<SystemId>& getDependencies(SystemId id) const
+    {
+        return mSystems[id].dependencies;
+    }
+
+    // Duration of the system during the last run
+    Duration getDuration(SystemId id) const
+    {
+        return mSystems[id].duration;
+    }
+
+    // Return the chain of dependent systems with the longest total duration during the last run
+    std::vector<SystemId> getCriticalPath() const
+    {
+        auto finishTimes = std::vector<Duration>(mSystems.size());
+        auto predecessors = std::vector<SystemId>(mSystems.size(), mSystems.size());
+        auto last = SystemId(0);
+        // Systems are added in a topological order
+        for (auto id = SystemId(0); id < mSystems.size(); ++id)
+        {
+            auto start = Duration::zero();
+            for (auto dependency : mSystems[id].dependencies)
+            {
+                if (finishTimes[dependency] > start)
+                {
+                    start = finishTimes[dependency];
+                    predecessors[id] = dependency;
+                }
+            }
+            finishTimes[id] = start + mSystems[id].duration;
+            if (finishTimes[id] > finishTimes[last])
+                last = id;
+        }
+        auto path = std::vector<SystemId>();
+        for (auto id = last; id < mSystems.size(); id = predecessors[id])
+            path.push_back(id);
+        std::reverse(std::begin(path), std::end(path));
+        return path;
+    }
+
+    Duration getCriticalPathDuration() const
+    {
+        auto duration = Duration::zero();
+        for (auto id : getCriticalPath())
+            duration += mSystems[id].duration;
+        return duration;
+    }
+
+private:
+    struct System
+    {
+        std::string name;
+        ComponentMask reads;
+        ComponentMask writes;
+        std::function<void()> function;
+        std::vector<SystemId> dependencies;
+        std::vector<SystemId> dependents;
+        std::atomic<std::size_t> nbRemainingDependencies = 0;
+        Duration duration = Duration::zero();
+    };
+
+    EntityManager& mEntityManager;
+    ThreadPool& mPool;
+    std::deque<System> mSystems;
+
+    static bool conflict(const System& lhs, const System& rhs)
+    {
+        return lhs.writes.intersects(rhs.reads) || lhs.writes.intersects(rhs.writes) || lhs.reads.intersects(rhs.writes);
+    }
+
+    void submit(TaskGroup& group, SystemId id)
+    {
+        mPool.submit(group, [this, &group, id]()
+        {
+            auto& system = mSystems[id];
+            auto start = std::chrono::steady_clock::now();
+            system.function();
+            system.duration = std::chrono::steady_clock::now() - start;
+            // Start the systems that were waiting for this one
+            for (auto dependent : system.dependents)
+            {
+                if (mSystems[dependent].nbRemainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    submit(group, dependent);
+            }
+        });
+    }
+};
+
+}
+
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "Config.h"
+#include "PagedVector.h"
+#include "Span.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Arrays are aligned in the stream so that they can be read in place from a memory-mapped file
+constexpr auto SerializationAlignment = std::size_t(16);
+
+// Types whose values can be read from untrusted data because every byte pattern is a valid value: integers other than
+// bool, floating-point numbers, scoped enums and arrays of them
+// A struct made of such types opts in by declaring static constexpr auto Readable = true
+template<typename T, typename = void>
+struct IsReadable : std::bool_constant<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>
+{
+
+};
+
+template<typename T>
+struct IsReadable<T, std::enable_if_t<std::is_enum_v<T>>> :
+    std::bool_constant<!std::is_convertible_v<T, std::underlying_type_t<T>>>
+{
+
+};
+
+template<typename T, std::size_t N>
+struct IsReadable<std::array<T, N>> : IsReadable<T>
+{
+
+};
+
+template<typename T>
+struct IsReadable<T, std::enable_if_t<T::Readable>> : std::true_type
+{
+
+};
+
+// Write trivially copyable values and arrays of them to a stream
+class BinaryWriter
+{
+public:
+    explicit BinaryWriter(std::ostream& stream) : mStream(stream)
+    {
+
+    }
+
+    bool isGood() const
+    {
+        return static_cast<bool>(mStream);
+    }
+
+    template<typename T>
+    void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+        writeBytes(&value, sizeof(T));
+    }
+
+    void writeString(std::string_view string)
+    {
+        write<uint64_t>(string.size());
+        writeBytes(string.data(), string.size());
+    }
+
+    // Write the size of the array, the size of its objects then the objects
+    template<typename T>
+    void writeArray(Span<const T> objects)
+    {
+        writeArrayHeader<T>(objects.size());
+        writeBytes(objects.data(), objects.size() * sizeof(T));
+    }
+
+    template<typename T>
+    void writeArray(const std::pmr::vector<T>& objects)
+    {
+        writeArray(Span<const T>(objects));
+    }
+
+    // Same as writeArray for std::pmr::vector<T> or PagedVector<T>
+    template<typename Storage>
+    void writeStorage(const Storage& objects)
+    {
+        using T = typename Storage::value_type;
+        if constexpr (IsPagedVector<Storage>::value)
+        {
+            writeArrayHeader<T>(objects.size());
+            for (auto i = std::size_t(0); i < objects.size(); i += objects.getContiguousSize(i))
+                writeBytes(&objects[i], objects.getContiguousSize(i) * sizeof(T));
+        }
+        else
+            writeArray(Span<const T>(objects));
+    }
+
+private:
+    std::ostream& mStream;
+    std::size_t mPosition = 0;
+
+    void writeBytes(const void* data, std::size_t size)
+    {
+        mStream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        mPosition += size;
+    }
+
+    template<typename T>
+    void writeArrayHeader(std::size_t size)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+        static_assert(alignof(T) <= SerializationAlignment, "T is overaligned");
+        write<uint64_t>(size);
+        write<uint64_t>(sizeof(T));
+        static constexpr char Padding[SerializationAlignment] = {};
+        writeBytes(Padding, (SerializationAlignment - mPosition % SerializationAlignment) % SerializationAlignment);
+    }
+};
+
+// Read the values written by BinaryWriter from memory, arrays are read in place so the data must be aligned on
+// SerializationAlignment
+// All the methods return false if the data is truncated, misaligned or does not match the expected types
+// Only readable types are read, other types such as bool are written as integers and checked after they are read
+class BinaryReader
+{
+public:
+    explicit BinaryReader(Span<const std::byte> data) : mData(data)
+    {
+
+    }
+
+    template<typename T>
+    bool read(T& value)
+    {
+        static_assert(IsReadable<T>::value, "T must be readable");
+        return readObject(value);
+    }
+
+    // Same as read for objects of any trivially copyable type, their bytes are copied as is so every byte pattern must
+    // be a valid object, it is used for the components
+    template<typename T>
+    bool readObject(T& object)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+        if (mPosition + sizeof(T) > mData.size())
+            return false;
+        std::memcpy(&object, mData.data() + mPosition, sizeof(T));
+        mPosition += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string_view& string)
+    {
+        auto size = uint64_t(0);
+        if (!read(size) || size > mData.size() - mPosition)
+            return false;
+        string = std::string_view(reinterpret_cast<const char*>(mData.data() + mPosition), size);
+        mPosition += size;
+        return true;
+    }
+
+    // The objects stay in the memory of the reader
+    template<typename T>
+    bool readArray(Span<const T>& objects)
+    {
+        static_assert(IsReadable<T>::value, "T must be readable");
+        return readObjects(objects);
+    }
+
+    template<typename T>
+    bool readArray(std::pmr::vector<T>& objects)
+    {
+        auto span = Span<const T>();
+        if (!readArray(span))
+            return false;
+        objects.assign(span.begin(), span.end());
+        return true;
+    }
+
+    // Copy the objects in a std::pmr::vector<T> or a PagedVector<T>, as readObject they can be of any trivially
+    // copyable type
+    template<typename Storage>
+    bool readStorage(Storage& storage)
+    {
+        auto objects = Span<const typename Storage::value_type>();
+        if (!readObjects(objects))
+            return false;
+        if constexpr (IsPagedVector<Storage>::value)
+        {
+            storage.clear();
+            storage.reserve(objects.size());
+            for (const auto& object : objects)
+                storage.emplace_back(object);
+        }
+        else
+            storage.assign(objects.begin(), objects.end());
+        return true;
+    }
+
+private:
+    Span<const std::byte> mData;
+    std::size_t mPosition = 0;
+
+    template<typename T>
+    bool readObjects(Span<const T>& objects)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+        auto size = uint64_t(0);
+        auto objectSize = uint64_t(0);
+        if (!read(size) || !read(objectSize) || objectSize != sizeof(T))
+            return false;
+        mPosition += (SerializationAlignment - mPosition % SerializationAlignment) % SerializationAlignment;
+        if (mPosition > mData.size() || size > (mData.size() - mPosition) / sizeof(T) ||
+            reinterpret_cast<std::uintptr_t>(mData.data()) % SerializationAlignment != 0)
+        {
+            return false;
+        }
+        objects = Span<const T>(reinterpret_cast<const T*>(mData.data() + mPosition), size);
+        mPosition += size * sizeof(T);
+        return true;
+    }
+};
+
+}
+
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "Config.h"
+#include "EntityManager.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Write snapshots of an entity manager without blocking the thread that updates it
+// Two ways to capture the entity manager are available:
+// - Copy, the default and the only one available everywhere: the entity manager is copied into a second one owned by
+// the writer with restoreFrom, then a background thread saves the copy. The pause of the caller is a bulk copy of the
+// arrays, so it grows linearly with the size of the world, but the copy reuses the memory of the previous capture so it
+// does not allocate once the world stops growing, and the frames that follow are not slowed down. All component types
+// must be copyable
+// - Fork, a fallback on POSIX systems for worlds too large to be copied within a frame: the process is forked and the
+// child process writes the snapshot from its copy-on-write view of the memory. The pause of the caller is the time to
+// fork, which grows with the memory mapped by the process as its page tables are duplicated, and while the child
+// process runs the first write to each page is a copy-on-write fault taken by the thread that writes, so the frames
+// that follow a capture are slowed down in proportion to the memory they modify. Only the calling thread exists in the
+// child process, the locks held by the other threads at the time of the fork, such as the workers of a thread pool,
+// stay locked forever there. The file and the stream are thus created before forking and the child process only reads
+// memory and calls write, fsync, close, rename and _exit: it never allocates memory nor takes a lock
+// A background thread writes the copy or waits for the child process and records the result
+class SnapshotWriter
+{
+public:
+    enum class Capture
+    {
+        Copy,
+#if defined(__unix__) || defined(__APPLE__)
+        Fork
+#endif
+    };
+
+    explicit SnapshotWriter(Capture capture = Capture::Copy) : mCapture(capture)
+    {
+
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    ~SnapshotWriter()
+    {
+        wait();
+    }
+
+    // Start writing a snapshot of manager to path, the snapshot is written to a temporary file renamed to path once
+    // complete, so path always contains a complete snapshot
+    // No other thread must modify manager during the call, manager can be modified as soon as it returns
+    // Return false if the previous snapshot is not written yet, if the temporary file cannot be created, if manager
+    // cannot be copied or if the process cannot be forked
+    bool write(const EntityManager& manager, const std::string& path)
+    {
+        if (mWriter.joinable() && !isDone())
+            return false;
+        wait();
+        mSucceeded = false;
+#if defined(__unix__) || defined(__APPLE__)
+        if (mCapture == Capture::Fork)
+            return fork(manager, path);
+#endif
+        return copy(manager, path);
+    }
+
+    bool isDone() const
+    {
+        return mDone.load(std::memory_order_acquire);
+    }
+
+    // Wait for the snapshot being written and return whether the last snapshot was written successfully
+    bool wait()
+    {
+        if (mWriter.joinable())
+            mWriter.join();
+        return mSucceeded;
+    }
+
+private:
+    Capture mCapture;
+    std::thread mWriter;
+    std::atomic<bool> mDone = true;
+    bool mSucceeded = false;
+    // Second buffer the entity manager is copied into, it is only accessed by the background thread while it writes
+    std::unique_ptr<EntityManager> mCopy;
+
+    bool copy(const EntityManager& manager, const std::string& path)
+    {
+        // The copy does not use the memory resource of manager as it outlives the call
+        if (mCopy == nullptr)
+            mCopy = std::make_unique<EntityManager>();
+        auto temporaryPath = path + ".tmp";
+        auto file = std::ofstream(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        if (!mCopy->restoreFrom(manager))
+        {
+            file.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+        mDone.store(false, std::memory_order_relaxed);
+        mWriter = std::thread([this, file = std::move(file), temporaryPath, path]() mutable
+        {
+            auto succeeded = mCopy->save(file) && static_cast<bool>(file.flush());
+            file.close();
+            mSucceeded = succeeded && !file.fail() && std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+            mDone.store(true, std::memory_order_release);
+        });
+        return true;
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    bool fork(const EntityManager& manager, const std::string& path)
+    {
+        // Everything the child process needs is created before forking
+        auto temporaryPath = path + ".tmp";
+        auto file = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (file < 0)
+            return false;
+        auto buffer = std::make_unique<FileBuffer>(file);
+        auto stream = std::ostream(buffer.get());
+        auto pid = ::fork();
+        if (pid == 0)
+            ::_exit(writeSnapshot(manager, file, *buffer, stream, temporaryPath, path) ? 0 : 1);
+        ::close(file);
+        if (pid < 0)
+        {
+            ::unlink(temporaryPath.c_str());
+            return false;
+        }
+        mDone.store(false, std::memory_order_relaxed);
+        mWriter = std::thread([this, pid]()
+        {
+            auto status = 0;
+            while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+                continue;
+            mSucceeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            mDone.store(true, std::memory_order_release);
+        });
+        return true;
+    }
+
+    // Stream buffer over a file descriptor, it does not allocate so that it can be used after forking
+    class FileBuffer : public std::streambuf
+    {
+    public:
+        explicit FileBuffer(int file) : mFile(file)
+        {
+            setp(mBuffer, mBuffer + BufferSize);
+        }
+
+    protected:
+        int_type overflow(int_type character) override
+        {
+            if (sync() != 0)
+                return traits_type::eof();
+            if (!traits_type::eq_int_type(character, traits_type::eof()))
+            {
+                *pptr() = traits_type::to_char_type(character);
+                pbump(1);
+            }
+            return traits_type::not_eof(character);
+        }
+
+        int sync() override
+        {
+            if (!writeAll(pbase(), static_cast<std::size_t>(pptr() - pbase())))
+                return -1;
+            setp(mBuffer, mBuffer + BufferSize);
+            return 0;
+        }
+
+        // Large arrays are written directly
+        std::streamsize xsputn(const char* data, std::streamsize size) override
+        {
+            if (size < epptr() - pptr())
+                return std::streambuf::xsputn(data, size);
+            if (sync() != 0 || !writeAll(data, static_cast<std::size_t>(size)))
+                return 0;
+            return size;
+        }
+
+    private:
+        static constexpr auto BufferSize = std::size_t(1) << 16;
+
+        int mFile;
+        char mBuffer[BufferSize];
+
+        bool writeAll(const char* data, std::size_t size)
+        {
+            while (size > 0)
+            {
+                auto written = ::write(mFile, data, size);
+                if (written < 0 && errno != EINTR)
+                    return false;
+                data += std::max<ssize_t>(written, 0);
+                size -= static_cast<std::size_t>(std::max<ssize_t>(written, 0));
+            }
+            return true;
+        }
+    };
+
+    // Executed by the child process
+    static bool writeSnapshot(const EntityManager& manager, int file, FileBuffer& buffer, std::ostream& stream,
+        const std::string& temporaryPath, const std::string& path)
+    {
+        auto succeeded = manager.save(stream) && buffer.pubsync() == 0 && ::fsync(file) == 0;
+        succeeded = ::close(file) == 0 && succeeded;
+        return succeeded && std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+#endif
+};
+
+}
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Non-owning view over a contiguous sequence of objects
+template<typename T>
+class Span
+{
+public:
+    Span() = default;
+
+    Span(T* data, std::size_t size) : mData(data), mSize(size)
+    {
+
+    }
+
+    template<typename Container, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Container>, Span<T>>>>
+    Span(Container&& container) : mData(std::data(container)), mSize(std::size(container))
+    {
+
+    }
+
+    T* data() const
+    {
+        return mData;
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    T& operator[](std::size_t i) const
+    {
+        return mData[i];
+    }
+
+    T* begin() const
+    {
+        return mData;
+    }
+
+    T* end() const
+    {
+        return mData + mSize;
+    }
+
+    Span<T> subspan(std::size_t offset, std::size_t size) const
+    {
+        return Span<T>(mData + offset, size);
+    }
+
+private:
+    T* mData = nullptr;
+    std::size_t mSize = 0;
+};
+
+// Non-owning view over objects separated by a constant number of bytes, for instance a field of an array of structs
+template<typename T>
+class StridedSpan
+{
+    using Byte = std::conditional_t<std::is_const_v<T>, const std::byte, std::byte>;
+
+public:
+    StridedSpan() = default;
+
+    StridedSpan(T* data, std::size_t size, std::size_t stride) :
+        mData(reinterpret_cast<Byte*>(data)), mSize(size), mStride(stride)
+    {
+
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+    bool empty() const
+    {
+        return mSize == 0;
+    }
+
+    // Number of bytes between two consecutive objects
+    std::size_t stride() const
+    {
+        return mStride;
+    }
+
+    T& operator[](std::size_t i) const
+    {
+        return *reinterpret_cast<T*>(mData + i * mStride);
+    }
+
+private:
+    Byte* mData = nullptr;
+    std::size_t mSize = 0;
+    std::size_t mStride = 0;
+};
+
+}
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "Config.h"
+#include "IdTraits.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Map from dense ids to indices, the storage is split in pages that are allocated on first use
+// Generational ids are stored next to their index, so a stale id whose index has been reused is not found
+template<typename Id>
+class SparseIndex
+{
+    using Traits = IdTraits<Id>;
+    // Slots of generational ids hold the generation of the id in their high half and the index in their low half
+    using Slot = std::conditional_t<Traits::Generational, uint64_t, std::size_t>;
+
+    static_assert(!Traits::Generational || Traits::MaxCount <= UINT32_MAX, "The indices of generational ids must fit in 32 bits");
+
+    static constexpr auto Undefined = std::numeric_limits<Slot>::max();
+    static constexpr auto IndexBits = 32;
+
+public:
+    static constexpr auto PageSize = std::size_t(4096);
+
+    explicit SparseIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : mPages(resource)
+    {
+
+    }
+
+    SparseIndex(const SparseIndex&) = delete;
+    SparseIndex& operator=(const SparseIndex&) = delete;
+
+    ~SparseIndex()
+    {
+        auto allocator = std::pmr::polymorphic_allocator<Page>(mPages.get_allocator());
+        for (auto page : mPages)
+        {
+            if (page != nullptr)
+                allocator.deallocate(page, 1);
+        }
+    }
+
+    // If Id is generational, the undefined slots never match as no id has the last generation
+    bool has(Id id) const
+    {
+        auto i = Traits::getIndex(id);
+        auto page = i / PageSize;
+        if (page >= mPages.size() || mPages[page] == nullptr)
+            return false;
+        auto slot = (*mPages[page])[i % PageSize];
+        if constexpr (Traits::Generational)
+            return static_cast<uint32_t>(slot >> IndexBits) == Traits::getGeneration(id);
+        else
+            return slot != Undefined;
+    }
+
+    std::size_t get(Id id) const
+    {
+        auto i = Traits::getIndex(id);
+        auto slot = (*mPages[i / PageSize])[i % PageSize];
+        if constexpr (Traits::Generational)
+            return static_cast<std::size_t>(static_cast<uint32_t>(slot));
+        else
+            return slot;
+    }
+
+    void set(Id id, std::size_t index)
+    {
+        auto i = Traits::getIndex(id);
+        if constexpr (Traits::Generational)
+            getOrCreatePage(i / PageSize)[i % PageSize] = (Slot(Traits::getGeneration(id)) << IndexBits) | Slot(index);
+        else
+            getOrCreatePage(i / PageSize)[i % PageSize] = index;
+    }
+
+    void erase(Id id)
+    {
+        auto i = Traits::getIndex(id);
+        (*mPages[i / PageSize])[i % PageSize] = Undefined;
+    }
+
+    // Copy the mapping of other, the pages already allocated are reused
+    void copy(const SparseIndex& other)
+    {
+        for (auto page = std::size_t(0); page < std::max(mPages.size(), other.mPages.size()); ++page)
+        {
+            if (page < other.mPages.size() && other.mPages[page] != nullptr)
+                getOrCreatePage(page) = *other.mPages[page];
+            else if (page < mPages.size() && mPages[page] != nullptr)
+                mPages[page]->fill(Undefined);
+        }
+    }
+
+private:
+    using Page = std::array<Slot, PageSize>;
+
+    std::pmr::vector<Page*> mPages;
+
+    Page& getOrCreatePage(std::size_t page)
+    {
+        if (page >= mPages.size())
+            mPages.resize(page + 1, nullptr);
+        if (mPages[page] == nullptr)
+        {
+            mPages[page] = new (std::pmr::polymorphic_allocator<Page>(mPages.get_allocator()).allocate(1)) Page;
+            mPages[page]->fill(Undefined);
+        }
+        return *mPages[page];
+    }
+};
+
+}
+
+}
@@ -1,19 +1,51 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <memory_resource>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
 #include <vector>
+#include "Config.h"
+#include "IdTraits.h"
+#include "Serialization.h"
+#include "Span.h"
 
 namespace ecs
 {
 
-template<typename Id, typename T>
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Storage is the container of the objects, either std::pmr::vector<T> or PagedVector<T>
+// If Id is generational, the generation of an id is incremented when it is erased so that it is not valid anymore once
+// its index is reused, and the index is retired once it reaches the last generation so that a stale id is never valid
+// again
+template<typename Id, typename T, typename Storage = std::pmr::vector<T>>
 class SparseSet
 {
+    using Traits = IdTraits<Id>;
+
     static constexpr auto Undefined = std::numeric_limits<std::size_t>::max();
+    static constexpr auto UndefinedId = static_cast<Id>(std::numeric_limits<uint64_t>::max());
+    // Batch erasures compact the objects when they erase more than 1 / CompactionRatio of the objects behind the first one
+    static constexpr auto CompactionRatio = std::size_t(8);
 
 public:
+    // All the memory of the set is allocated from resource, T is constructed with the resource if it is allocator-aware
+    explicit SparseSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        mIdToIndex(resource), mIds(resource), mFreeIds(resource), mObjects(resource), mIndexToId(resource)
+    {
+
+    }
+
+    // std::length_error is thrown if all the indices that ids can encode are used or retired
     template<typename ...Args>
     std::pair<Id, T&> emplace(Args&& ...args)
     {
+        if (mFreeIds.empty() && mIdToIndex.size() >= Traits::MaxCount)
+            throw std::length_error("Too many ids, their indices do not fit in the id type");
         // Add object
         std::size_t i = mObjects.size();
         auto& object = mObjects.emplace_back(std::forward<Args>(args)...);
@@ -21,61 +53,147 @@ public:
         Id id;
         if (mFreeIds.empty())
         {
-            id = static_cast<Id>(mIdToIndex.size());
+            id = Traits::create(mIdToIndex.size(), 0);
             mIdToIndex.push_back(i);
+            if constexpr (Traits::Generational)
+                mIds.push_back(id);
         }
         else
         {
             id = mFreeIds.back();
             mFreeIds.pop_back();
-            mIdToIndex[static_cast<std::size_t>(id)] = i;
+            mIdToIndex[Traits::getIndex(id)] = i;
+            if constexpr (Traits::Generational)
+                mIds[Traits::getIndex(id)] = id;
         }
         mIndexToId.push_back(id);
         return std::pair<Id, T&>(id, object);
     }
 
+    // If Id is generational, it is a single comparison that is false for stale ids
     bool has(Id id) const
     {
-        return static_cast<std::size_t>(id) < mIdToIndex.size() &&
-            mIdToIndex[static_cast<std::size_t>(id)] != Undefined;
+        if constexpr (Traits::Generational)
+            return Traits::getIndex(id) < mIds.size() && mIds[Traits::getIndex(id)] == id;
+        else
+            return Traits::getIndex(id) < mIdToIndex.size() && mIdToIndex[Traits::getIndex(id)] != Undefined;
     }
 
     T& get(Id id)
     {
-        return mObjects[mIdToIndex[static_cast<std::size_t>(id)]];
+        return mObjects[mIdToIndex[Traits::getIndex(id)]];
     }
 
     const T& get(Id id) const
     {
-        return mObjects[mIdToIndex[static_cast<std::size_t>(id)]];
+        return mObjects[mIdToIndex[Traits::getIndex(id)]];
     }
 
     void erase(Id id)
     {
         // Get the index of the object to destroy
-        std::size_t i = mIdToIndex[static_cast<std::size_t>(id)];
+        std::size_t i = mIdToIndex[Traits::getIndex(id)];
         // Swap with the last object and update its index
         // Moving std::unordered_map may causes a segfault
         std::swap(mObjects[i], mObjects.back());
         //mObjects[i] = std::move(mObjects.back());
         Id lastObjectId = mIndexToId.back();
-        mIdToIndex[static_cast<std::size_t>(lastObjectId)] = i;
+        mIdToIndex[Traits::getIndex(lastObjectId)] = i;
         mIndexToId[i] = lastObjectId;
         // Erase the last object and its index
         mObjects.pop_back();
         mIndexToId.pop_back();
-        // Assign Undefined to the id
-        mIdToIndex[static_cast<std::size_t>(id)] = Undefined;
-        // Add the deleted Id to the free Ids
-        mFreeIds.push_back(id);
+        // Assign Undefined to the id and add it to the free ids
+        release(id);
+    }
+
+    // Erase several distinct objects at once
+    // If there are many objects to erase, the remaining objects are compacted in a single pass that preserves their order
+    void erase(Span<const Id> ids)
+    {
+        auto first = mObjects.size();
+        for (auto id : ids)
+            first = std::min(first, mIdToIndex[Traits::getIndex(id)]);
+        if (ids.size() * CompactionRatio < mObjects.size() - first)
+        {
+            for (auto id : ids)
+                erase(id);
+            return;
+        }
+        for (auto id : ids)
+            release(id);
+        auto j = first;
+        for (auto i = first; i < mObjects.size(); ++i)
+        {
+            auto id = mIndexToId[i];
+            if (mIdToIndex[Traits::getIndex(id)] != Undefined)
+            {
+                if (i != j)
+                {
+                    mObjects[j] = std::move(mObjects[i]);
+                    mIndexToId[j] = id;
+                    mIdToIndex[Traits::getIndex(id)] = j;
+                }
+                ++j;
+            }
+        }
+        while (mObjects.size() > j)
+            mObjects.pop_back();
+        mIndexToId.resize(j);
+    }
+
+    // Swap the objects at indices i and j, ids are preserved
+    void swap(std::size_t i, std::size_t j)
+    {
+        if (i == j)
+            return;
+        std::swap(mObjects[i], mObjects[j]);
+        std::swap(mIndexToId[i], mIndexToId[j]);
+        mIdToIndex[Traits::getIndex(mIndexToId[i])] = i;
+        mIdToIndex[Traits::getIndex(mIndexToId[j])] = j;
+    }
+
+    // Sort the objects with compare(lhs, rhs), ids are preserved
+    template<typename Compare>
+    void sort(Compare compare)
+    {
+        auto order = std::vector<std::size_t>(mObjects.size());
+        std::iota(std::begin(order), std::end(order), 0);
+        std::sort(std::begin(order), std::end(order), [this, &compare](std::size_t i, std::size_t j)
+        {
+            return compare(std::as_const(mObjects[i]), std::as_const(mObjects[j]));
+        });
+        // Follow the cycles of the permutation, order[i] is the index of the object to move at i
+        for (auto i = std::size_t(0); i < order.size(); ++i)
+        {
+            auto j = i;
+            while (order[j] != i)
+            {
+                auto k = order[j];
+                swap(j, k);
+                order[j] = j;
+                j = k;
+            }
+            order[j] = j;
+        }
+    }
+
+    std::size_t getIndex(Id id) const
+    {
+        return mIdToIndex[Traits::getIndex(id)];
+    }
+
+    Id getId(std::size_t i) const
+    {
+        return mIndexToId[i];
     }
 
-    std::vector<T>& getObjects()
+    Storage& getObjects()
     {
         return mObjects;
     }
 
-    const std::vector<T>& getObjects() const
+    const Storage& getObjects() const
     {
         return mObjects;
     }
@@ -85,19 +203,167 @@ public:
         return mObjects.size();
     }
 
+    // Number of indices used by the ids so far, whether their objects are alive or erased
+    std::size_t getIndexCount() const
+    {
+        return mIdToIndex.size();
+    }
+
+    // Number of objects that can still be emplaced
+    std::size_t getAvailableCount() const
+    {
+        return mFreeIds.size() + (Traits::MaxCount - mIdToIndex.size());
+    }
+
+    // Remove all the ids and the objects, the memory already allocated is kept
+    void clear()
+    {
+        mIdToIndex.clear();
+        mIds.clear();
+        mFreeIds.clear();
+        mObjects.clear();
+        mIndexToId.clear();
+    }
+
+    // Copy the ids and the objects of other, the memory already allocated is reused
+    void copy(const SparseSet& other)
+    {
+        mIdToIndex = other.mIdToIndex;
+        mIds = other.mIds;
+        mFreeIds = other.mFreeIds;
+        mIndexToId = other.mIndexToId;
+        if constexpr (IsPagedVector<Storage>::value)
+            mObjects.assign(other.mObjects);
+        else
+            mObjects = other.mObjects;
+    }
+
+    // Serialization
+    // The objects are copied as raw bytes if they are trivially copyable, otherwise they must have the methods
+    // save(writer) and load(reader, args...)
+
+    void save(BinaryWriter& writer) const
+    {
+        writer.writeArray(mIdToIndex);
+        writer.writeArray(mIds);
+        writer.writeArray(mFreeIds);
+        writer.writeArray(mIndexToId);
+        if constexpr (std::is_trivially_copyable_v<T>)
+            writer.writeStorage(mObjects);
+        else
+        {
+            writer.write<uint64_t>(mObjects.size());
+            for (auto i = std::size_t(0); i < mObjects.size(); ++i)
+                mObjects[i].save(writer);
+        }
+    }
+
+    // The set must be empty, return false if the data is truncated or if the loaded ids are not consistent
+    template<typename ...Args>
+    bool load(BinaryReader& reader, Args&&... args)
+    {
+        if (!reader.readArray(mIdToIndex) || !reader.readArray(mIds) || !reader.readArray(mFreeIds) ||
+            !reader.readArray(mIndexToId))
+        {
+            return false;
+        }
+        if constexpr (std::is_trivially_copyable_v<T>)
+        {
+            if (!reader.readStorage(mObjects))
+                return false;
+        }
+        else
+        {
+            auto size = uint64_t(0);
+            if (!reader.read(size) || size != mIndexToId.size())
+                return false;
+            mObjects.reserve(size);
+            for (auto i = uint64_t(0); i < size; ++i)
+            {
+                if (!mObjects.emplace_back().load(reader, args...))
+                    return false;
+            }
+        }
+        return mObjects.size() == mIndexToId.size() && isConsistent();
+    }
+
     void reserve(std::size_t size)
     {
         mIdToIndex.reserve(size);
+        if constexpr (Traits::Generational)
+            mIds.reserve(size);
         mFreeIds.reserve(size);
         mObjects.reserve(size);
         mIndexToId.reserve(size);
     }
 
   private:
-    std::vector<std::size_t> mIdToIndex;
-    std::vector<Id> mFreeIds;
-    std::vector<T> mObjects;
-    std::vector<Id> mIndexToId;
+    std::pmr::vector<std::size_t> mIdToIndex;
+    std::pmr::vector<Id> mIds; // Live id of each index if Id is generational, UndefinedId if there is none
+    std::pmr::vector<Id> mFreeIds;
+    Storage mObjects;
+    std::pmr::vector<Id> mIndexToId;
+
+    // Each index must be either used by exactly one object or free exactly once, or retired if Id is generational
+    bool isConsistent() const
+    {
+        auto nbIndices = mIndexToId.size() + mFreeIds.size();
+        if (mIdToIndex.size() > Traits::MaxCount || nbIndices > mIdToIndex.size() ||
+            (!Traits::Generational && nbIndices != mIdToIndex.size()) ||
+            mIds.size() != (Traits::Generational ? mIdToIndex.size() : 0))
+        {
+            return false;
+        }
+        auto seen = std::vector<bool>(mIdToIndex.size(), false);
+        for (auto i = std::size_t(0); i < mIndexToId.size(); ++i)
+        {
+            auto index = Traits::getIndex(mIndexToId[i]);
+            if (index >= seen.size() || seen[index] || mIdToIndex[index] != i)
+                return false;
+            if constexpr (Traits::Generational)
+            {
+                if (mIds[index] != mIndexToId[i])
+                    return false;
+            }
+            seen[index] = true;
+        }
+        for (auto id : mFreeIds)
+        {
+            auto index = Traits::getIndex(id);
+            if (index >= seen.size() || seen[index] || mIdToIndex[index] != Undefined)
+                return false;
+            if constexpr (Traits::Generational)
+            {
+                if (mIds[index] != UndefinedId)
+                    return false;
+            }
+            seen[index] = true;
+        }
+        // The other indices are retired
+        for (auto index = std::size_t(0); index < seen.size(); ++index)
+        {
+            if (!seen[index] && (mIdToIndex[index] != Undefined || mIds[index] != UndefinedId))
+                return false;
+        }
+        return true;
+    }
+
+    void release(Id id)
+    {
+        auto index = Traits::getIndex(id);
+        mIdToIndex[index] = Undefined;
+        if constexpr (Traits::Generational)
+        {
+            mIds[index] = UndefinedId;
+            // Retire the index if its next generation is the last one
+            if (Traits::getGeneration(id) + 1 < Traits::GenerationMask)
+                mFreeIds.push_back(Traits::create(index, Traits::getGeneration(id) + 1));
+        }
+        else
+            mFreeIds.push_back(id);
+    }
 };
 
+}
+
 }
\ No newline at end of file
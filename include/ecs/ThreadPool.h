@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Counter of the tasks submitted to a thread pool that are not finished yet, with the first exception they threw
+class TaskGroup
+{
+public:
+    bool isDone() const
+    {
+        return mNbPendingTasks.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class ThreadPool;
+
+    std::atomic<std::size_t> mNbPendingTasks = 0;
+    std::mutex mMutex;
+    std::exception_ptr mException;
+
+    void setException(std::exception_ptr exception)
+    {
+        auto lock = std::lock_guard(mMutex);
+        if (!mException)
+            mException = std::move(exception);
+    }
+};
+
+// Work-stealing thread pool
+// Each thread has its own queue, it pushes and pops tasks at the back of it and steals tasks at the front of the others
+// The thread calling wait executes tasks too, so a pool of n threads spawns n - 1 workers
+class ThreadPool
+{
+    struct Task
+    {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+public:
+    explicit ThreadPool(std::size_t nbThreads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1)) :
+        mQueues(std::max<std::size_t>(nbThreads, 1))
+    {
+        for (auto& queue : mQueues)
+            queue = std::make_unique<Queue>();
+        for (auto i = std::size_t(1); i < mQueues.size(); ++i)
+            mWorkers.emplace_back(&ThreadPool::run, this, i);
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            auto lock = std::lock_guard(mMutex);
+            mStopped = true;
+        }
+        mConditionVariable.notify_all();
+        for (auto& worker : mWorkers)
+            worker.join();
+    }
+
+    // Pool used when no pool is specified
+    static ThreadPool& getDefault()
+    {
+        static auto pool = ThreadPool();
+        return pool;
+    }
+
+    std::size_t getThreadCount() const
+    {
+        return mQueues.size();
+    }
+
+    // Return the index of the calling thread if it is a worker of the pool, in [1, getThreadCount()), 0 otherwise
+    std::size_t getThreadIndex() const
+    {
+        return getQueueIndex();
+    }
+
+    template<typename Callable>
+    void submit(TaskGroup& group, Callable&& callable)
+    {
+        group.mNbPendingTasks.fetch_add(1, std::memory_order_relaxed);
+        auto& queue = *mQueues[getQueueIndex()];
+        {
+            auto lock = std::lock_guard(queue.mutex);
+            queue.tasks.push_back(Task{std::forward<Callable>(callable), &group});
+        }
+        {
+            auto lock = std::lock_guard(mMutex);
+            ++mNbQueuedTasks;
+        }
+        mConditionVariable.notify_one();
+    }
+
+    // Execute tasks until all the tasks of group are done, then rethrow the first exception thrown by one of them
+    // The calling thread sleeps while there is no task to execute
+    void wait(TaskGroup& group)
+    {
+        auto index = getQueueIndex();
+        while (!group.isDone())
+        {
+            if (runTask(index))
+                continue;
+            auto lock = std::unique_lock(mMutex);
+            mConditionVariable.wait(lock, [this, &group]{ return group.isDone() || mNbQueuedTasks > 0; });
+        }
+        if (group.mException)
+            std::rethrow_exception(group.mException);
+    }
+
+private:
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mWorkers;
+    std::mutex mMutex;
+    std::condition_variable mConditionVariable;
+    std::size_t mNbQueuedTasks = 0;
+    bool mStopped = false;
+
+    static inline thread_local const ThreadPool* sPool = nullptr;
+    static inline thread_local std::size_t sThreadIndex = 0;
+
+    std::size_t getQueueIndex() const
+    {
+        return sPool == this ? sThreadIndex : 0;
+    }
+
+    void run(std::size_t index)
+    {
+        sPool = this;
+        sThreadIndex = index;
+        while (true)
+        {
+            if (runTask(index))
+                continue;
+            auto lock = std::unique_lock(mMutex);
+            mConditionVariable.wait(lock, [this]{ return mStopped || mNbQueuedTasks > 0; });
+            if (mStopped)
+                return;
+        }
+    }
+
+    bool runTask(std::size_t index)
+    {
+        auto task = Task();
+        if (!popTask(index, task))
+            return false;
+        // The exceptions are rethrown by wait, the group must not be accessed once its last task is done
+        try
+        {
+            task.function();
+        }
+        catch (...)
+        {
+            task.group->setException(std::current_exception());
+        }
+        if (task.group->mNbPendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            // Wake up the threads waiting for the group
+            auto lock = std::lock_guard(mMutex);
+            mConditionVariable.notify_all();
+        }
+        return true;
+    }
+
+    bool popTask(std::size_t index, Task& task)
+    {
+        // Own queue first
+        {
+            auto& queue = *mQueues[index];
+            auto lock = std::lock_guard(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                onTaskPopped();
+                return true;
+            }
+        }
+        // Then steal from the others
+        for (auto i = std::size_t(1); i < mQueues.size(); ++i)
+        {
+            auto& queue = *mQueues[(index + i) % mQueues.size()];
+            auto lock = std::lock_guard(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                onTaskPopped();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void onTaskPopped()
+    {
+        auto lock = std::lock_guard(mMutex);
+        --mNbQueuedTasks;
+    }
+};
+
+// Split [0, size) in ranges of grainSize indices and call callable(begin, end) for each range in parallel on pool, then
+// wait for all the ranges and rethrow the first exception thrown by one of them
+template<typename Callable>
+void parallelFor(std::size_t size, std::size_t grainSize, ThreadPool& pool, Callable&& callable)
+{
+    auto group = TaskGroup();
+    grainSize = std::max<std::size_t>(grainSize, 1);
+    for (auto begin = std::size_t(0); begin < size; begin += grainSize)
+    {
+        auto end = std::min(begin + grainSize, size);
+        pool.submit(group, [&callable, begin, end]()
+        {
+            callable(begin, end);
+        });
+    }
+    pool.wait(group);
+}
+
+}
+
+}
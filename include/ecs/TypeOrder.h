@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "Config.h"
+
+namespace ecs
+{
+
+inline namespace ECS_ABI_NAMESPACE
+{
+
+// Name of T given by the compiler, its format depends on the compiler and its version
+template<typename T>
+constexpr std::string_view getCompilerTypeName()
+{
+#if defined(__GNUC__)
+    return __PRETTY_FUNCTION__;
+#elif defined(_MSC_VER)
+    return __FUNCSIG__;
+#else
+    static_assert(!std::is_same_v<T, T>, "The compiler does not provide the name of a type");
+    return {};
+#endif
+}
+
+template<typename T, typename = void>
+struct HasTypeName : std::false_type
+{
+
+};
+
+template<typename T>
+struct HasTypeName<T, std::void_t<decltype(std::string_view(T::Name))>> : std::true_type
+{
+
+};
+
+// Name of T known at compile time, it orders types and identifies component types in snapshots
+// T can declare it with a static constexpr member Name, otherwise the name given by the compiler is used and snapshots
+// can only be loaded by programs built with the same compiler
+template<typename T>
+constexpr std::string_view getTypeName()
+{
+    if constexpr (HasTypeName<T>::value)
+        return std::string_view(T::Name);
+    else
+        return getCompilerTypeName<T>();
+}
+
+// Order of the types Ts by name, it does not depend on the order in which Ts are listed
+// Indices[i] is the index in Ts of the i-th type in order and Positions[i] is the position in order of the i-th type of Ts
+template<typename ...Ts>
+struct TypeOrder
+{
+    static constexpr auto Indices = []()
+    {
+        constexpr auto Names = std::array<std::string_view, sizeof...(Ts)>{getTypeName<Ts>()...};
+        auto indices = std::array<std::size_t, sizeof...(Ts)>{};
+        for (auto i = std::size_t(0); i < indices.size(); ++i)
+            indices[i] = i;
+        // Insertion sort, the number of types is small
+        for (auto i = std::size_t(1); i < indices.size(); ++i)
+        {
+            for (auto j = i; j > 0 && Names[indices[j]] < Names[indices[j - 1]]; --j)
+            {
+                auto index = indices[j];
+                indices[j] = indices[j - 1];
+                indices[j - 1] = index;
+            }
+        }
+        return indices;
+    }();
+
+    static constexpr auto Positions = []()
+    {
+        auto positions = std::array<std::size_t, sizeof...(Ts)>{};
+        for (auto i = std::size_t(0); i < positions.size(); ++i)
+            positions[Indices[i]] = i;
+        return positions;
+    }();
+
+    static constexpr auto IsSorted = []()
+    {
+        for (auto i = std::size_t(0); i < Indices.size(); ++i)
+        {
+            if (Indices[i] != i)
+                return false;
+        }
+        return true;
+    }();
+
+private:
+    template<typename T>
+    struct Identity
+    {
+        using Type = T;
+    };
+
+    // Only used in unevaluated contexts
+    template<template<typename...> typename Template, std::size_t ...Is>
+    static Identity<Template<std::tuple_element_t<Indices[Is], std::tuple<Ts...>>...>> sort(std::index_sequence<Is...>);
+
+public:
+    // Template instantiated with Ts in order
+    template<template<typename...> typename Template>
+    using Sorted = typename decltype(sort<Template>(std::index_sequence_for<Ts...>{}))::Type;
+};
+
+}
+
+}
@@ -2,10 +2,14 @@
 
 #include <functional>
 #include "Component.h"
+#include "Config.h"
 
 namespace ecs
 {
 
+inline namespace ECS_ABI_NAMESPACE
+{
+
 class Visitor
 {
 public:
@@ -24,6 +28,11 @@ public:
         };
     }
 
+    bool hasHandler(ComponentType componentType) const
+    {
+        return static_cast<bool>(mHandlers[componentType]);
+    }
+
     void handle(ComponentType componentType, BaseComponent& component) const
     {
         if (mHandlers[componentType])
@@ -34,4 +43,6 @@ private:
     std::vector<std::function<void(BaseComponent&)>> mHandlers;
 };
 
+}
+
 }
\ No newline at end of file
@@ -1,11 +1,20 @@
+#include <cstring>
+#include <sstream>
 #include "gtest/gtest.h"
+#include "ecs/ArchetypeEntityManager.h"
+#include "ecs/CommandBuffer.h"
 #include "ecs/Component.h"
 #include "ecs/EntityManager.h"
+#include "ecs/RollbackBuffer.h"
+#include "ecs/Scheduler.h"
+#include "ecs/SnapshotWriter.h"
 
 using namespace ecs;
 
 struct Position : public Component<Position>
 {
+    static constexpr auto Name = std::string_view("Position");
+
     Position(float X = 0.0, float Y = 0.0) : x(X), y(Y)
     {
 
@@ -17,6 +26,8 @@ struct Position : public Component<Position>
 
 struct Velocity : public Component<Velocity>
 {
+    static constexpr auto Name = std::string_view("Velocity");
+
     Velocity(float X = 0.0, float Y = 0.0) : x(X), y(Y)
     {
 
@@ -36,6 +47,72 @@ struct Mass : public Component<Mass>
     float value;
 };
 
+template<>
+struct ecs::ComponentTraits<Position> : ecs::DefaultComponentTraits
+{
+    using Fields = ecs::Fields<&Position::x, &Position::y>;
+};
+
+template<>
+struct ecs::ComponentTraits<Velocity> : ecs::DefaultComponentTraits
+{
+    using Fields = ecs::Fields<&Velocity::x, &Velocity::y>;
+};
+
+template<>
+struct ecs::ComponentTraits<Mass> : ecs::DefaultComponentTraits
+{
+    static constexpr auto TrackChanges = true;
+};
+
+struct Health : public Component<Health>
+{
+    Health(float Value = 0.0) : value(Value)
+    {
+
+    }
+
+    float value;
+};
+
+template<>
+struct ecs::ComponentTraits<Health> : ecs::DefaultComponentTraits
+{
+    static constexpr auto PagedStorage = true;
+};
+
+struct Handle : public Component<Handle>
+{
+    std::unique_ptr<float> value;
+};
+
+// Share its value to count the living copies
+struct Shared : public Component<Shared>
+{
+    std::shared_ptr<float> value;
+};
+
+// Record whether the component was constructed at an aligned address, copies keep the flag of the original
+struct alignas(32) Aligned : public Component<Aligned>
+{
+    Aligned() : aligned(reinterpret_cast<std::uintptr_t>(this) % alignof(Aligned) == 0)
+    {
+
+    }
+
+    bool aligned;
+};
+
+// Its constructor throws if fail is true
+struct Fragile : public Component<Fragile>
+{
+    explicit Fragile(bool fail)
+    {
+        if (fail)
+            throw std::runtime_error("Construction failed");
+    }
+};
+
 float getX(std::size_t i)
 {
     return static_cast<float>(i);
@@ -61,8 +138,8 @@ float getMass(std::size_t i)
     return 3.0f * static_cast<float>(i);
 }
 
-template<typename ...Ts>
-std::vector<Entity> getEntitiesInEntitySet(const EntitySet<Ts...>& entitySet)
+template<typename EntitySet>
+std::vector<Entity> getEntitiesInEntitySet(const EntitySet& entitySet)
 {
     auto entities = std::vector<Entity>();
     for (auto [entity, components] : entitySet)
@@ -70,6 +147,28 @@ std::vector<Entity> getEntitiesInEntitySet(const EntitySet<Ts...>& entitySet)
     return entities;
 }
 
+// Replace the default memory resource until the guard is destroyed, even if an assertion fails
+class DefaultResourceGuard
+{
+public:
+    explicit DefaultResourceGuard(std::pmr::memory_resource* resource) :
+        mPreviousResource(std::pmr::set_default_resource(resource))
+    {
+
+    }
+
+    DefaultResourceGuard(const DefaultResourceGuard&) = delete;
+    DefaultResourceGuard& operator=(const DefaultResourceGuard&) = delete;
+
+    ~DefaultResourceGuard()
+    {
+        std::pmr::set_default_resource(mPreviousResource);
+    }
+
+private:
+    std::pmr::memory_resource* mPreviousResource;
+};
+
 class EntityManagerTest : public ::testing::TestWithParam<std::tuple<bool, std::size_t>>
 {
 protected:
@@ -728,7 +827,7 @@ TEST_P(EntityManagerTest, EntityRemovedListener)
     ASSERT_EQ(manager.getEntitySet<Mass>().getSize(), counterMass);
 }
 
-TEST_P(EntityManagerTest, Visitor)
+TEST_P(EntityManagerTest, OwningEntitySet)
 {
     auto [reserve, nbEntities] = GetParam();
     if (reserve)
@@ -741,36 +840,2055 @@ TEST_P(EntityManagerTest, Visitor)
             manager.addComponent<Position>(entity, getX(i), getY(i));
         if (i % 4 >= 2)
             manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
-        if (i % 4 >= 3)
-            manager.addComponent<Mass>(entity, getMass(i));
     }
-    // Visit
-    auto counterPosition = std::size_t(0);
-    auto counterVelocity = std::size_t(0);
-    auto counterMass = std::size_t(0);
-    auto visitor = Visitor();
-    visitor.setHandler<Position>([&counterPosition]([[maybe_unused]] const auto& position)
+    auto& entitySet = manager.getOwningEntitySet<Position, Velocity>();
+    ASSERT_TRUE(entitySet.isOwning());
+    // Components must be packed in the order of the entity set
+    auto checkPacked = [this, &entitySet]()
     {
-        ++counterPosition;
+        auto i = std::size_t(0);
+        const Position* firstPosition = nullptr;
+        const Velocity* firstVelocity = nullptr;
+        entitySet.forEach([&](Entity entity, const Position& position, const Velocity& velocity)
+        {
+            if (i == 0)
+            {
+                firstPosition = &position;
+                firstVelocity = &velocity;
+            }
+            ASSERT_EQ(&position, firstPosition + i);
+            ASSERT_EQ(&velocity, firstVelocity + i);
+            ASSERT_EQ(&position, &manager.getComponent<Position>(entity));
+            ASSERT_EQ(&velocity, &manager.getComponent<Velocity>(entity));
+            ++i;
+        });
+        ASSERT_EQ(i, entitySet.getSize());
+    };
+    checkPacked();
+    // Remove some entities and components, and add new ones
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        if (i % 3 == 0)
+            manager.removeEntity(entities[i]);
+        else if (i % 4 >= 2 && i % 5 == 0)
+            manager.removeComponent<Position>(entities[i]);
+        else if (i % 4 == 1)
+            manager.addComponent<Velocity>(entities[i], getVx(i), getVy(i));
+    }
+    checkPacked();
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        if (i % 3 != 0 && i % 4 >= 2 && i % 5 != 0)
+        {
+            const auto& position = manager.getComponent<Position>(entities[i]);
+            ASSERT_EQ(position.x, getX(i));
+            ASSERT_EQ(position.y, getY(i));
+        }
+    }
+}
+
+TEST_P(EntityManagerTest, ParallelForEach)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 0)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+    }
+    auto pool = ThreadPool(4);
+    auto counter = std::atomic<std::size_t>(0);
+    manager.getEntitySet<Position, Velocity>().parallelForEach([&counter]([[maybe_unused]] Entity entity, Position& position, const Velocity& velocity)
+    {
+        position.x += velocity.x;
+        position.y += velocity.y;
+        ++counter;
+    }, 16, pool);
+    ASSERT_EQ(counter, (nbEntities + 1) / 2);
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        const auto& position = manager.getComponent<Position>(entities[i]);
+        if (i % 2 == 0)
+        {
+            ASSERT_EQ(position.x, getX(i) + getVx(i));
+            ASSERT_EQ(position.y, getY(i) + getVy(i));
+        }
+        else
+            ASSERT_EQ(position.x, getX(i));
+    }
+    // Const version with the default pool
+    counter = 0;
+    std::as_const(manager.getEntitySet<Position>()).parallelForEach([&counter]([[maybe_unused]] Entity entity, [[maybe_unused]] const Position& position)
+    {
+        ++counter;
+    }, 64);
+    ASSERT_EQ(counter, nbEntities);
+    // An exception thrown by a task is rethrown once all the tasks are done, and the pool is still usable
+    counter = 0;
+    ASSERT_THROW(manager.getEntitySet<Position>().parallelForEach([&counter](Entity entity, const Position&)
+    {
+        ++counter;
+        if (static_cast<std::size_t>(entity) % 100 == 0)
+            throw std::runtime_error("Task failed");
+    }, 16, pool), std::runtime_error);
+    ASSERT_LE(counter, nbEntities);
+    counter = 0;
+    manager.getEntitySet<Position>().parallelForEach([&counter](Entity, const Position&)
+    {
+        ++counter;
+    }, 16, pool);
+    ASSERT_EQ(counter, nbEntities);
+}
+
+TEST_P(EntityManagerTest, Scheduler)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        manager.addComponent<Mass>(entity, getMass(i));
+    }
+    auto pool = ThreadPool(4);
+    auto scheduler = Scheduler(manager, pool);
+    auto integrate = scheduler.addSystem<EntitySet<Position, Velocity>, Read<>, Write<Position>>("integrate", [](auto& entitySet)
+    {
+        entitySet.forEach([]([[maybe_unused]] Entity entity, Position& position, const Velocity& velocity)
+        {
+            position.x += velocity.x;
+            position.y += velocity.y;
+        });
     });
-    visitor.setHandler<Velocity>([&counterVelocity]([[maybe_unused]] const auto& velocity)
+    auto damp = scheduler.addSystem<EntitySet<Velocity>, Read<>, Write<Velocity>>("damp", [](auto& entitySet)
     {
-        ++counterVelocity;
+        entitySet.forEach([]([[maybe_unused]] Entity entity, Velocity& velocity)
+        {
+            velocity.x *= 0.5f;
+            velocity.y *= 0.5f;
+        });
     });
-    visitor.setHandler<Mass>([&counterMass]([[maybe_unused]] const auto& mass)
+    auto weigh = scheduler.addSystem<EntitySet<Mass>, Read<>, Write<Mass>>("weigh", [](auto& entitySet)
     {
-        ++counterMass;
+        entitySet.forEach([]([[maybe_unused]] Entity entity, Mass& mass)
+        {
+            mass.value *= 2.0f;
+        });
     });
-    for (auto entity : entities)
-        manager.visitEntity(entity, visitor);
-    // Tests
-    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), counterPosition);
-    ASSERT_EQ(manager.getEntitySet<Velocity>().getSize(), counterVelocity);
-    ASSERT_EQ(manager.getEntitySet<Mass>().getSize(), counterMass);
+    ASSERT_TRUE(scheduler.getDependencies(integrate).empty());
+    ASSERT_EQ(scheduler.getDependencies(damp), std::vector<Scheduler::SystemId>{integrate});
+    ASSERT_TRUE(scheduler.getDependencies(weigh).empty());
+    scheduler.run();
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        auto [position, velocity, mass] = manager.getComponents<Position, Velocity, Mass>(entities[i]);
+        ASSERT_EQ(position.x, getX(i) + getVx(i));
+        ASSERT_EQ(position.y, getY(i) + getVy(i));
+        ASSERT_EQ(velocity.x, 0.5f * getVx(i));
+        ASSERT_EQ(mass.value, 2.0f * getMass(i));
+    }
+    auto criticalPath = scheduler.getCriticalPath();
+    ASSERT_FALSE(criticalPath.empty());
+    ASSERT_LE(criticalPath.size(), 2);
+    ASSERT_LE(scheduler.getCriticalPathDuration(), scheduler.getDuration(integrate) + scheduler.getDuration(damp) + scheduler.getDuration(weigh));
+}
+
+TEST_P(EntityManagerTest, CommandBuffer)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+    }
+    // Record from several threads
+    auto pool = ThreadPool(4);
+    auto buffers = CommandBuffers(pool);
+    auto& entitySet = manager.getEntitySet<Position, Velocity>();
+    entitySet.parallelForEach([&buffers](Entity entity, const Position& position, const Velocity& velocity)
+    {
+        auto& buffer = buffers.getLocal();
+        auto i = static_cast<std::size_t>(position.x);
+        if (i % 2 == 0)
+            buffer.addComponent<Mass>(entity, getMass(i));
+        if (i % 3 == 0)
+            buffer.removeComponent<Velocity>(entity);
+        if (i % 5 == 0)
+            buffer.removeEntity(entity);
+        // Spawn a new entity
+        auto child = buffer.createEntity();
+        buffer.addComponent<Position>(child, position.x, position.y);
+        buffer.addComponent<Velocity>(child, velocity.x, velocity.y);
+    }, 16, pool);
+    ASSERT_EQ(entitySet.getSize(), nbEntities);
+    buffers.playback(manager);
+    for (auto i = std::size_t(0); i < buffers.getSize(); ++i)
+        ASSERT_TRUE(buffers[i].isEmpty());
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        auto entity = entities[i];
+        if (i % 5 == 0)
+        {
+            ASSERT_FALSE(manager.hasEntity(entity));
+            continue;
+        }
+        ASSERT_EQ(manager.hasComponent<Mass>(entity), i % 2 == 0);
+        ASSERT_EQ(manager.hasComponent<Velocity>(entity), i % 3 != 0);
+        if (i % 2 == 0)
+        {
+            ASSERT_EQ(manager.getComponent<Mass>(entity).value, getMass(i));
+        }
+    }
+    auto nbRemaining = nbEntities - (nbEntities + 4) / 5;
+    auto nbWithoutVelocity = (nbEntities + 2) / 3 - (nbEntities + 14) / 15;
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), nbRemaining + nbEntities);
+    ASSERT_EQ(entitySet.getSize(), nbRemaining - nbWithoutVelocity + nbEntities);
+    ASSERT_EQ(manager.getEntitySet<Mass>().getSize(), (nbEntities + 1) / 2 - (nbEntities + 9) / 10);
+    // Deferred entities can be removed in the same buffer and unplayed commands are destroyed
+    auto buffer = CommandBuffer();
+    auto entity = buffer.createEntity();
+    buffer.addComponent<Mass>(entity, 1.0f);
+    buffer.removeEntity(entity);
+    buffer.playback(manager);
+    ASSERT_EQ(buffer.getCreatedEntities().size(), 1);
+    ASSERT_FALSE(manager.hasEntity(buffer.getCreatedEntities()[0]));
+    buffer.addComponent<Mass>(buffer.createEntity(), 2.0f);
+    buffer.clear();
+    ASSERT_TRUE(buffer.isEmpty());
+    // Overaligned components are constructed at aligned addresses in the arena
+    for (auto i = std::size_t(0); i < 4; ++i)
+    {
+        auto alignedEntity = buffer.createEntity();
+        buffer.addComponent<Mass>(alignedEntity, 1.0f);
+        buffer.addComponent<Aligned>(alignedEntity);
+    }
+    buffer.playback(manager);
+    for (auto createdEntity : buffer.getCreatedEntities())
+        ASSERT_TRUE(manager.getComponent<Aligned>(createdEntity).aligned);
+}
+
+TEST_P(EntityManagerTest, CommandBuffersThreads)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto pool = ThreadPool(4);
+    auto buffers = CommandBuffers(pool);
+    auto record = [&buffers](std::size_t n)
+    {
+        auto& buffer = buffers.getLocal();
+        for (auto i = std::size_t(0); i < n; ++i)
+            buffer.addComponent<Position>(buffer.createEntity(), getX(i), getY(i));
+    };
+    auto group = TaskGroup();
+    for (auto i = std::size_t(0); i < 8; ++i)
+        pool.submit(group, [&record, n = nbEntities]{ record(n); });
+    // The calling thread and another thread record while the workers record
+    auto thread = std::thread(record, nbEntities);
+    record(nbEntities);
+    pool.wait(group);
+    thread.join();
+    ASSERT_GE(buffers.getSize(), 2);
+    buffers.playback(manager);
+    for (auto i = std::size_t(0); i < buffers.getSize(); ++i)
+        ASSERT_TRUE(buffers[i].isEmpty());
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), 10 * nbEntities);
+}
+
+TEST_P(EntityManagerTest, CommandBufferRemoveThenAddComponent)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+    }
+    auto& owningEntitySet = manager.getOwningEntitySet<Position, Velocity>();
+    auto& entitySet = manager.getEntitySet<Position>();
+    // Replace the position of one entity out of two in the same playback
+    auto buffer = CommandBuffer();
+    for (auto i = std::size_t(0); i < nbEntities; i += 2)
+    {
+        buffer.removeComponent<Position>(entities[i]);
+        buffer.addComponent<Position>(entities[i], -getX(i), -getY(i));
+    }
+    buffer.playback(manager);
+    ASSERT_EQ(owningEntitySet.getSize(), nbEntities);
+    ASSERT_EQ(entitySet.getSize(), nbEntities);
+    auto expectedX = [](std::size_t i)
+    {
+        return i % 2 == 0 ? -getX(i) : getX(i);
+    };
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+        ASSERT_EQ(manager.getComponent<Position>(entities[i]).x, expectedX(i));
+    // The sets refer to the new components and the owning set keeps them packed
+    const Position* firstPosition = nullptr;
+    auto j = std::size_t(0);
+    owningEntitySet.forEach([&](Entity entity, const Position& position, [[maybe_unused]] const Velocity& velocity)
+    {
+        if (j == 0)
+            firstPosition = &position;
+        ASSERT_EQ(&position, firstPosition + j);
+        ASSERT_EQ(&position, &manager.getComponent<Position>(entity));
+        ++j;
+    });
+    ASSERT_EQ(j, nbEntities);
+    entitySet.forEach([&](Entity entity, const Position& position)
+    {
+        ASSERT_EQ(&position, &manager.getComponent<Position>(entity));
+    });
+}
+
+TEST_P(EntityManagerTest, CommandBufferRemoveSameEntity)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+    }
+    // Two buffers remove the same entities, and one of them also removes an entity that is already removed
+    auto stale = manager.createEntity();
+    manager.removeEntity(stale);
+    auto buffers = std::vector<CommandBuffer>(2);
+    for (auto& buffer : buffers)
+    {
+        for (auto i = std::size_t(0); i < nbEntities; i += 2)
+            buffer.removeEntity(entities[i]);
+    }
+    buffers[1].removeEntity(stale);
+    CommandBuffer::playback(Span<CommandBuffer>(buffers), manager);
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+        ASSERT_EQ(manager.hasEntity(entities[i]), i % 2 != 0);
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), nbEntities / 2);
+    // Move assignment destroys the components recorded in the assigned buffer
+    auto value = std::make_shared<float>(1.0f);
+    {
+        auto buffer = CommandBuffer();
+        buffer.addComponent<Shared>(buffer.createEntity(), Shared{{}, value});
+        ASSERT_EQ(value.use_count(), 2);
+        buffer = CommandBuffer();
+        ASSERT_EQ(value.use_count(), 1);
+        ASSERT_TRUE(buffer.isEmpty());
+        buffer.addComponent<Shared>(buffer.createEntity(), Shared{{}, value});
+        auto other = CommandBuffer();
+        other = std::move(buffer);
+        ASSERT_EQ(value.use_count(), 2);
+    }
+    ASSERT_EQ(value.use_count(), 1);
+}
+
+TEST_P(EntityManagerTest, CommandBufferConflicts)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 0)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+    }
+    auto stale = manager.createEntity();
+    manager.removeEntity(stale);
+    auto value = std::make_shared<float>(1.0f);
+    auto buffers = std::vector<CommandBuffer>(2);
+    for (auto& buffer : buffers)
+    {
+        for (auto i = std::size_t(0); i < nbEntities; ++i)
+        {
+            // Both buffers remove the same components, including absent ones, and add the same components
+            buffer.removeComponent<Velocity>(entities[i]);
+            buffer.addComponent<Shared>(entities[i], Shared{{}, value});
+        }
+        // Commands on dead entities are skipped
+        buffer.addComponent<Shared>(stale, Shared{{}, value});
+        buffer.removeComponent<Position>(stale);
+    }
+    // The entities removed by the first buffer are removed after the component commands of all the buffers
+    buffers[0].removeEntity(entities[0]);
+    buffers[1].addComponent<Mass>(entities[0], 1.0f);
+    CommandBuffer::playback(Span<CommandBuffer>(buffers), manager);
+    ASSERT_FALSE(manager.hasEntity(entities[0]));
+    for (auto i = std::size_t(1); i < nbEntities; ++i)
+    {
+        ASSERT_FALSE(manager.hasComponent<Velocity>(entities[i]));
+        ASSERT_TRUE(manager.hasComponent<Shared>(entities[i]));
+        ASSERT_EQ(manager.getComponent<Position>(entities[i]).x, getX(i));
+    }
+    ASSERT_EQ(manager.getEntitySet<Velocity>().getSize(), 0);
+    ASSERT_EQ(manager.getEntitySet<Shared>().getSize(), nbEntities - 1);
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), nbEntities - 1);
+    // One component per entity, the skipped ones are destroyed
+    ASSERT_EQ(static_cast<std::size_t>(value.use_count()), nbEntities);
+}
+
+TEST_P(EntityManagerTest, CreateEntities)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto counter = std::size_t(0);
+    manager.getEntitySet<Position, Velocity>().addEntityAddedListener([&counter]([[maybe_unused]] auto entity)
+    {
+        ++counter;
+    });
+    auto entities = manager.createEntities<Position, Velocity>(nbEntities,
+        [](std::size_t i){ return Position(getX(i), getY(i)); },
+        Velocity(1.0f, 2.0f));
+    ASSERT_EQ(entities.size(), nbEntities);
+    ASSERT_EQ(counter, nbEntities);
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        auto [position, velocity] = manager.getComponents<Position, Velocity>(entities[i]);
+        ASSERT_EQ(position.x, getX(i));
+        ASSERT_EQ(position.y, getY(i));
+        ASSERT_EQ(velocity.x, 1.0f);
+        ASSERT_EQ(velocity.y, 2.0f);
+        ASSERT_FALSE(manager.hasComponent<Mass>(entities[i]));
+    }
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), nbEntities);
+    ASSERT_EQ(manager.getEntitySet<Velocity>().getSize(), nbEntities);
+    auto entitySetSize = manager.getEntitySet<Position, Velocity, Mass>().getSize();
+    ASSERT_EQ(entitySetSize, 0);
+    // Default-constructed components
+    auto otherEntities = manager.createEntities<Mass>(nbEntities);
+    ASSERT_EQ(manager.getComponent<Mass>(otherEntities.back()).value, 0.0f);
+    ASSERT_EQ(manager.getEntitySet<Mass>().getSize(), nbEntities);
+    // Entity indices have 32 bits, creating more entities fails before any of them is created
+    ASSERT_THROW(manager.createEntities<Mass>(IdTraits<Entity>::MaxCount - 2 * nbEntities + 1), std::length_error);
+    ASSERT_EQ(manager.getEntitySet<Mass>().getSize(), nbEntities);
+}
+
+TEST_P(EntityManagerTest, RemoveEntitiesAndComponents)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto& owningEntitySet = manager.getOwningEntitySet<Position, Velocity>();
+    auto counter = std::size_t(0);
+    manager.getEntitySet<Position>().addEntityRemovedListener([&counter]([[maybe_unused]] auto entity)
+    {
+        ++counter;
+    });
+    auto entities = manager.createEntities<Position, Velocity>(nbEntities,
+        [](std::size_t i){ return Position(getX(i), getY(i)); },
+        [](std::size_t i){ return Velocity(getVx(i), getVy(i)); });
+    // Remove the velocity of one entity out of four
+    auto entitiesWithoutVelocity = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; i += 4)
+        entitiesWithoutVelocity.push_back(entities[i]);
+    manager.removeComponents<Velocity>(entitiesWithoutVelocity);
+    ASSERT_EQ(owningEntitySet.getSize(), nbEntities - entitiesWithoutVelocity.size());
+    ASSERT_EQ(manager.getEntitySet<Velocity>().getSize(), nbEntities - entitiesWithoutVelocity.size());
+    // Remove one entity out of two
+    auto removedEntities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; i += 2)
+        removedEntities.push_back(entities[i]);
+    manager.removeEntities(removedEntities);
+    ASSERT_EQ(counter, removedEntities.size());
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), nbEntities - removedEntities.size());
+    ASSERT_EQ(owningEntitySet.getSize(), nbEntities - removedEntities.size());
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            ASSERT_FALSE(manager.hasEntity(entities[i]));
+        }
+        else
+        {
+            auto [position, velocity] = manager.getComponents<Position, Velocity>(entities[i]);
+            ASSERT_EQ(position.x, getX(i));
+            ASSERT_EQ(position.y, getY(i));
+            ASSERT_EQ(velocity.x, getVx(i));
+            ASSERT_EQ(velocity.y, getVy(i));
+        }
+    }
+    owningEntitySet.forEach([this](Entity entity, Position& position, Velocity& velocity)
+    {
+        ASSERT_EQ(&position, &manager.getComponent<Position>(entity));
+        ASSERT_EQ(&velocity, &manager.getComponent<Velocity>(entity));
+    });
+    auto remainingEntities = getEntitiesInEntitySet(manager.getEntitySet<Position>());
+    std::sort(std::begin(remainingEntities), std::end(remainingEntities));
+    for (auto i = std::size_t(0); i < remainingEntities.size(); ++i)
+        ASSERT_EQ(remainingEntities[i], entities[2 * i + 1]);
+}
+
+TEST_P(EntityManagerTest, Columns)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto& entitySet = manager.getOwningEntitySet<Position, Velocity>();
+    auto entities = manager.createEntities<Position, Velocity>(nbEntities,
+        [](std::size_t i){ return Position(getX(i), getY(i)); },
+        [](std::size_t i){ return Velocity(getVx(i), getVy(i)); });
+    // Remove some entities so that the set is not in creation order
+    auto removedEntities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; i += 3)
+        removedEntities.push_back(entities[i]);
+    manager.removeEntities(removedEntities);
+    auto positions = entitySet.getComponents<Position>();
+    auto xs = entitySet.getColumn<&Position::x>();
+    auto ys = entitySet.getColumn<&Position::y>();
+    auto scalars = std::as_const(entitySet).getScalars<Velocity>();
+    ASSERT_EQ(positions.size(), entitySet.getSize());
+    ASSERT_EQ(xs.size(), entitySet.getSize());
+    ASSERT_EQ(scalars.size(), 2 * entitySet.getSize());
+    auto i = std::size_t(0);
+    entitySet.forEach([&](Entity entity, Position& position, Velocity& velocity)
+    {
+        ASSERT_EQ(&positions[i], &manager.getComponent<Position>(entity));
+        ASSERT_EQ(&xs[i], &position.x);
+        ASSERT_EQ(&ys[i], &position.y);
+        ASSERT_EQ(scalars[2 * i], velocity.x);
+        ASSERT_EQ(scalars[2 * i + 1], velocity.y);
+        ++i;
+    });
+    // Write through a column
+    for (auto j = std::size_t(0); j < xs.size(); ++j)
+        xs[j] = -1.0f;
+    for (auto entity : getEntitiesInEntitySet(entitySet))
+        ASSERT_EQ(manager.getComponent<Position>(entity).x, -1.0f);
+    // Non-owning sets have no columns
+    auto& nonOwningEntitySet = manager.getEntitySet<Position>();
+    ASSERT_THROW(nonOwningEntitySet.getComponents<Position>(), std::logic_error);
+    ASSERT_THROW(std::as_const(nonOwningEntitySet).getColumn<&Position::x>(), std::logic_error);
+}
+
+TEST_P(EntityManagerTest, ForEachChunk)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = manager.createEntities<Position, Velocity>(nbEntities,
+        [](std::size_t i){ return Position(getX(i), getY(i)); },
+        [](std::size_t i){ return Velocity(getVx(i), getVy(i)); });
+    auto update = [](Span<const Entity> chunkEntities, Span<Position> positions, Span<Velocity> velocities)
+    {
+        ASSERT_EQ(positions.size(), chunkEntities.size());
+        ASSERT_EQ(velocities.size(), chunkEntities.size());
+        for (auto i = std::size_t(0); i < positions.size(); ++i)
+        {
+            positions[i].x += velocities[i].x;
+            positions[i].y += velocities[i].y;
+        }
+    };
+    auto check = [this, &entities](std::size_t nbUpdates)
+    {
+        auto nbVisitedEntities = std::size_t(0);
+        std::as_const(manager).getEntitySet<Position, Velocity>().forEachChunk([&](Span<const Entity> chunkEntities,
+            Span<const Position> positions, [[maybe_unused]] Span<const Velocity> velocities)
+        {
+            for (auto i = std::size_t(0); i < chunkEntities.size(); ++i)
+                ASSERT_EQ(manager.getComponent<Position>(chunkEntities[i]).x, positions[i].x);
+            nbVisitedEntities += chunkEntities.size();
+        });
+        ASSERT_EQ(nbVisitedEntities, entities.size());
+        for (auto i = std::size_t(0); i < entities.size(); ++i)
+        {
+            const auto& position = manager.getComponent<Position>(entities[i]);
+            ASSERT_EQ(position.x, getX(i) + static_cast<float>(nbUpdates) * getVx(i));
+            ASSERT_EQ(position.y, getY(i) + static_cast<float>(nbUpdates) * getVy(i));
+        }
+    };
+    // Gathered components
+    manager.getEntitySet<Position, Velocity>().forEachChunk(update);
+    check(1);
+    // Contiguous components
+    manager.getOwningEntitySet<Position, Velocity>().forEachChunk(update);
+    check(2);
+}
+
+TEST_P(EntityManagerTest, MemoryResource)
+{
+    auto [reserve, nbEntities] = GetParam();
+    auto resource = std::pmr::monotonic_buffer_resource(std::pmr::new_delete_resource());
+    // Any allocation from the default resource fails, the allocations with new are not checked
+    auto guard = DefaultResourceGuard(std::pmr::null_memory_resource());
+    {
+        auto world = EntityManager(&resource);
+        ASSERT_EQ(world.getResource(), &resource);
+        if (reserve)
+            world.reserve(nbEntities);
+        auto& entitySet = world.getEntitySet<Position, Velocity>();
+        auto listenerId = entitySet.addEntityRemovedListener([]([[maybe_unused]] auto entity){});
+        auto entities = world.createEntities<Position, Velocity>(nbEntities,
+            [](std::size_t i){ return Position(getX(i), getY(i)); },
+            Velocity());
+        for (auto i = std::size_t(0); i < nbEntities; i += 2)
+            world.addComponent<Mass>(entities[i], getMass(i));
+        world.removeComponents<Velocity>(Span<const Entity>(entities.data(), entities.size() / 2));
+        world.removeEntity(entities.back());
+        ASSERT_EQ(entitySet.getSize(), nbEntities - nbEntities / 2 - 1);
+        ASSERT_EQ(world.getEntitySet<Mass>().getSize(), nbEntities / 2);
+        for (auto i = std::size_t(0); i + 1 < nbEntities; ++i)
+            ASSERT_EQ(world.getComponent<Position>(entities[i]).x, getX(i));
+        entitySet.removeEntityRemovedListener(listenerId);
+    }
+}
+
+TEST_P(EntityManagerTest, PagedStorage)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = manager.createEntities<Position>(nbEntities,
+        [](std::size_t i){ return Position(getX(i), getY(i)); });
+    // Adding components never moves the previous ones
+    auto addresses = std::vector<Health*>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+        addresses.push_back(&manager.addComponent<Health>(entities[i], getMass(i)));
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+        ASSERT_EQ(&manager.getComponent<Health>(entities[i]), addresses[i]);
+    // Removal keeps the storage packed
+    auto removedEntities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; i += 3)
+        removedEntities.push_back(entities[i]);
+    manager.removeComponents<Health>(removedEntities);
+    if (manager.hasComponent<Health>(entities.back()))
+        manager.removeComponent<Health>(entities.back());
+    for (auto i = std::size_t(0); i + 1 < nbEntities; ++i)
+    {
+        if (i % 3 == 0)
+        {
+            ASSERT_FALSE(manager.hasComponent<Health>(entities[i]));
+        }
+        else
+        {
+            ASSERT_EQ(manager.getComponent<Health>(entities[i]).value, getMass(i));
+        }
+    }
+    // Owning entity sets iterate over pages
+    auto& entitySet = manager.getOwningEntitySet<Position, Health>();
+    auto nbVisitedEntities = std::size_t(0);
+    entitySet.forEach([&](Entity entity, Position& position, Health& health)
+    {
+        ASSERT_EQ(&position, &manager.getComponent<Position>(entity));
+        ASSERT_EQ(&health, &manager.getComponent<Health>(entity));
+        ++nbVisitedEntities;
+    });
+    ASSERT_EQ(nbVisitedEntities, entitySet.getSize());
+    nbVisitedEntities = 0;
+    entitySet.forEachChunk([&](Span<const Entity> chunkEntities, Span<Position> positions, Span<Health> healths)
+    {
+        for (auto i = std::size_t(0); i < chunkEntities.size(); ++i)
+        {
+            ASSERT_EQ(&positions[i], &manager.getComponent<Position>(chunkEntities[i]));
+            ASSERT_EQ(&healths[i], &manager.getComponent<Health>(chunkEntities[i]));
+        }
+        nbVisitedEntities += chunkEntities.size();
+    });
+    ASSERT_EQ(nbVisitedEntities, entitySet.getSize());
+}
+
+TEST_P(EntityManagerTest, ChangeTracking)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto getChangedEntities = [this](auto filter, Tick tick)
+    {
+        auto entities = std::vector<Entity>();
+        std::as_const(manager.getEntitySet<Position, Mass>()).forEach<decltype(filter)>(tick,
+            [&entities](Entity entity, [[maybe_unused]] const Position& position, [[maybe_unused]] const Mass& mass)
+            {
+                entities.push_back(entity);
+            });
+        return entities;
+    };
+    auto start = manager.getTick();
+    auto entities = manager.createEntities<Position, Mass>(nbEntities);
+    ASSERT_EQ(getChangedEntities(Added<Mass>(), start - 1).size(), nbEntities);
+    ASSERT_EQ(getChangedEntities(Changed<Mass>(), start - 1).size(), nbEntities);
+    ASSERT_TRUE(getChangedEntities(Added<Mass>(), start).empty());
+    // Modify one entity out of ten
+    auto tick = manager.nextTick();
+    auto modifiedEntities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; i += 10)
+    {
+        manager.getComponent<Mass>(entities[i]).value = getMass(i);
+        modifiedEntities.push_back(entities[i]);
+    }
+    auto changedEntities = getChangedEntities(Changed<Mass>(), start);
+    ASSERT_EQ(changedEntities, modifiedEntities);
+    ASSERT_TRUE(getChangedEntities(Added<Mass>(), start).empty());
+    ASSERT_TRUE(getChangedEntities(Changed<Mass>(), tick).empty());
+    // Read-only accesses do not modify components
+    tick = manager.nextTick();
+    std::as_const(manager.getEntitySet<Mass>()).forEach([]([[maybe_unused]] Entity entity, [[maybe_unused]] const Mass& mass){});
+    ASSERT_TRUE(getChangedEntities(Changed<Mass>(), tick - 1).empty());
+    // Mutable accesses do
+    for ([[maybe_unused]] auto [entity, components] : manager.getEntitySet<Mass>())
+        ;
+    ASSERT_EQ(getChangedEntities(Changed<Mass>(), tick - 1).size(), nbEntities);
+    // Removed components are forgotten, added ones are recorded
+    tick = manager.nextTick();
+    manager.getComponent<Mass>(entities.front());
+    manager.removeEntity(entities.front());
+    auto entity = manager.createEntity();
+    manager.addComponent<Position>(entity);
+    manager.addComponent<Mass>(entity);
+    auto addedEntities = getChangedEntities(Added<Mass>(), tick - 1);
+    ASSERT_EQ(addedEntities, std::vector<Entity>{entity});
+    ASSERT_EQ(getChangedEntities(Changed<Mass>(), tick - 1), addedEntities);
+    // The log is compacted
+    for (auto i = std::size_t(0); i < 4096; ++i)
+    {
+        tick = manager.nextTick();
+        manager.getComponent<Mass>(entity).value = getMass(i);
+    }
+    ASSERT_EQ(getChangedEntities(Changed<Mass>(), tick - 1), addedEntities);
+    ASSERT_EQ(getChangedEntities(Changed<Mass>(), start).size(), nbEntities);
+}
+
+TEST_P(EntityManagerTest, ChangeTrackingAccess)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    manager.createEntities<Position, Mass>(nbEntities);
+    auto getNbChangedEntities = [this](Tick tick)
+    {
+        auto nbChangedEntities = std::size_t(0);
+        std::as_const(manager.getEntitySet<Mass>()).forEach<Changed<Mass>>(tick, [&](Entity, const Mass&)
+        {
+            ++nbChangedEntities;
+        });
+        return nbChangedEntities;
+    };
+    auto check = [&](auto access, bool modified)
+    {
+        auto tick = manager.nextTick();
+        access();
+        ASSERT_EQ(getNbChangedEntities(tick - 1), modified ? nbEntities : 0);
+    };
+    auto& entitySet = manager.getEntitySet<Position, Mass>();
+    auto& permutedEntitySet = manager.getEntitySet<Mass, Position>();
+    auto& filteredEntitySet = manager.getEntitySet<With<Position>, Without<>, Optional<Mass>>();
+    // Only the components passed by mutable reference, pointer or span are modified
+    check([&]{ entitySet.forEach([](Entity, Position&, const Mass&){}); }, false);
+    check([&]{ entitySet.forEach([](Entity, const Position&, Mass&){}); }, true);
+    check([&]{ entitySet.forEach([](Entity, Position, Mass){}); }, false);
+    check([&]{ permutedEntitySet.forEach([](Entity, const Mass&, Position&){}); }, false);
+    check([&]{ permutedEntitySet.forEach([](Entity, Mass&, const Position&){}); }, true);
+    check([&]{ filteredEntitySet.forEach([](Entity, Position&, const Mass*){}); }, false);
+    check([&]{ filteredEntitySet.forEach([](Entity, const Position&, Mass*){}); }, true);
+    check([&]{ entitySet.forEachChunk([](Span<const Entity>, Span<Position>, Span<const Mass>){}); }, false);
+    check([&]{ entitySet.forEachChunk([](Span<const Entity>, Span<const Position>, Span<Mass>){}); }, true);
+    check([&]{ entitySet.parallelForEach([](Entity, Position&, const Mass&){}, 16); }, false);
+    check([&]{ entitySet.parallelForEach([](Entity, const Position&, Mass&){}, 16); }, true);
+    // The signature of generic lambdas is unknown
+    check([&]{ entitySet.forEach([](Entity, auto&, auto&){}); }, true);
+    // Systems do not modify the components they only read
+    auto scheduler = Scheduler(manager);
+    scheduler.addSystem<EntitySet<Position, Mass>, Read<>, Write<Position>>("move", [](auto& systemEntitySet)
+    {
+        systemEntitySet.forEach([](Entity, auto& position, auto&)
+        {
+            position.x += 1.0f;
+        });
+    });
+    check([&]{ scheduler.run(); }, false);
+}
+
+TEST_P(EntityManagerTest, BatchListeners)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto& entitySet = manager.getEntitySet<Position, Velocity>();
+    auto nbAddedCalls = std::size_t(0);
+    auto nbRemovedCalls = std::size_t(0);
+    auto addedEntities = std::vector<Entity>();
+    auto removedEntities = std::vector<Entity>();
+    auto addedListenerId = entitySet.addEntitiesAddedListener([&](Span<const Entity> entities)
+    {
+        ++nbAddedCalls;
+        addedEntities.insert(std::end(addedEntities), std::begin(entities), std::end(entities));
+    });
+    auto removedListenerId = entitySet.addEntitiesRemovedListener([&](Span<const Entity> entities)
+    {
+        ++nbRemovedCalls;
+        removedEntities.insert(std::end(removedEntities), std::begin(entities), std::end(entities));
+    });
+    auto entities = std::vector<Entity>();
+    auto expectedEntities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 0)
+        {
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+            expectedEntities.push_back(entity);
+        }
+    }
+    // Nothing is notified before notifyListeners
+    ASSERT_EQ(nbAddedCalls, 0);
+    manager.notifyListeners();
+    ASSERT_EQ(nbAddedCalls, nbEntities > 0 ? 1 : 0);
+    ASSERT_EQ(nbRemovedCalls, 0);
+    ASSERT_EQ(addedEntities, expectedEntities);
+    // Nothing to notify
+    manager.notifyListeners();
+    ASSERT_EQ(nbAddedCalls, nbEntities > 0 ? 1 : 0);
+    // Removals are batched and entities added then removed are not notified
+    addedEntities.clear();
+    auto expectedRemovedEntities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; i += 4)
+    {
+        manager.removeComponent<Velocity>(entities[i]);
+        expectedRemovedEntities.push_back(entities[i]);
+    }
+    for (auto i = std::size_t(1); i < nbEntities; i += 2)
+    {
+        manager.addComponent<Velocity>(entities[i], getVx(i), getVy(i));
+        manager.removeEntity(entities[i]);
+    }
+    manager.notifyListeners();
+    ASSERT_EQ(nbRemovedCalls, nbEntities > 0 ? 1 : 0);
+    ASSERT_EQ(removedEntities, expectedRemovedEntities);
+    ASSERT_TRUE(addedEntities.empty());
+    // Without batch listeners, nothing is buffered
+    entitySet.removeEntitiesAddedListener(addedListenerId);
+    entitySet.removeEntitiesRemovedListener(removedListenerId);
+    auto entity = manager.createEntity();
+    manager.addComponent<Position>(entity);
+    manager.addComponent<Velocity>(entity);
+    manager.notifyListeners();
+    ASSERT_TRUE(addedEntities.empty());
+}
+
+TEST_P(EntityManagerTest, LazyEntitySet)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        if (i % 4 >= 1)
+            manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 4 >= 2)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 4 >= 3)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    // The entity set is created by the first non-const access and filled with the existing entities
+    ASSERT_THROW((std::as_const(manager).getEntitySet<Velocity, Mass>()), std::logic_error);
+    const auto& entitySet = std::as_const(manager.getEntitySet<Velocity, Mass>());
+    auto expectedEntities = std::vector<Entity>();
+    for (auto i = std::size_t(3); i < nbEntities; i += 4)
+        expectedEntities.push_back(entities[i]);
+    auto entitiesInEntitySet = getEntitiesInEntitySet(entitySet);
+    std::sort(std::begin(entitiesInEntitySet), std::end(entitiesInEntitySet));
+    ASSERT_EQ(entitiesInEntitySet, expectedEntities);
+    entitySet.forEach([](Entity entity, const Velocity& velocity, const Mass& mass)
+    {
+        auto i = static_cast<std::size_t>(entity);
+        ASSERT_EQ(velocity.x, getVx(i));
+        ASSERT_EQ(mass.value, getMass(i));
+    });
+    // Then it is maintained
+    for (auto i = std::size_t(2); i < nbEntities; i += 4)
+    {
+        manager.addComponent<Mass>(entities[i], getMass(i));
+        expectedEntities.push_back(entities[i]);
+    }
+    for (auto i = std::size_t(3); i < nbEntities; i += 8)
+    {
+        manager.removeEntity(entities[i]);
+        expectedEntities.erase(std::find(std::begin(expectedEntities), std::end(expectedEntities), entities[i]));
+    }
+    std::sort(std::begin(expectedEntities), std::end(expectedEntities));
+    entitiesInEntitySet = getEntitiesInEntitySet(entitySet);
+    std::sort(std::begin(entitiesInEntitySet), std::end(entitiesInEntitySet));
+    ASSERT_EQ(entitiesInEntitySet, expectedEntities);
+}
+
+TEST_P(EntityManagerTest, FilteredEntitySet)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        if (i % 4 >= 1)
+            manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 1)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 3 == 0)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    // Entities with a position, without a velocity and maybe with a mass
+    auto& entitySet = manager.getEntitySet<With<Position>, Without<Velocity>, Optional<Mass>>();
+    auto check = [&]()
+    {
+        auto expectedSize = std::size_t(0);
+        for (auto entity : entities)
+        {
+            if (manager.hasEntity(entity) && manager.hasComponent<Position>(entity) && !manager.hasComponent<Velocity>(entity))
+                ++expectedSize;
+        }
+        ASSERT_EQ(entitySet.getSize(), expectedSize);
+        std::as_const(entitySet).forEach([&](Entity entity, const Position& position, const Mass* mass)
+        {
+            auto i = static_cast<std::size_t>(entity);
+            ASSERT_TRUE(!manager.hasComponent<Velocity>(entity));
+            ASSERT_EQ(position.x, getX(i));
+            ASSERT_EQ(mass != nullptr, manager.hasComponent<Mass>(entity));
+            if (mass != nullptr)
+            {
+                ASSERT_EQ(mass, &std::as_const(manager).getComponent<Mass>(entity));
+            }
+        });
+    };
+    check();
+    // Adding an excluded component removes the entity, adding or removing an optional component keeps it
+    for (auto i = std::size_t(0); i < nbEntities; i += 4)
+    {
+        if (!manager.hasComponent<Position>(entities[i]))
+            manager.addComponent<Position>(entities[i], getX(i), getY(i));
+        else if (!manager.hasComponent<Velocity>(entities[i]))
+            manager.addComponent<Velocity>(entities[i], getVx(i), getVy(i));
+    }
+    check();
+    for (auto i = std::size_t(0); i < nbEntities; i += 2)
+    {
+        if (manager.hasComponent<Mass>(entities[i]))
+            manager.removeComponent<Mass>(entities[i]);
+        else
+            manager.addComponent<Mass>(entities[i], getMass(i));
+    }
+    check();
+    for (auto i = std::size_t(1); i < nbEntities; i += 4)
+        manager.removeComponent<Velocity>(entities[i]);
+    manager.removeEntities(Span<const Entity>(entities.data(), nbEntities / 2));
+    check();
+    // Mutable iterations give mutable optional components
+    entitySet.forEach([](Entity entity, Position& position, Mass* mass)
+    {
+        position.x = 0.0f;
+        if (mass != nullptr)
+            mass->value = getMass(static_cast<std::size_t>(entity)) + 1.0f;
+    });
+    entitySet.forEach([](Entity entity, const Position& position, const Mass* mass)
+    {
+        ASSERT_EQ(position.x, 0.0f);
+        if (mass != nullptr)
+        {
+            ASSERT_EQ(mass->value, getMass(static_cast<std::size_t>(entity)) + 1.0f);
+        }
+    });
+    // Iterators give the same entities and components as forEach
+    auto iteratedEntities = std::vector<Entity>();
+    for (auto [entity, components] : std::as_const(entitySet))
+    {
+        auto [position, mass] = components;
+        ASSERT_EQ(position.x, 0.0f);
+        ASSERT_EQ(mass, manager.hasComponent<Mass>(entity) ? &std::as_const(manager).getComponent<Mass>(entity) : nullptr);
+        iteratedEntities.push_back(entity);
+    }
+    auto expectedEntities = std::vector<Entity>();
+    std::as_const(entitySet).forEach([&expectedEntities](Entity entity, [[maybe_unused]] const Position& position,
+        [[maybe_unused]] const Mass* mass)
+    {
+        expectedEntities.push_back(entity);
+    });
+    ASSERT_EQ(iteratedEntities, expectedEntities);
+    // Parallel iterations visit each entity once
+    auto pool = ThreadPool(4);
+    auto counter = std::atomic<std::size_t>(0);
+    entitySet.parallelForEach([&counter](Entity entity, Position& position, Mass* mass)
+    {
+        position.x = getX(static_cast<std::size_t>(entity));
+        if (mass != nullptr)
+            mass->value = getMass(static_cast<std::size_t>(entity));
+        ++counter;
+    }, 16, pool);
+    ASSERT_EQ(counter, entitySet.getSize());
+    check();
+    // Only the optional components the callable may modify and the entity has are marked as modified
+    auto getChangedMasses = [this](Tick tick)
+    {
+        auto nbChangedMasses = std::size_t(0);
+        std::as_const(manager.getEntitySet<Mass>()).forEach<Changed<Mass>>(tick,
+            [&nbChangedMasses]([[maybe_unused]] Entity entity, [[maybe_unused]] const Mass& mass)
+            {
+                ++nbChangedMasses;
+            });
+        return nbChangedMasses;
+    };
+    auto nbMasses = std::size_t(0);
+    std::as_const(entitySet).forEach([&nbMasses]([[maybe_unused]] Entity entity,
+        [[maybe_unused]] const Position& position, const Mass* mass)
+    {
+        nbMasses += mass != nullptr ? 1 : 0;
+    });
+    auto tick = manager.nextTick();
+    entitySet.forEach([]([[maybe_unused]] Entity entity, [[maybe_unused]] Position& position,
+        [[maybe_unused]] const Mass* mass){});
+    std::as_const(entitySet).parallelForEach([]([[maybe_unused]] Entity entity,
+        [[maybe_unused]] const Position& position, [[maybe_unused]] const Mass* mass){}, 16, pool);
+    ASSERT_EQ(getChangedMasses(tick - 1), 0);
+    entitySet.parallelForEach([]([[maybe_unused]] Entity entity, [[maybe_unused]] const Position& position,
+        [[maybe_unused]] Mass* mass){}, 16, pool);
+    ASSERT_EQ(getChangedMasses(tick - 1), nbMasses);
+    tick = manager.nextTick();
+    for ([[maybe_unused]] auto [entity, components] : entitySet)
+        ;
+    ASSERT_EQ(getChangedMasses(tick - 1), nbMasses);
+}
+
+TEST_P(EntityManagerTest, CanonicalEntitySet)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto& entitySet = manager.getEntitySet<Position, Velocity, Mass>();
+    auto& permutedEntitySet = manager.getEntitySet<Mass, Velocity, Position>();
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 2 == 0)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    // Permutations share the same entities
+    ASSERT_EQ(entitySet.getSize(), permutedEntitySet.getSize());
+    ASSERT_EQ(getEntitiesInEntitySet(entitySet), getEntitiesInEntitySet(permutedEntitySet));
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+        ASSERT_EQ(permutedEntitySet.hasEntity(entities[i]), i % 2 == 0);
+    // Each permutation keeps its own order of components
+    permutedEntitySet.forEach([](Entity entity, Mass& mass, const Velocity& velocity, const Position& position)
+    {
+        auto i = static_cast<std::size_t>(entity);
+        ASSERT_EQ(mass.value, getMass(i));
+        ASSERT_EQ(velocity.x, getVx(i));
+        ASSERT_EQ(position.x, getX(i));
+        mass.value += 1.0f;
+    });
+    for (auto [entity, components] : permutedEntitySet)
+    {
+        auto i = static_cast<std::size_t>(entity);
+        ASSERT_EQ(std::get<0>(components).value, getMass(i) + 1.0f);
+        ASSERT_EQ(std::get<2>(components).y, getY(i));
+    }
+    // Owning through a permutation makes all of them owning
+    manager.getOwningEntitySet<Velocity, Mass, Position>();
+    ASSERT_TRUE(entitySet.isOwning());
+    auto masses = permutedEntitySet.getComponents<Mass>();
+    ASSERT_EQ(masses.size(), entitySet.getSize());
+    entitySet.forEach([&masses, j = std::size_t(0)](Entity entity, const Position&, const Velocity&, const Mass& mass) mutable
+    {
+        ASSERT_EQ(mass.value, getMass(static_cast<std::size_t>(entity)) + 1.0f);
+        ASSERT_EQ(&masses[j++], &mass);
+    });
+}
+
+TEST_P(EntityManagerTest, Sort)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto& entitySet = manager.getEntitySet<Position, Velocity>();
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+    }
+    // Scatter the entities
+    for (auto i = std::size_t(0); i < nbEntities; i += 3)
+        manager.removeComponent<Position>(entities[i]);
+    for (auto i = std::size_t(0); i < nbEntities; i += 3)
+        manager.addComponent<Position>(entities[i], getX(i), getY(i));
+    auto expectedSize = entitySet.getSize();
+    // Sort in the storage order of the positions
+    entitySet.sort<Position>();
+    ASSERT_EQ(entitySet.getSize(), expectedSize);
+    const Position* previous = nullptr;
+    entitySet.forEach([&previous](Entity entity, const Position& position, const Velocity& velocity)
+    {
+        auto i = static_cast<std::size_t>(entity);
+        ASSERT_EQ(position.x, getX(i));
+        ASSERT_EQ(velocity.x, getVx(i));
+        ASSERT_TRUE(previous == nullptr || previous < &position);
+        previous = &position;
+    });
+    // Sort the positions then follow their order
+    manager.sortComponents<Position>([](const Position& lhs, const Position& rhs)
+    {
+        return lhs.x > rhs.x;
+    });
+    entitySet.sort<Position>();
+    auto sortedEntities = getEntitiesInEntitySet(entitySet);
+    ASSERT_TRUE(std::is_sorted(std::rbegin(sortedEntities), std::rend(sortedEntities)));
+    // Sort incrementally
+    auto nbCalls = std::size_t(0);
+    while (!entitySet.sortIncrementally(std::less<Entity>(), 16))
+        ++nbCalls;
+    ASSERT_TRUE(nbCalls <= nbEntities * nbEntities / 16);
+    sortedEntities = getEntitiesInEntitySet(entitySet);
+    ASSERT_TRUE(std::is_sorted(std::begin(sortedEntities), std::end(sortedEntities)));
+    for (auto entity : sortedEntities)
+        ASSERT_EQ(manager.getComponent<Velocity>(entity).x, getVx(static_cast<std::size_t>(entity)));
+    // Sort the velocities in the order of the set
+    manager.sortComponents<Velocity>(entitySet);
+    const Velocity* previousVelocity = nullptr;
+    entitySet.forEach([&previousVelocity](Entity entity, const Position&, const Velocity& velocity)
+    {
+        ASSERT_EQ(velocity.x, getVx(static_cast<std::size_t>(entity)));
+        ASSERT_TRUE(previousVelocity == nullptr || previousVelocity < &velocity);
+        previousVelocity = &velocity;
+    });
+    // Owning sets move their components with the entities
+    manager.getOwningEntitySet<Position, Velocity>();
+    ASSERT_THROW(manager.sortComponents<Velocity>(entitySet), std::logic_error);
+    auto compareX = [](const Position& lhs, const Position& rhs){ return lhs.x < rhs.x; };
+    ASSERT_THROW(manager.sortComponents<Position>(compareX), std::logic_error);
+    entitySet.sort(std::greater<Entity>());
+    sortedEntities = getEntitiesInEntitySet(entitySet);
+    ASSERT_TRUE(std::is_sorted(std::rbegin(sortedEntities), std::rend(sortedEntities)));
+    auto positions = entitySet.getComponents<Position>();
+    for (auto i = std::size_t(0); i < sortedEntities.size(); ++i)
+        ASSERT_EQ(positions[i].x, getX(static_cast<std::size_t>(sortedEntities[i])));
+}
+
+TEST_P(EntityManagerTest, StaleEntity)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+        entities.push_back(manager.createEntity());
+    for (auto entity : entities)
+        manager.removeEntity(entity);
+    // The new entities reuse the indices of the removed ones with another generation
+    auto newEntities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = newEntities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+    }
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        ASSERT_FALSE(manager.hasEntity(entities[i]));
+        ASSERT_TRUE(manager.hasEntity(newEntities[i]));
+        ASSERT_NE(entities[i], newEntities[nbEntities - 1 - i]);
+        ASSERT_EQ(IdTraits<Entity>::getIndex(entities[i]), IdTraits<Entity>::getIndex(newEntities[nbEntities - 1 - i]));
+    }
+    auto& entitySet = manager.getEntitySet<Position>();
+    ASSERT_EQ(entitySet.getSize(), nbEntities);
+    for (auto entity : newEntities)
+        ASSERT_TRUE(entitySet.hasEntity(entity));
+    // Entity sets tell stale entities apart from the entities that reuse their indices
+    for (auto entity : entities)
+        ASSERT_FALSE(entitySet.hasEntity(entity));
+    // Churn one index, it keeps being reused and the stale entity never matches again
+    auto stale = manager.createEntity();
+    auto index = IdTraits<Entity>::getIndex(stale);
+    manager.removeEntity(stale);
+    for (auto i = std::size_t(0); i < 10000; ++i)
+    {
+        auto entity = manager.createEntity();
+        ASSERT_EQ(IdTraits<Entity>::getIndex(entity), index);
+        ASSERT_NE(entity, stale);
+        ASSERT_FALSE(manager.hasEntity(stale));
+        manager.removeEntity(entity);
+    }
+    // Snapshots keep the generations
+    auto path = ::testing::TempDir() + "generations.bin";
+    ASSERT_TRUE(manager.save(path));
+    auto loadedManager = EntityManager();
+    ASSERT_TRUE(loadedManager.load(path));
+    auto entity = loadedManager.createEntity();
+    ASSERT_EQ(IdTraits<Entity>::getIndex(entity), index);
+    ASSERT_EQ(IdTraits<Entity>::getGeneration(entity), IdTraits<Entity>::getGeneration(stale) + 10001);
+}
+
+TEST_P(EntityManagerTest, ManyEntities)
+{
+    auto [reserve, nbEntities] = GetParam();
+    // More live entities than 20 bits of index can address
+    auto count = (std::size_t(1) << 20) + nbEntities;
+    if (reserve)
+        manager.reserve(count);
+    auto entities = manager.createEntities<Position>(count, [](std::size_t i){ return Position(getX(i), getY(i)); });
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), count);
+    ASSERT_EQ(IdTraits<Entity>::getIndex(entities.back()), count - 1);
+    for (auto i = std::size_t(0); i < count; i += 4096)
+    {
+        ASSERT_TRUE(manager.hasEntity(entities[i]));
+        ASSERT_EQ(manager.getComponent<Position>(entities[i]).x, getX(i));
+    }
+    ASSERT_TRUE(manager.getEntitySet<Position>().hasEntity(entities.back()));
+}
+
+TEST_P(EntityManagerTest, Snapshot)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 0)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 3 == 0)
+            manager.addComponent<Mass>(entity, getMass(i));
+        if (i % 5 == 0)
+            manager.addComponent<Health>(entity, getMass(i));
+    }
+    auto& owningEntitySet = manager.getOwningEntitySet<Position, Velocity>();
+    auto& filteredEntitySet = manager.getEntitySet<With<Position>, Without<Velocity>, Optional<Mass>>();
+    for (auto i = std::size_t(0); i < nbEntities; i += 4)
+        manager.removeEntity(entities[i]);
+    manager.nextTick();
+    // Save then load into another manager
+    auto path = ::testing::TempDir() + "snapshot.bin";
+    ASSERT_TRUE(manager.save(path));
+    auto loadedManager = EntityManager();
+    ASSERT_TRUE(loadedManager.load(path));
+    ASSERT_FALSE(loadedManager.load(path));
+    ASSERT_EQ(loadedManager.getTick(), manager.getTick());
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities[i];
+        ASSERT_EQ(loadedManager.hasEntity(entity), manager.hasEntity(entity));
+        if (!manager.hasEntity(entity))
+            continue;
+        ASSERT_EQ(loadedManager.getComponent<Position>(entity).x, getX(i));
+        ASSERT_EQ(loadedManager.hasComponent<Velocity>(entity), i % 2 == 0);
+        if (i % 2 == 0)
+        {
+            ASSERT_EQ(loadedManager.getComponent<Velocity>(entity).x, getVx(i));
+        }
+        ASSERT_EQ(loadedManager.hasComponent<Mass>(entity), i % 3 == 0);
+        if (i % 3 == 0)
+        {
+            ASSERT_EQ(loadedManager.getComponent<Mass>(entity).value, getMass(i));
+        }
+        ASSERT_EQ(loadedManager.hasComponent<Health>(entity), i % 5 == 0);
+        if (i % 5 == 0)
+        {
+            ASSERT_EQ(loadedManager.getComponent<Health>(entity).value, getMass(i));
+        }
+    }
+    // Component types that declare their name are identified by it, as are the entity sets of these types
+    ASSERT_EQ(BaseComponent::getComponentDescriptor(Position::Type).name, "Position");
+    ASSERT_EQ(BaseEntitySet::getEntitySetDescriptor(EntitySet<Position, Velocity>::Type).name,
+        "EntitySet<Position, Velocity>");
+    // Entity sets keep their entities and their order
+    auto& loadedOwningEntitySet = loadedManager.getEntitySet<Position, Velocity>();
+    ASSERT_TRUE(loadedOwningEntitySet.isOwning());
+    ASSERT_EQ(getEntitiesInEntitySet(loadedOwningEntitySet), getEntitiesInEntitySet(owningEntitySet));
+    auto positions = loadedOwningEntitySet.getComponents<Position>();
+    auto i = std::size_t(0);
+    loadedOwningEntitySet.forEach([&](Entity entity, const Position& position, const Velocity&)
+    {
+        ASSERT_EQ(&positions[i++], &position);
+        ASSERT_EQ(position.x, getX(static_cast<std::size_t>(entity)));
+    });
+    auto& loadedFilteredEntitySet = loadedManager.getEntitySet<With<Position>, Without<Velocity>, Optional<Mass>>();
+    ASSERT_EQ(loadedFilteredEntitySet.getSize(), filteredEntitySet.getSize());
+    loadedFilteredEntitySet.forEach([&](Entity entity, const Position&, const Mass* mass)
+    {
+        ASSERT_TRUE(filteredEntitySet.hasEntity(entity));
+        ASSERT_EQ(mass != nullptr, manager.hasComponent<Mass>(entity));
+    });
+    // Loaded entity sets are maintained and views are recreated
+    auto nbOwnedEntities = loadedManager.getEntitySet<Velocity, Position>().getSize();
+    ASSERT_EQ(nbOwnedEntities, owningEntitySet.getSize());
+    for (auto j = std::size_t(1); j < nbEntities; j += 4)
+    {
+        manager.removeEntity(entities[j]);
+        loadedManager.removeEntity(entities[j]);
+    }
+    ASSERT_EQ(getEntitiesInEntitySet(loadedOwningEntitySet), getEntitiesInEntitySet(owningEntitySet));
+    ASSERT_EQ(loadedFilteredEntitySet.getSize(), filteredEntitySet.getSize());
+    // Both managers reuse the same indices and generations
+    for (auto j = std::size_t(0); j < nbEntities / 4; ++j)
+    {
+        auto entity = manager.createEntity();
+        ASSERT_FALSE(loadedManager.hasEntity(entity));
+        ASSERT_EQ(loadedManager.createEntity(), entity);
+    }
+    // Invalid snapshots are rejected
+    auto data = std::vector<std::byte>(16);
+    ASSERT_FALSE(EntityManager().load(Span<const std::byte>(data)));
+}
+
+TEST_P(EntityManagerTest, CorruptedSnapshot)
+{
+    auto [reserve, nbEntities] = GetParam();
+    nbEntities = std::min(nbEntities, std::size_t(8));
+    if (reserve)
+        manager.reserve(nbEntities);
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = manager.createEntity();
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 0)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 3 == 0)
+            manager.addComponent<Mass>(entity, getMass(i));
+        if (i % 4 == 0)
+            manager.removeEntity(entity);
+    }
+    manager.getOwningEntitySet<Position, Velocity>();
+    manager.getEntitySet<With<Position>, Without<Velocity>, Optional<Mass>>();
+    auto stream = std::stringstream();
+    ASSERT_TRUE(manager.save(stream));
+    auto snapshot = stream.str();
+    auto data = std::vector<std::byte>(snapshot.size());
+    std::memcpy(data.data(), snapshot.data(), snapshot.size());
+    // Each corrupted snapshot is either rejected or consistent enough to remove all its entities
+    for (auto i = std::size_t(0); i < data.size(); ++i)
+    {
+        data[i] ^= std::byte(0x81);
+        auto loadedManager = EntityManager();
+        if (loadedManager.load(Span<const std::byte>(data)))
+        {
+            auto entities = getEntitiesInEntitySet(loadedManager.getEntitySet<Position>());
+            for (auto entity : entities)
+                loadedManager.removeEntity(entity);
+            ASSERT_EQ((loadedManager.getEntitySet<Position, Velocity>().getSize()), 0);
+        }
+        data[i] ^= std::byte(0x81);
+    }
+    ASSERT_TRUE(EntityManager().load(Span<const std::byte>(data)));
+    // Misaligned data is rejected
+    data.insert(data.begin(), std::byte(0));
+    ASSERT_FALSE(EntityManager().load(Span<const std::byte>(data.data() + 1, data.size() - 1)));
+}
+
+TEST_P(EntityManagerTest, SnapshotWriter)
+{
+    auto [reserve, nbEntities] = GetParam();
+    auto captures = std::vector<SnapshotWriter::Capture>{SnapshotWriter::Capture::Copy};
+#if defined(__unix__) || defined(__APPLE__)
+    captures.push_back(SnapshotWriter::Capture::Fork);
+#endif
+    for (auto capture : captures)
+    {
+        auto writtenManager = EntityManager();
+        if (reserve)
+            writtenManager.reserve(nbEntities);
+        auto entities = std::vector<Entity>();
+        for (auto i = std::size_t(0); i < nbEntities; ++i)
+        {
+            auto entity = entities.emplace_back(writtenManager.createEntity());
+            writtenManager.addComponent<Position>(entity, getX(i), getY(i));
+            if (i % 2 == 0)
+                writtenManager.addComponent<Health>(entity, getMass(i));
+        }
+        auto path = ::testing::TempDir() + "background_snapshot.bin";
+        auto writer = SnapshotWriter(capture);
+        ASSERT_TRUE(writer.write(writtenManager, path));
+        // The snapshot is not affected by the modifications made while it is written
+        for (auto i = std::size_t(0); i < nbEntities; ++i)
+        {
+            writtenManager.getComponent<Position>(entities[i]).x = 0.0f;
+            if (i % 2 == 0)
+                writtenManager.removeComponent<Health>(entities[i]);
+        }
+        writtenManager.removeEntity(entities.back());
+        ASSERT_TRUE(writer.wait());
+        ASSERT_TRUE(writer.isDone());
+        auto loadedManager = EntityManager();
+        ASSERT_TRUE(loadedManager.load(path));
+        for (auto i = std::size_t(0); i < nbEntities; ++i)
+        {
+            ASSERT_TRUE(loadedManager.hasEntity(entities[i]));
+            ASSERT_EQ(loadedManager.getComponent<Position>(entities[i]).x, getX(i));
+            ASSERT_EQ(loadedManager.hasComponent<Health>(entities[i]), i % 2 == 0);
+        }
+        // A new snapshot replaces the previous one
+        ASSERT_TRUE(writer.write(writtenManager, path));
+        ASSERT_TRUE(writer.wait());
+        auto reloadedManager = EntityManager();
+        ASSERT_TRUE(reloadedManager.load(path));
+        ASSERT_FALSE(reloadedManager.hasEntity(entities.back()));
+        if (nbEntities > 1)
+        {
+            ASSERT_FALSE(reloadedManager.hasComponent<Health>(entities.front()));
+            ASSERT_EQ(reloadedManager.getComponent<Position>(entities.front()).x, 0.0f);
+        }
+        // Failures are reported
+        ASSERT_FALSE(writer.write(writtenManager, ::testing::TempDir() + "missing/snapshot.bin"));
+        ASSERT_FALSE(writer.wait());
+        writtenManager.addComponent<Handle>(writtenManager.createEntity());
+        // Components that are not copyable cannot be captured by a copy and are not serializable
+        if (capture == SnapshotWriter::Capture::Copy)
+            ASSERT_FALSE(writer.write(writtenManager, path));
+        else
+        {
+            ASSERT_TRUE(writer.write(writtenManager, path));
+            ASSERT_FALSE(writer.wait());
+        }
+        auto lastManager = EntityManager();
+        ASSERT_TRUE(lastManager.load(path));
+        ASSERT_FALSE(lastManager.hasEntity(entities.back()));
+    }
+}
+
+TEST_P(EntityManagerTest, Delta)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 0)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    manager.getEntitySet<Position, Mass>();
+    // The replica starts from a snapshot of the baseline
+    manager.recordDeltas();
+    auto path = ::testing::TempDir() + "delta_baseline.bin";
+    ASSERT_TRUE(manager.save(path));
+    auto replica = EntityManager();
+    ASSERT_TRUE(replica.load(path));
+    auto& replicaEntitySet = replica.getEntitySet<Position, Mass>();
+    auto checkReplica = [&]()
+    {
+        for (auto i = std::size_t(0); i < entities.size(); ++i)
+        {
+            auto entity = entities[i];
+            ASSERT_EQ(replica.hasEntity(entity), manager.hasEntity(entity));
+            if (!manager.hasEntity(entity))
+                continue;
+            ASSERT_EQ(replica.hasComponent<Position>(entity), manager.hasComponent<Position>(entity));
+            if (manager.hasComponent<Position>(entity))
+            {
+                ASSERT_EQ(replica.getComponent<Position>(entity).x, manager.getComponent<Position>(entity).x);
+            }
+            ASSERT_EQ(replica.hasComponent<Velocity>(entity), manager.hasComponent<Velocity>(entity));
+            if (manager.hasComponent<Velocity>(entity))
+            {
+                ASSERT_EQ(replica.getComponent<Velocity>(entity).y, manager.getComponent<Velocity>(entity).y);
+            }
+            ASSERT_EQ(replica.hasComponent<Mass>(entity), manager.hasComponent<Mass>(entity));
+            if (manager.hasComponent<Mass>(entity))
+            {
+                ASSERT_EQ(replica.getComponent<Mass>(entity).value, manager.getComponent<Mass>(entity).value);
+            }
+        }
+        auto expectedSize = manager.getEntitySet<Position, Mass>().getSize();
+        ASSERT_EQ(replicaEntitySet.getSize(), expectedSize);
+    };
+    auto applyDelta = [&]()
+    {
+        auto stream = std::stringstream();
+        ASSERT_TRUE(manager.saveDelta(stream));
+        auto delta = stream.str();
+        auto data = std::vector<std::max_align_t>(delta.size() / sizeof(std::max_align_t) + 1);
+        std::memcpy(data.data(), delta.data(), delta.size());
+        auto bytes = Span<const std::byte>(reinterpret_cast<const std::byte*>(data.data()), delta.size());
+        ASSERT_TRUE(replica.applyDelta(bytes));
+        // A delta only applies to its baseline
+        ASSERT_FALSE(replica.applyDelta(bytes));
+        ASSERT_EQ(replica.getTick(), manager.getTick());
+    };
+    // Structural changes and modifications of components that track changes
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        if (i % 7 == 0)
+            manager.removeEntity(entities[i]);
+        else if (i % 5 == 0)
+            manager.addComponent<Velocity>(entities[i], getVx(i), getVy(i));
+        else if (i % 4 == 0)
+            manager.removeComponent<Mass>(entities[i]);
+        else if (i % 2 == 0)
+            manager.getComponent<Mass>(entities[i]).value += 1.0f;
+        else if (i % 3 == 0)
+            manager.addComponent<Mass>(entities[i], getMass(i));
+    }
+    for (auto i = std::size_t(0); i < nbEntities / 4; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Mass>(entity, getMass(i));
+    }
+    applyDelta();
+    checkReplica();
+    // Deltas are chained
+    auto buffer = CommandBuffer();
+    for (auto i = std::size_t(1); i < nbEntities; i += 3)
+    {
+        if (manager.hasEntity(entities[i]) && manager.hasComponent<Position>(entities[i]))
+            buffer.removeComponent<Position>(entities[i]);
+    }
+    buffer.createEntity();
+    buffer.playback(manager);
+    entities.insert(std::end(entities), std::begin(buffer.getCreatedEntities()), std::end(buffer.getCreatedEntities()));
+    applyDelta();
+    checkReplica();
+    // An empty delta
+    applyDelta();
+    checkReplica();
+}
+
+TEST_P(EntityManagerTest, Rollback)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 2 == 0)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 3 == 0)
+            manager.addComponent<Health>(entity, getMass(i));
+    }
+    auto& owningEntitySet = manager.getOwningEntitySet<Position, Velocity>();
+    auto& filteredEntitySet = manager.getEntitySet<With<Position>, Without<Velocity>, Optional<Health>>();
+    // The entity sets of a clone are bound to its own components
+    auto clone = manager.clone();
+    auto& clonedEntitySet = clone->getEntitySet<Velocity, Position>();
+    ASSERT_TRUE(clonedEntitySet.isOwning());
+    ASSERT_EQ(getEntitiesInEntitySet(clone->getEntitySet<Position, Velocity>()), getEntitiesInEntitySet(owningEntitySet));
+    clonedEntitySet.forEach([](Entity, Velocity& velocity, Position& position)
+    {
+        velocity.x = 0.0f;
+        position.x = 0.0f;
+    });
+    owningEntitySet.forEach([](Entity entity, const Position& position, const Velocity& velocity)
+    {
+        ASSERT_EQ(position.x, getX(static_cast<std::size_t>(entity)));
+        ASSERT_EQ(velocity.x, getVx(static_cast<std::size_t>(entity)));
+    });
+    auto& clonedFilteredEntitySet = clone->getEntitySet<With<Position>, Without<Velocity>, Optional<Health>>();
+    auto filteredEntities = std::vector<Entity>();
+    filteredEntitySet.forEach([&filteredEntities](Entity entity, const Position&, const Health*)
+    {
+        filteredEntities.push_back(entity);
+    });
+    auto nbFilteredEntities = std::size_t(0);
+    clonedFilteredEntitySet.forEach([&](Entity entity, const Position&, const Health*)
+    {
+        ASSERT_EQ(entity, filteredEntities[nbFilteredEntities++]);
+    });
+    ASSERT_EQ(nbFilteredEntities, filteredEntities.size());
+    // Save a state per frame, each frame changes the world
+    auto buffer = RollbackBuffer(4);
+    auto check = [&](std::size_t frame)
+    {
+        for (auto i = std::size_t(0); i < nbEntities; ++i)
+        {
+            auto removed = i % 5 < frame;
+            ASSERT_EQ(manager.hasEntity(entities[i]), !removed);
+            if (removed)
+                continue;
+            ASSERT_EQ(manager.getComponent<Position>(entities[i]).x, getX(i) + static_cast<float>(frame));
+            ASSERT_EQ(manager.hasComponent<Velocity>(entities[i]), i % 2 == 0);
+            ASSERT_EQ(manager.hasComponent<Health>(entities[i]), i % 3 == 0);
+        }
+        auto expectedSize = std::size_t(0);
+        for (auto i = std::size_t(0); i < nbEntities; i += 2)
+            expectedSize += i % 5 < frame ? std::size_t(0) : std::size_t(1);
+        ASSERT_EQ(owningEntitySet.getSize(), expectedSize);
+        auto positions = owningEntitySet.getComponents<Position>();
+        auto j = std::size_t(0);
+        owningEntitySet.forEach([&](Entity entity, const Position& position, const Velocity&)
+        {
+            ASSERT_EQ(&position, &positions[j++]);
+            ASSERT_EQ(position.x, getX(static_cast<std::size_t>(entity)) + static_cast<float>(frame));
+        });
+        filteredEntitySet.forEach([&](Entity entity, const Position&, const Health* health)
+        {
+            ASSERT_EQ(health != nullptr, static_cast<std::size_t>(entity) % 3 == 0);
+        });
+    };
+    for (auto frame = std::size_t(0); frame < 5; ++frame)
+    {
+        buffer.save(manager);
+        for (auto i = std::size_t(0); i < nbEntities; ++i)
+        {
+            if (i % 5 == frame)
+                manager.removeEntity(entities[i]);
+            else if (manager.hasEntity(entities[i]))
+                manager.getComponent<Position>(entities[i]).x += 1.0f;
+        }
+        check(frame + 1);
+    }
+    ASSERT_EQ(buffer.getSize(), buffer.getCapacity());
+    // Roll back two frames, the world is restored in place
+    buffer.restore(manager, 1);
+    check(3);
+    ASSERT_EQ(buffer.getSize(), 3);
+    // The entity sets are still maintained and the removed entities are valid again
+    auto newEntity = manager.createEntity();
+    manager.addComponent<Position>(newEntity);
+    manager.addComponent<Velocity>(newEntity);
+    ASSERT_TRUE(owningEntitySet.hasEntity(newEntity));
+    manager.removeEntity(newEntity);
+    check(3);
+    buffer.restore(manager, 2);
+    check(1);
+    // The sets and components missing in the clone are rebuilt from its entities
+    auto& healthEntitySet = manager.getEntitySet<Health>();
+    auto& massEntitySet = manager.getEntitySet<Mass>();
+    if (manager.hasEntity(entities.back()))
+        manager.addComponent<Mass>(entities.back());
+    // Restoring from a clone
+    manager.restoreFrom(*clone);
+    ASSERT_EQ(getEntitiesInEntitySet(owningEntitySet), getEntitiesInEntitySet(clonedEntitySet));
+    ASSERT_EQ(healthEntitySet.getSize(), (nbEntities + 2) / 3);
+    for (auto i = std::size_t(0); i < nbEntities; i += 3)
+        ASSERT_TRUE(healthEntitySet.hasEntity(entities[i]));
+    ASSERT_EQ(massEntitySet.getSize(), 0);
+    if (nbEntities > 0)
+    {
+        manager.removeEntity(entities.front());
+        ASSERT_FALSE(healthEntitySet.hasEntity(entities.front()));
+        manager.restoreFrom(*clone);
+    }
+    owningEntitySet.forEach([](Entity entity, const Position& position, const Velocity& velocity)
+    {
+        ASSERT_EQ(position.x, 0.0f);
+        ASSERT_EQ(velocity.y, getVy(static_cast<std::size_t>(entity)));
+    });
+    // Components that cannot be copied prevent copies, without modifying anything
+    auto entity = manager.createEntity();
+    manager.addComponent<Handle>(entity);
+    ASSERT_EQ(manager.clone(), nullptr);
+    auto nbStates = buffer.getSize();
+    ASSERT_FALSE(buffer.save(manager));
+    ASSERT_EQ(buffer.getSize(), nbStates);
+    ASSERT_FALSE(manager.restoreFrom(*clone));
+    ASSERT_TRUE(manager.hasComponent<Handle>(entity));
+    // States that are not saved cannot be restored
+    ASSERT_FALSE(buffer.restore(manager, nbStates));
+    ASSERT_TRUE(manager.hasComponent<Handle>(entity));
+    ASSERT_THROW(buffer.getState(nbStates), std::out_of_range);
+    ASSERT_THROW(RollbackBuffer(0), std::invalid_argument);
+}
+
+TEST_P(EntityManagerTest, CloneOwningPermutation)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = manager.createEntity();
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 2 == 0)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    // The ownership is taken through a permutation of the canonical set
+    static_assert(!EntitySet<Velocity, Position>::IsCanonical);
+    manager.getOwningEntitySet<Velocity, Position>();
+    auto check = [](EntityManager& copy)
+    {
+        ASSERT_TRUE((copy.getEntitySet<Position, Velocity>().isOwning()));
+        ASSERT_THROW((copy.getOwningEntitySet<Position, Mass>()), std::logic_error);
+        ASSERT_THROW((copy.getOwningEntitySet<Mass, Velocity>()), std::logic_error);
+        copy.getEntitySet<Velocity, Position>().forEach([](Entity entity, const Velocity& velocity,
+            const Position& position)
+        {
+            ASSERT_EQ(position.x, getX(static_cast<std::size_t>(entity)));
+            ASSERT_EQ(velocity.x, getVx(static_cast<std::size_t>(entity)));
+        });
+    };
+    auto clone = manager.clone();
+    check(*clone);
+    auto restored = EntityManager();
+    ASSERT_TRUE(restored.restoreFrom(manager));
+    check(restored);
+}
+
+TEST_P(EntityManagerTest, ComponentOwnedTwice)
+{
+    auto& owningEntitySet = manager.getOwningEntitySet<Position, Velocity>();
+    auto& entitySet = manager.getEntitySet<Velocity, Mass>();
+    ASSERT_THROW((manager.getOwningEntitySet<Velocity, Mass>()), std::logic_error);
+    ASSERT_TRUE(owningEntitySet.isOwning());
+    ASSERT_FALSE(entitySet.isOwning());
+    // Getting the owning set again is allowed
+    auto& sameEntitySet = manager.getOwningEntitySet<Position, Velocity>();
+    ASSERT_EQ(&sameEntitySet, &owningEntitySet);
+}
+
+TEST_P(EntityManagerTest, SystemAccess)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = manager.createEntity();
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 2 == 0)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    auto pool = ThreadPool(2);
+    auto scheduler = Scheduler(manager, pool);
+    // Only the written components are mutable
+    scheduler.addSystem<EntitySet<Position, Velocity>, Read<>, Write<Position>>("integrate", [](auto& entitySet)
+    {
+        entitySet.forEach([](Entity, auto& position, auto& velocity)
+        {
+            static_assert(!std::is_const_v<std::remove_reference_t<decltype(position)>>);
+            static_assert(std::is_const_v<std::remove_reference_t<decltype(velocity)>>);
+            position.x += velocity.x;
+        });
+    });
+    scheduler.addSystem<EntitySet<With<Position>, Without<>, Optional<Mass>>, Read<>, Write<Position>>("weigh", [](auto& entitySet)
+    {
+        entitySet.forEach([](Entity, Position& position, auto* mass)
+        {
+            static_assert(std::is_const_v<std::remove_pointer_t<decltype(mass)>>);
+            if (mass != nullptr)
+                position.y += mass->value;
+        });
+    });
+    // The entity set itself is given to systems that write all its components
+    scheduler.addSystem<EntitySet<Velocity>, Read<>, Write<Velocity>>("damp", [](auto& entitySet)
+    {
+        static_assert(std::is_same_v<std::remove_reference_t<decltype(entitySet)>, EntitySet<Velocity>>);
+    });
+    scheduler.run();
+}
+
+TEST_P(EntityManagerTest, Visitor)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        if (i % 4 >= 1)
+            manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 4 >= 2)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 4 >= 3)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    // Visit
+    auto counterPosition = std::size_t(0);
+    auto counterVelocity = std::size_t(0);
+    auto counterMass = std::size_t(0);
+    auto visitor = Visitor();
+    visitor.setHandler<Position>([&counterPosition]([[maybe_unused]] const auto& position)
+    {
+        ++counterPosition;
+    });
+    visitor.setHandler<Velocity>([&counterVelocity]([[maybe_unused]] const auto& velocity)
+    {
+        ++counterVelocity;
+    });
+    visitor.setHandler<Mass>([&counterMass]([[maybe_unused]] const auto& mass)
+    {
+        ++counterMass;
+    });
+    for (auto entity : entities)
+        manager.visitEntity(entity, visitor);
+    // Tests
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), counterPosition);
+    ASSERT_EQ(manager.getEntitySet<Velocity>().getSize(), counterVelocity);
+    ASSERT_EQ(manager.getEntitySet<Mass>().getSize(), counterMass);
+    // The handled components are marked as modified, the others are not
+    auto tick = manager.nextTick();
+    auto massVisitor = Visitor();
+    massVisitor.setHandler<Mass>([](Mass& mass)
+    {
+        mass.value += 1.0f;
+    });
+    for (auto entity : entities)
+        manager.visitEntity(entity, massVisitor);
+    auto nbChanged = std::size_t(0);
+    std::as_const(manager.getEntitySet<Mass>()).forEach<Changed<Mass>>(tick - 1,
+        [&nbChanged]([[maybe_unused]] Entity entity, [[maybe_unused]] const Mass& mass)
+        {
+            ++nbChanged;
+        });
+    ASSERT_EQ(nbChanged, counterMass);
+}
+
+TEST_P(EntityManagerTest, TypedVisitor)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        if (i % 4 >= 1)
+            manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 4 >= 2)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        if (i % 4 >= 3)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    // Visit each entity, Mass is not visited
+    auto counterPosition = std::size_t(0);
+    auto counterVelocity = std::size_t(0);
+    auto visit = [&](auto& component)
+    {
+        using T = std::decay_t<decltype(component)>;
+        static_assert(!std::is_same_v<T, Mass>);
+        if constexpr (std::is_same_v<T, Position>)
+            ++counterPosition;
+        else
+            ++counterVelocity;
+    };
+    for (auto entity : entities)
+        manager.visitEntity<Position, Velocity>(entity, visit);
+    ASSERT_EQ(manager.getEntitySet<Position>().getSize(), counterPosition);
+    ASSERT_EQ(manager.getEntitySet<Velocity>().getSize(), counterVelocity);
+    // Visit all the entities at once
+    auto i = std::size_t(0);
+    manager.visitEntities<Mass, Position>(entities, [&](Entity entity, auto& component)
+    {
+        using T = std::decay_t<decltype(component)>;
+        auto j = static_cast<std::size_t>(entity);
+        if constexpr (std::is_same_v<T, Mass>)
+        {
+            ASSERT_EQ(component.value, getMass(j));
+            component.value = 0.0f;
+        }
+        else
+            ASSERT_EQ(component.x, getX(j));
+        ++i;
+    });
+    ASSERT_EQ(i, manager.getEntitySet<Position>().getSize() + manager.getEntitySet<Mass>().getSize());
+    manager.getEntitySet<Mass>().forEach([]([[maybe_unused]] Entity entity, const Mass& mass)
+    {
+        ASSERT_EQ(mass.value, 0.0f);
+    });
+    // Read-only visits do not mark the components as modified, mutable ones do
+    auto getNbChangedMasses = [this](Tick tick)
+    {
+        auto nbChangedMasses = std::size_t(0);
+        std::as_const(manager.getEntitySet<Mass>()).forEach<Changed<Mass>>(tick,
+            [&nbChangedMasses]([[maybe_unused]] Entity entity, [[maybe_unused]] const Mass& mass)
+            {
+                ++nbChangedMasses;
+            });
+        return nbChangedMasses;
+    };
+    auto tick = manager.nextTick();
+    for (auto entity : entities)
+        manager.visitEntity<Mass>(entity, []([[maybe_unused]] const Mass& mass){});
+    manager.visitEntities<Mass>(entities, []([[maybe_unused]] Entity entity, [[maybe_unused]] const Mass& mass){});
+    ASSERT_EQ(getNbChangedMasses(tick - 1), 0);
+    manager.visitEntities<Mass>(entities, []([[maybe_unused]] Entity entity, [[maybe_unused]] Mass& mass){});
+    ASSERT_EQ(getNbChangedMasses(tick - 1), manager.getEntitySet<Mass>().getSize());
+}
+
+class ArchetypeEntityManagerTest : public ::testing::TestWithParam<std::tuple<bool, std::size_t>>
+{
+protected:
+    ArchetypeEntityManager manager;
+};
+
+TEST_P(ArchetypeEntityManagerTest, AddSeveralComponentsAndRemoveSome)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        manager.addComponent<Position>(entity, getX(i), getY(i));
+        manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+        manager.addComponent<Mass>(entity, getMass(i));
+    }
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        auto entity = entities[i];
+        if (i % 4 >= 1)
+            manager.removeComponent<Position>(entity);
+        if (i % 4 >= 2)
+            manager.removeComponent<Velocity>(entity);
+        if (i % 4 >= 3)
+            manager.removeComponent<Mass>(entity);
+    }
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        auto entity = entities[i];
+        ASSERT_EQ(manager.hasComponent<Position>(entity), i % 4 < 1);
+        ASSERT_EQ(manager.hasComponent<Velocity>(entity), i % 4 < 2);
+        ASSERT_EQ(manager.hasComponent<Mass>(entity), i % 4 < 3);
+        if (i % 4 < 1)
+        {
+            const auto& position = manager.getComponent<Position>(entity);
+            ASSERT_EQ(position.x, getX(i));
+            ASSERT_EQ(position.y, getY(i));
+        }
+        if (i % 4 < 2)
+        {
+            const auto& velocity = std::as_const(manager).getComponent<Velocity>(entity);
+            ASSERT_EQ(velocity.x, getVx(i));
+            ASSERT_EQ(velocity.y, getVy(i));
+        }
+        if (i % 4 < 3)
+        {
+            const auto& mass = manager.getComponent<Mass>(entity);
+            ASSERT_EQ(mass.value, getMass(i));
+        }
+    }
+    auto entitySetSize = manager.getEntitySet<Position, Velocity, Mass>().getSize();
+    ASSERT_EQ(entitySetSize, (nbEntities - 1) / 4 + 1);
+}
+
+TEST_P(ArchetypeEntityManagerTest, AddAndRemoveSomeEntities)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    auto entities = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = entities.emplace_back(manager.createEntity());
+        if (i % 4 >= 1)
+            manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 4 >= 2)
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+    }
+    // A component whose constructor throws is not added and the entity keeps its components
+    for (auto i = std::size_t(0); i < entities.size(); i += 5)
+    {
+        ASSERT_THROW(manager.addComponent<Fragile>(entities[i], true), std::runtime_error);
+        ASSERT_FALSE(manager.hasComponent<Fragile>(entities[i]));
+        if (i % 2 == 0)
+            manager.addComponent<Fragile>(entities[i], false);
+    }
+    for (auto i = std::size_t(0); i < entities.size(); i += 3)
+        manager.removeEntity(entities[i]);
+    for (auto i = std::size_t(0); i < entities.size(); ++i)
+    {
+        auto entity = entities[i];
+        if (i % 3 == 0)
+        {
+            ASSERT_FALSE(manager.hasEntity(entity));
+            continue;
+        }
+        ASSERT_TRUE(manager.hasEntity(entity));
+        ASSERT_EQ(manager.hasComponent<Fragile>(entity), i % 10 == 0);
+        if (i % 4 >= 2)
+        {
+            auto hasPositionAndVelocity = manager.hasComponents<Position, Velocity>(entity);
+            ASSERT_TRUE(hasPositionAndVelocity);
+            auto [position, velocity] = manager.getComponents<Position, Velocity>(entity);
+            ASSERT_EQ(position.x, getX(i));
+            ASSERT_EQ(velocity.y, getVy(i));
+        }
+    }
+}
+
+TEST_P(ArchetypeEntityManagerTest, Reserve)
+{
+    auto [reserve, nbEntities] = GetParam();
+    auto archetype = Archetype({});
+    if (reserve)
+        archetype.reserve(nbEntities);
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+        archetype.allocate(static_cast<Entity>(i));
+    auto capacity = archetype.getCapacity();
+    ASSERT_GE(capacity, nbEntities);
+    // Erasing the rows keeps the reserved chunks and a spare one
+    while (archetype.getSize() > 0)
+        archetype.erase(archetype.getSize() - 1);
+    if (reserve)
+        ASSERT_EQ(archetype.getCapacity(), capacity);
+    else
+        ASSERT_EQ(archetype.getCapacity(), archetype.getChunkCapacity());
+}
+
+TEST_P(ArchetypeEntityManagerTest, EntitySet)
+{
+    auto [reserve, nbEntities] = GetParam();
+    if (reserve)
+        manager.reserve(nbEntities);
+    // Create the entity set before the archetypes to check it is updated
+    auto& entitySet = manager.getEntitySet<Position, Velocity>();
+    auto entitiesWithTwo = std::vector<Entity>();
+    for (auto i = std::size_t(0); i < nbEntities; ++i)
+    {
+        auto entity = manager.createEntity();
+        if (i % 4 >= 1)
+            manager.addComponent<Position>(entity, getX(i), getY(i));
+        if (i % 4 >= 2)
+        {
+            manager.addComponent<Velocity>(entity, getVx(i), getVy(i));
+            entitiesWithTwo.push_back(entity);
+        }
+        if (i % 4 >= 3)
+            manager.addComponent<Mass>(entity, getMass(i));
+    }
+    auto entitiesInEntitySet = getEntitiesInEntitySet(entitySet);
+    std::sort(std::begin(entitiesWithTwo), std::end(entitiesWithTwo));
+    std::sort(std::begin(entitiesInEntitySet), std::end(entitiesInEntitySet));
+    ASSERT_EQ(entitiesWithTwo, entitiesInEntitySet);
+    // Check the components seen during iteration
+    for (auto [entity, components] : entitySet)
+    {
+        auto [position, velocity] = components;
+        ASSERT_EQ(&position, &manager.getComponent<Position>(entity));
+        ASSERT_EQ(&velocity, &manager.getComponent<Velocity>(entity));
+    }
+    auto counter = std::size_t(0);
+    entitySet.forEach([&counter]([[maybe_unused]] Entity entity, Position& position, const Velocity& velocity)
+    {
+        position.x += velocity.x;
+        ++counter;
+    });
+    ASSERT_EQ(counter, entitiesWithTwo.size());
+    // Entity sets created afterwards see the existing archetypes
+    auto entitySetSize = manager.getEntitySet<Position>().getSize();
+    ASSERT_EQ(entitySetSize, nbEntities - (nbEntities + 3) / 4);
 }
 
 // Seems that I use an old version of googletest, should be replaced by INSTANTIATE_TEST_SUITE in latter version
 INSTANTIATE_TEST_CASE_P(ReserveAndNbEntities, EntityManagerTest, ::testing::Combine(::testing::Values(false, true), ::testing::Values(1, 100, 10000)));
+INSTANTIATE_TEST_CASE_P(ReserveAndNbEntities, ArchetypeEntityManagerTest, ::testing::Combine(::testing::Values(false, true), ::testing::Values(1, 100, 10000)));
 
 int main(int argc, char **argv)
 {